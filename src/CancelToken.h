@@ -0,0 +1,23 @@
+#pragma once
+#include <atomic>
+
+// Flag one thread raises to stop a scan or search running on another.
+//
+// The long loops poll it at chunk granularity: once per $MFT read, per FAT
+// or exFAT directory cluster and every few thousand search candidates. A
+// cancelled scan fails with ERROR_CANCELLED and its partial index is thrown
+// away; a cancelled search stops delivering results. Reset() before reusing
+// the token for the next operation.
+class CancelToken {
+public:
+  CancelToken() : cancelled(false) {}
+
+  void Cancel() { cancelled.store(true, std::memory_order_relaxed); }
+  void Reset() { cancelled.store(false, std::memory_order_relaxed); }
+  bool IsCancelled() const {
+    return cancelled.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<bool> cancelled;
+};
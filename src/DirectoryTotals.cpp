@@ -0,0 +1,140 @@
+#include "DirectoryTotals.h"
+#include <algorithm>
+
+DirectoryTotals::DirectoryTotals()
+    : rootId(EntryStore::NoParent), generation(0), built(false) {}
+
+void DirectoryTotals::Clear() {
+  std::vector<uint32_t>().swap(slots);
+  std::vector<Totals>().swap(totals);
+  volume = Totals();
+  built = false;
+}
+
+static void AddTotals(DirectoryTotals::Totals &into,
+                      const DirectoryTotals::Totals &from) {
+  into.size += from.size;
+  into.allocated += from.allocated;
+  into.files += from.files;
+  into.directories += from.directories;
+}
+
+void DirectoryTotals::Build(const EntryStore &store, const DirectoryTree &tree,
+                            uint32_t root) {
+  rootId = root;
+  slots.assign(store.IdLimit(), NoSlot);
+  totals.clear();
+  volume = Totals();
+
+  // Directories whose subtree is still open, innermost last
+  struct Open {
+    uint32_t end; // Tree position where the subtree ends
+    uint32_t slot;
+  };
+  std::vector<Open> open;
+  auto innermost = [&]() -> Totals & {
+    return open.empty() ? volume : totals[open.back().slot];
+  };
+  auto close = [&]() {
+    uint32_t slot = open.back().slot;
+    open.pop_back();
+    AddTotals(innermost(), totals[slot]);
+  };
+
+  const std::vector<uint32_t> &order = tree.Order();
+  for (uint32_t p = 0; p < (uint32_t)order.size(); p++) {
+    while (!open.empty() && open.back().end <= p)
+      close();
+    uint32_t id = order[p];
+    if (id == rootId) {
+      // Its children hang off the tree's virtual root, i.e. the volume
+      volume.allocated += store.AllocatedSize(id);
+      continue;
+    }
+    if (!store.IsDirectory(id)) {
+      Totals &into = innermost();
+      into.size += store.Size(id);
+      into.allocated += store.AllocatedSize(id);
+      into.files++;
+      continue;
+    }
+    innermost().directories++;
+    Totals own;
+    own.allocated = store.AllocatedSize(id);
+    Open dir;
+    dir.end = tree.SubtreeEnd(p);
+    dir.slot = (uint32_t)totals.size();
+    slots[id] = dir.slot;
+    totals.push_back(own);
+    open.push_back(dir);
+  }
+  while (!open.empty())
+    close();
+
+  generation = store.Generation();
+  built = true;
+}
+
+DirectoryTotals::Totals DirectoryTotals::Of(uint32_t id) const {
+  if (id == rootId)
+    return volume;
+  if (id >= slots.size() || slots[id] == NoSlot)
+    return Totals();
+  return totals[slots[id]];
+}
+
+std::vector<uint32_t> DirectoryTotals::Largest(const DirectoryTree &tree,
+                                               DirectoryTree::Range range,
+                                               size_t count) const {
+  std::vector<uint32_t> ids;
+  const std::vector<uint32_t> &order = tree.Order();
+  for (uint32_t p = range.first; p < range.second; p++) {
+    uint32_t id = order[p];
+    if (id < slots.size() && slots[id] != NoSlot)
+      ids.push_back(id);
+  }
+  auto larger = [this](uint32_t a, uint32_t b) {
+    return totals[slots[a]].allocated > totals[slots[b]].allocated;
+  };
+  if (ids.size() > count) {
+    std::partial_sort(ids.begin(), ids.begin() + count, ids.end(), larger);
+    ids.resize(count);
+  } else {
+    std::sort(ids.begin(), ids.end(), larger);
+  }
+  return ids;
+}
+
+std::vector<DirectoryUsage>
+ReportDiskUsage(const EntryStore &entries, PathCache &paths,
+                DirectoryTree &tree, DirectoryTotals &totals, uint32_t rootId,
+                const std::wstring &folder, size_t count) {
+  std::vector<DirectoryUsage> report;
+  if (!tree.IsCurrent(entries))
+    tree.Build(entries, rootId);
+  if (!totals.IsCurrent(entries))
+    totals.Build(entries, tree, rootId);
+
+  DirectoryTree::Range range(0, tree.Size());
+  if (!folder.empty() && !tree.Resolve(entries, folder, range))
+    return report;
+
+  DirectoryUsage usage;
+  if (range.first == 0 && range.second == tree.Size()) {
+    usage.path = paths.RootPath();
+    usage.totals = totals.Volume();
+  } else {
+    uint32_t id = tree.Order()[range.first];
+    usage.path = paths.FullPath(entries, id);
+    usage.totals = totals.Of(id);
+    range.first++; // Only what lies below
+  }
+  report.push_back(usage);
+
+  for (uint32_t id : totals.Largest(tree, range, count)) {
+    usage.path = paths.FullPath(entries, id);
+    usage.totals = totals.Of(id);
+    report.push_back(usage);
+  }
+  return report;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "DirectoryTree.h"
+#include "EntryStore.h"
+#include "PathCache.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Recursive disk usage of every directory in an EntryStore: the logical and
+// allocated bytes and the file and folder counts of everything below it.
+//
+// Built in one pass over a DirectoryTree's preorder. A stack holds the
+// directories whose subtree is still open; each entry adds to the innermost
+// one, and a directory folds into its parent once its subtree ends, so the
+// totals come out bottom-up without walking a parent chain per entry. Every
+// file counts once, under its own parent: further hard links add nothing,
+// and named streams are already part of their file's allocation.
+class DirectoryTotals {
+public:
+  struct Totals {
+    uint64_t size;      // Logical bytes of the files below
+    uint64_t allocated; // Bytes on disk, directory indexes included
+    uint64_t files;
+    uint64_t directories;
+
+    Totals() : size(0), allocated(0), files(0), directories(0) {}
+  };
+
+  DirectoryTotals();
+
+  // `rootId` as given to DirectoryTree::Build; the root's totals are the
+  // volume's. `tree` must be current for `store`.
+  void Build(const EntryStore &store, const DirectoryTree &tree,
+             uint32_t rootId);
+  bool IsCurrent(const EntryStore &store) const {
+    return built && generation == store.Generation();
+  }
+  void Clear();
+
+  const Totals &Volume() const { return volume; }
+  // Totals below directory `id`, its own index included; zeros for a file.
+  Totals Of(uint32_t id) const;
+  // Directories at tree positions [range.first, range.second) with the most
+  // allocated bytes, largest first, at most `count`.
+  std::vector<uint32_t> Largest(const DirectoryTree &tree,
+                                DirectoryTree::Range range,
+                                size_t count) const;
+
+private:
+  static constexpr uint32_t NoSlot = 0xFFFFFFFF;
+
+  std::vector<uint32_t> slots; // By id: index into totals, NoSlot for files
+  std::vector<Totals> totals;
+  Totals volume;
+  uint32_t rootId;
+  uint64_t generation;
+  bool built;
+};
+
+// One line of a disk usage report.
+struct DirectoryUsage {
+  std::wstring path;
+  DirectoryTotals::Totals totals;
+};
+
+// The disk usage report shared by all readers: `folder` itself (the whole
+// volume when empty), then the `count` directories below it with the most
+// allocated bytes. Tree and totals are rebuilt when the store changed. Empty
+// when the folder is not on the volume.
+std::vector<DirectoryUsage>
+ReportDiskUsage(const EntryStore &entries, PathCache &paths,
+                DirectoryTree &tree, DirectoryTotals &totals, uint32_t rootId,
+                const std::wstring &folder, size_t count);
@@ -0,0 +1,168 @@
+#include "DirectoryTree.h"
+#include <algorithm>
+#include <cwctype>
+
+DirectoryTree::DirectoryTree() : generation(0), built(false) {}
+
+void DirectoryTree::Clear() {
+  std::vector<uint32_t>().swap(order);
+  std::vector<uint32_t>().swap(subtreeEnd);
+  built = false;
+}
+
+void DirectoryTree::Build(const EntryStore &store, uint32_t rootId) {
+  uint32_t limit = store.IdLimit();
+  const uint32_t virtualRoot = limit; // Parent slot for top-level entries
+
+  // Group children by parent (counting sort) so each directory's children
+  // are contiguous
+  auto parentOf = [&](uint32_t id) -> uint32_t {
+    uint32_t parent = store.Parent(id);
+    if (parent == id || parent == rootId || !store.IsValid(parent))
+      return virtualRoot;
+    return parent;
+  };
+  std::vector<uint32_t> childStart((size_t)limit + 2, 0);
+  for (uint32_t id = 0; id < limit; id++) {
+    if (store.IsValid(id))
+      childStart[parentOf(id) + 1]++;
+  }
+  for (size_t i = 1; i < childStart.size(); i++)
+    childStart[i] += childStart[i - 1];
+  std::vector<uint32_t> children(store.Count());
+  {
+    std::vector<uint32_t> fill(childStart.begin(), childStart.end() - 1);
+    for (uint32_t id = 0; id < limit; id++) {
+      if (store.IsValid(id))
+        children[fill[parentOf(id)]++] = id;
+    }
+  }
+
+  order.clear();
+  order.reserve(store.Count());
+  subtreeEnd.assign(store.Count(), 0);
+  std::vector<bool> visited(limit, false);
+
+  // Iterative DFS; each frame is (id, next child index)
+  std::vector<std::pair<uint32_t, uint32_t>> stack;
+  auto walk = [&](uint32_t start) {
+    visited[start] = true;
+    stack.push_back(std::make_pair(start, childStart[start]));
+    order.push_back(start);
+    while (!stack.empty()) {
+      auto &frame = stack.back();
+      if (frame.second < childStart[frame.first + 1]) {
+        uint32_t child = children[frame.second++];
+        if (visited[child])
+          continue;
+        visited[child] = true;
+        order.push_back(child);
+        stack.push_back(std::make_pair(child, childStart[child]));
+      } else {
+        // Position of the frame's entry is where it was pushed to order
+        stack.pop_back();
+      }
+    }
+  };
+
+  // Positions are only known once pushed, so record them alongside
+  std::vector<uint32_t> position(limit, 0);
+  auto walkTopLevel = [&](uint32_t id) {
+    size_t first = order.size();
+    walk(id);
+    for (size_t p = first; p < order.size(); p++)
+      position[order[p]] = (uint32_t)p;
+  };
+
+  for (uint32_t i = childStart[virtualRoot]; i < childStart[virtualRoot + 1];
+       i++) {
+    if (!visited[children[i]])
+      walkTopLevel(children[i]);
+  }
+  // Entries caught in a parent cycle were never reached from the root
+  for (uint32_t id = 0; id < limit; id++) {
+    if (store.IsValid(id) && !visited[id])
+      walkTopLevel(id);
+  }
+
+  // A subtree ends where the next entry outside it starts: walk positions
+  // backwards, so every child's end is known before its parent's
+  for (uint32_t p = (uint32_t)order.size(); p-- > 0;)
+    subtreeEnd[p] = p + 1;
+  for (uint32_t p = (uint32_t)order.size(); p-- > 0;) {
+    uint32_t id = order[p];
+    uint32_t parent = parentOf(id);
+    if (parent == virtualRoot)
+      continue;
+    uint32_t parentPos = position[parent];
+    // Only a true tree parent (placed before its child) owns the child
+    if (parentPos < p && subtreeEnd[parentPos] < subtreeEnd[p])
+      subtreeEnd[parentPos] = subtreeEnd[p];
+  }
+
+  generation = store.Generation();
+  built = true;
+}
+
+static bool NameEquals(const wchar_t *a, size_t aLen, const std::wstring &b) {
+  if (aLen != b.length())
+    return false;
+  for (size_t i = 0; i < aLen; i++) {
+    if (towlower(a[i]) != towlower(b[i]))
+      return false;
+  }
+  return true;
+}
+
+bool DirectoryTree::Resolve(const EntryStore &store, const std::wstring &path,
+                            Range &range) const {
+  // Skip the drive; the caller only passes paths on this volume
+  size_t pos = 0;
+  if (path.length() >= 2 && path[1] == L':')
+    pos = 2;
+
+  Range current(0, Size());
+  bool atRoot = true;
+  while (pos < path.length()) {
+    size_t next = path.find(L'\\', pos);
+    if (next == std::wstring::npos)
+      next = path.length();
+    std::wstring component = path.substr(pos, next - pos);
+    pos = next + 1;
+    if (component.empty() || component == L".")
+      continue;
+
+    // Children are the entries after the directory itself, each followed by
+    // its own subtree
+    uint32_t p = atRoot ? current.first : current.first + 1;
+    bool found = false;
+    while (p < current.second) {
+      uint32_t id = order[p];
+      if (store.IsDirectory(id) &&
+          NameEquals(store.Name(id), store.NameLength(id), component)) {
+        current = Range(p, subtreeEnd[p]);
+        found = true;
+        break;
+      }
+      p = subtreeEnd[p];
+    }
+    if (!found)
+      return false;
+    atRoot = false;
+  }
+  range = current;
+  return true;
+}
+
+std::vector<DirectoryTree::Range>
+DirectoryTree::Merge(std::vector<Range> ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<Range> merged;
+  for (const auto &r : ranges) {
+    // Subtrees are either nested or disjoint
+    if (!merged.empty() && r.first < merged.back().second)
+      continue;
+    merged.push_back(r);
+  }
+  return merged;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "EntryStore.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Preorder (Euler tour) layout of the directory tree in an EntryStore.
+//
+// Every entry gets a position in Order() such that a directory at position p
+// and everything below it occupy [p, SubtreeEnd(p)). A folder filter then
+// becomes a contiguous range instead of a per-entry path comparison, and
+// several folders become a handful of merged ranges.
+//
+// Entries whose parent is the root, missing or themselves hang off a virtual
+// root covering [0, Size()). Entries only reachable through a parent cycle
+// are attached there too, so every valid entry has exactly one position.
+class DirectoryTree {
+public:
+  typedef std::pair<uint32_t, uint32_t> Range; // [begin, end) positions
+
+  DirectoryTree();
+
+  // `rootId` is the root directory's own id (NTFS record 5), or
+  // EntryStore::NoParent when the root has no entry.
+  void Build(const EntryStore &store, uint32_t rootId);
+  bool IsCurrent(const EntryStore &store) const {
+    return built && generation == store.Generation();
+  }
+  void Clear();
+
+  uint32_t Size() const { return (uint32_t)order.size(); }
+  const std::vector<uint32_t> &Order() const { return order; }
+  uint32_t SubtreeEnd(uint32_t position) const { return subtreeEnd[position]; }
+
+  // Resolves "X:\dir\sub" (drive and trailing backslash optional) to the
+  // positions of that directory's subtree. The root resolves to the whole
+  // tree. Names compare case-insensitively.
+  bool Resolve(const EntryStore &store, const std::wstring &path,
+               Range &range) const;
+
+  // Sorts ranges and drops those nested in another.
+  static std::vector<Range> Merge(std::vector<Range> ranges);
+
+private:
+  std::vector<uint32_t> order;      // Entry ids in preorder
+  std::vector<uint32_t> subtreeEnd; // By position
+  uint64_t generation;
+  bool built;
+};
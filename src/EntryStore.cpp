@@ -0,0 +1,370 @@
+#include "EntryStore.h"
+#include <algorithm>
+
+EntryStore::EntryStore()
+    : count(0), deadNameChars(0), generation(0), directoryGeneration(0),
+      loggedSince(0) {}
+
+void EntryStore::Clear() {
+  // Release the memory, not just the contents
+  std::vector<uint32_t>().swap(parents);
+  std::vector<uint64_t>().swap(sizes);
+  std::vector<uint64_t>().swap(allocatedSizes);
+  std::vector<uint64_t>().swap(times);
+  std::vector<uint64_t>().swap(creationTimes);
+  std::vector<uint64_t>().swap(accessTimes);
+  std::vector<uint64_t>().swap(changeTimes);
+  std::vector<uint16_t>().swap(attributes);
+  std::vector<uint32_t>().swap(nameOffsets);
+  std::vector<uint8_t>().swap(nameLengths);
+  std::vector<uint8_t>().swap(flags);
+  std::vector<wchar_t>().swap(names);
+  std::vector<wchar_t>().swap(foldedNames);
+  std::vector<uint16_t>().swap(foldTable);
+  ClearList(links);
+  std::vector<uint32_t>().swap(linkParents);
+  ClearList(streams);
+  std::vector<uint64_t>().swap(streamSizes);
+  count = 0;
+  deadNameChars = 0;
+  generation++;
+  directoryGeneration++;
+  std::vector<Change>().swap(changeLog);
+  loggedSince = generation;
+}
+
+void EntryStore::Changed(uint32_t id) {
+  generation++;
+  if (changeLog.size() >= ChangeLogLimit) {
+    // Drop the older half; whoever is that far behind rebuilds
+    changeLog.erase(changeLog.begin(),
+                    changeLog.begin() + ChangeLogLimit / 2);
+    loggedSince = changeLog.front().generation - 1;
+  }
+  Change change;
+  change.generation = generation;
+  change.id = id;
+  changeLog.push_back(change);
+}
+
+bool EntryStore::ChangedSince(uint64_t since,
+                              std::vector<uint32_t> &ids) const {
+  if (since < loggedSince)
+    return false;
+  auto first = std::upper_bound(
+      changeLog.begin(), changeLog.end(), since,
+      [](uint64_t value, const Change &c) { return value < c.generation; });
+  for (auto it = first; it != changeLog.end(); ++it)
+    ids.push_back(it->id);
+  return true;
+}
+
+void EntryStore::Reserve(size_t entries, size_t nameChars) {
+  parents.reserve(entries);
+  sizes.reserve(entries);
+  allocatedSizes.reserve(entries);
+  times.reserve(entries);
+  creationTimes.reserve(entries);
+  accessTimes.reserve(entries);
+  changeTimes.reserve(entries);
+  attributes.reserve(entries);
+  nameOffsets.reserve(entries);
+  nameLengths.reserve(entries);
+  flags.reserve(entries);
+  names.reserve(nameChars);
+  if (!foldTable.empty())
+    foldedNames.reserve(nameChars);
+}
+
+void EntryStore::Grow(uint32_t id) {
+  if (id < flags.size())
+    return;
+  size_t n = (size_t)id + 1;
+  parents.resize(n, NoParent);
+  sizes.resize(n, 0);
+  allocatedSizes.resize(n, 0);
+  times.resize(n, 0);
+  creationTimes.resize(n, 0);
+  accessTimes.resize(n, 0);
+  changeTimes.resize(n, 0);
+  attributes.resize(n, 0);
+  nameOffsets.resize(n, 0);
+  nameLengths.resize(n, 0);
+  flags.resize(n, 0);
+}
+
+void EntryStore::Set(uint32_t id, uint32_t parent, const wchar_t *name,
+                     size_t nameLength, uint64_t size, uint64_t lastWriteTime,
+                     bool isDirectory) {
+  if (nameLength > 255)
+    nameLength = 255;
+  Grow(id);
+  DropList(links, EntryFlag_Linked, id);
+  DropList(streams, EntryFlag_Streams, id);
+  if (flags[id] & EntryFlag_Valid)
+    deadNameChars += nameLengths[id];
+  else
+    count++;
+  Changed(id);
+  if (isDirectory || (flags[id] & EntryFlag_Directory))
+    directoryGeneration++;
+
+  parents[id] = parent;
+  sizes[id] = size;
+  allocatedSizes[id] = 0;
+  times[id] = lastWriteTime;
+  creationTimes[id] = 0;
+  accessTimes[id] = 0;
+  changeTimes[id] = 0;
+  attributes[id] = 0;
+  nameOffsets[id] = (uint32_t)names.size();
+  nameLengths[id] = (uint8_t)nameLength;
+  flags[id] = EntryFlag_Valid | (isDirectory ? EntryFlag_Directory : 0);
+  names.insert(names.end(), name, name + nameLength);
+  if (!foldTable.empty())
+    AppendFolded(name, nameLength);
+
+  // Renames leave the old name behind; reclaim once most of the arena is dead
+  if (deadNameChars > 4096 && deadNameChars > names.size() / 2)
+    CompactNames();
+}
+
+uint32_t EntryStore::Append(uint32_t parent, const wchar_t *name,
+                            size_t nameLength, uint64_t size,
+                            uint64_t lastWriteTime, bool isDirectory) {
+  uint32_t id = (uint32_t)flags.size();
+  Set(id, parent, name, nameLength, size, lastWriteTime, isDirectory);
+  return id;
+}
+
+void EntryStore::SetTimes(uint32_t id, const EntryTimes &entryTimes) {
+  creationTimes[id] = entryTimes.creation;
+  accessTimes[id] = entryTimes.lastAccess;
+  changeTimes[id] = entryTimes.change;
+}
+
+EntryTimes EntryStore::Times(uint32_t id) const {
+  EntryTimes entryTimes;
+  entryTimes.creation = creationTimes[id];
+  entryTimes.lastAccess = accessTimes[id];
+  entryTimes.change = changeTimes[id];
+  return entryTimes;
+}
+
+void EntryStore::AddLink(uint32_t id, uint32_t parent, const wchar_t *name,
+                         size_t nameLength) {
+  if (!IsValid(id))
+    return;
+  if (nameLength > 255)
+    nameLength = 255;
+  AddToList(links, EntryFlag_Linked, id, name, nameLength);
+  linkParents.push_back(parent);
+}
+
+void EntryStore::AddStream(uint32_t id, const wchar_t *name,
+                           size_t nameLength, uint64_t size) {
+  if (!IsValid(id))
+    return;
+  if (nameLength > 255)
+    nameLength = 255;
+  // Stored as "file:stream". Composed on the stack, since Name(id) lives in
+  // the arena being appended to
+  wchar_t full[255 + 1 + 255];
+  size_t ownerLength = NameLength(id);
+  std::copy(Name(id), Name(id) + ownerLength, full);
+  full[ownerLength] = L':';
+  std::copy(name, name + nameLength, full + ownerLength + 1);
+  AddToList(streams, EntryFlag_Streams, id, full,
+            ownerLength + 1 + nameLength);
+  streamSizes.push_back(size);
+}
+
+// Appends an item for `id` to the end of its list and returns the item.
+uint32_t EntryStore::AddToList(NameList &list, uint8_t flag, uint32_t id,
+                               const wchar_t *name, size_t nameLength) {
+  uint32_t item = (uint32_t)list.owners.size();
+  list.owners.push_back(id);
+  list.nameOffsets.push_back((uint32_t)names.size());
+  list.nameLengths.push_back((uint16_t)nameLength);
+  list.next.push_back(NoLink);
+  names.insert(names.end(), name, name + nameLength);
+  if (!foldTable.empty())
+    AppendFolded(name, nameLength);
+
+  if (flags[id] & flag) {
+    uint32_t last = list.first[id];
+    while (list.next[last] != NoLink)
+      last = list.next[last];
+    list.next[last] = item;
+  } else {
+    list.first[id] = item;
+    flags[id] |= flag;
+  }
+  list.count++;
+  Changed(id);
+  return item;
+}
+
+void EntryStore::DropList(NameList &list, uint8_t flag, uint32_t id) {
+  if (!(flags[id] & flag))
+    return;
+  auto it = list.first.find(id);
+  for (uint32_t item = it->second; item != NoLink; item = list.next[item]) {
+    deadNameChars += list.nameLengths[item];
+    list.owners[item] = NoParent;
+    list.count--;
+  }
+  list.first.erase(it);
+  flags[id] &= ~flag;
+  Changed(id);
+}
+
+void EntryStore::ClearList(NameList &list) {
+  std::vector<uint32_t>().swap(list.owners);
+  std::vector<uint32_t>().swap(list.nameOffsets);
+  std::vector<uint16_t>().swap(list.nameLengths);
+  std::vector<uint32_t>().swap(list.next);
+  std::unordered_map<uint32_t, uint32_t>().swap(list.first);
+  list.count = 0;
+}
+
+void EntryStore::Remove(uint32_t id) {
+  if (!IsValid(id))
+    return;
+  DropList(links, EntryFlag_Linked, id);
+  DropList(streams, EntryFlag_Streams, id);
+  deadNameChars += nameLengths[id];
+  Changed(id);
+  if (flags[id] & EntryFlag_Directory)
+    directoryGeneration++;
+  flags[id] = 0;
+  nameLengths[id] = 0;
+  count--;
+}
+
+// Applies CompactList()'s moves to a column kept alongside the list.
+template <typename T>
+static void Squeeze(std::vector<T> &column,
+                    const std::vector<uint32_t> &moved) {
+  uint32_t kept = 0;
+  for (size_t item = 0; item < moved.size(); item++) {
+    if (moved[item] != EntryStore::NoLink)
+      column[kept++] = column[item];
+  }
+  column.resize(kept);
+}
+
+void EntryStore::CompactNames() {
+  bool folded = !foldTable.empty();
+  std::vector<wchar_t> compacted, compactedFolded;
+  compacted.reserve(names.size() - deadNameChars);
+  if (folded)
+    compactedFolded.reserve(names.size() - deadNameChars);
+  for (size_t id = 0; id < flags.size(); id++) {
+    if (!(flags[id] & EntryFlag_Valid))
+      continue;
+    uint32_t offset = (uint32_t)compacted.size();
+    compacted.insert(compacted.end(), names.begin() + nameOffsets[id],
+                     names.begin() + nameOffsets[id] + nameLengths[id]);
+    if (folded)
+      compactedFolded.insert(compactedFolded.end(),
+                             foldedNames.begin() + nameOffsets[id],
+                             foldedNames.begin() + nameOffsets[id] +
+                                 nameLengths[id]);
+    nameOffsets[id] = offset;
+  }
+
+  std::vector<uint32_t> moved = CompactList(links, compacted, compactedFolded);
+  Squeeze(linkParents, moved);
+  moved = CompactList(streams, compacted, compactedFolded);
+  Squeeze(streamSizes, moved);
+
+  names.swap(compacted);
+  foldedNames.swap(compactedFolded);
+  deadNameChars = 0;
+}
+
+// Moves the live items of `list` to the front, their names into the new
+// arenas, and returns each old item's new index. Lists are only ever dropped
+// whole, so a live item's successor is live too.
+std::vector<uint32_t>
+EntryStore::CompactList(NameList &list, std::vector<wchar_t> &compacted,
+                        std::vector<wchar_t> &compactedFolded) {
+  bool folded = !foldTable.empty();
+  std::vector<uint32_t> moved(list.owners.size(), NoLink);
+  uint32_t kept = 0;
+  for (uint32_t item = 0; item < list.owners.size(); item++) {
+    if (list.owners[item] == NoParent)
+      continue;
+    uint32_t offset = (uint32_t)compacted.size();
+    uint32_t start = list.nameOffsets[item];
+    compacted.insert(compacted.end(), names.begin() + start,
+                     names.begin() + start + list.nameLengths[item]);
+    if (folded)
+      compactedFolded.insert(compactedFolded.end(),
+                             foldedNames.begin() + start,
+                             foldedNames.begin() + start +
+                                 list.nameLengths[item]);
+    moved[item] = kept;
+    list.owners[kept] = list.owners[item];
+    list.nameOffsets[kept] = offset;
+    list.nameLengths[kept] = list.nameLengths[item];
+    list.next[kept] = list.next[item];
+    kept++;
+  }
+  list.owners.resize(kept);
+  list.nameOffsets.resize(kept);
+  list.nameLengths.resize(kept);
+  list.next.resize(kept);
+  for (auto &next : list.next) {
+    if (next != NoLink)
+      next = moved[next];
+  }
+  for (auto &first : list.first)
+    first.second = moved[first.second];
+  return moved;
+}
+
+void EntryStore::AppendFolded(const wchar_t *name, size_t nameLength) {
+  const uint16_t *table = foldTable.data();
+  for (size_t i = 0; i < nameLength; i++)
+    foldedNames.push_back((wchar_t)table[(uint16_t)name[i]]);
+}
+
+void EntryStore::SetFoldTable(const std::vector<uint16_t> &table) {
+  std::vector<wchar_t>().swap(foldedNames);
+  if (table.size() != 0x10000) {
+    std::vector<uint16_t>().swap(foldTable);
+    return;
+  }
+  foldTable = table;
+  // Fold the whole arena, dead names included, so offsets carry over
+  foldedNames.reserve(names.size());
+  AppendFolded(names.data(), names.size());
+}
+
+size_t EntryStore::ListMemory(const NameList &list) {
+  return (list.owners.capacity() + list.nameOffsets.capacity() +
+          list.next.capacity()) *
+             sizeof(uint32_t) +
+         list.nameLengths.capacity() * sizeof(uint16_t) +
+         list.first.bucket_count() * sizeof(void *) +
+         list.first.size() * (2 * sizeof(uint32_t) + sizeof(void *));
+}
+
+size_t EntryStore::MemoryUsage() const {
+  return parents.capacity() * sizeof(uint32_t) +
+         sizes.capacity() * sizeof(uint64_t) +
+         allocatedSizes.capacity() * sizeof(uint64_t) +
+         times.capacity() * sizeof(uint64_t) +
+         creationTimes.capacity() * sizeof(uint64_t) +
+         accessTimes.capacity() * sizeof(uint64_t) +
+         changeTimes.capacity() * sizeof(uint64_t) +
+         attributes.capacity() * sizeof(uint16_t) +
+         nameOffsets.capacity() * sizeof(uint32_t) + nameLengths.capacity() +
+         flags.capacity() + names.capacity() * sizeof(wchar_t) +
+         foldedNames.capacity() * sizeof(wchar_t) +
+         foldTable.capacity() * sizeof(uint16_t) + ListMemory(links) +
+         linkParents.capacity() * sizeof(uint32_t) + ListMemory(streams) +
+         streamSizes.capacity() * sizeof(uint64_t);
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Entry flag bits
+const uint8_t EntryFlag_Valid = 0x01;
+const uint8_t EntryFlag_Directory = 0x02;
+const uint8_t EntryFlag_Linked = 0x04;  // Has further hard links
+const uint8_t EntryFlag_Streams = 0x08; // Has named data streams
+
+// Timestamps an entry keeps besides its last write time, as FILETIMEs; 0
+// where the file system does not record one.
+struct EntryTimes {
+  uint64_t creation;
+  uint64_t lastAccess;
+  uint64_t change; // NTFS metadata change
+
+  EntryTimes() : creation(0), lastAccess(0), change(0) {}
+};
+
+// Dense, column-oriented file index shared by the volume readers.
+//
+// Entries are addressed by a small integer id: the MFT record number on NTFS,
+// the order of discovery on FAT/exFAT. Every field is its own contiguous
+// array indexed by id and all names live in one arena, so a search streams
+// through a few arrays instead of chasing one heap node (and one heap name)
+// per file. Ids that were never set or were removed simply stay invalid.
+class EntryStore {
+public:
+  static constexpr uint32_t NoParent = 0xFFFFFFFF;
+  static constexpr uint32_t NoLink = 0xFFFFFFFF;
+  static constexpr uint32_t NoStream = 0xFFFFFFFF;
+
+  EntryStore();
+
+  void Clear();
+  void Reserve(size_t entries, size_t nameChars);
+
+  // Adds or replaces entry `id`, growing the columns as needed.
+  void Set(uint32_t id, uint32_t parent, const wchar_t *name,
+           size_t nameLength, uint64_t size, uint64_t lastWriteTime,
+           bool isDirectory);
+  // Adds an entry under the next free id and returns that id.
+  uint32_t Append(uint32_t parent, const wchar_t *name, size_t nameLength,
+                  uint64_t size, uint64_t lastWriteTime, bool isDirectory);
+  void Remove(uint32_t id);
+
+  // Adds another hard link of entry `id`: a second parent and name for the
+  // same file, sharing its size and time. Set() and Remove() drop them.
+  void AddLink(uint32_t id, uint32_t parent, const wchar_t *name,
+               size_t nameLength);
+  // Adds a named data stream (NTFS ADS) of entry `id` with its own size.
+  // Set() and Remove() drop them as well.
+  void AddStream(uint32_t id, const wchar_t *name, size_t nameLength,
+                 uint64_t size);
+
+  void SetSize(uint32_t id, uint64_t size) { sizes[id] = size; }
+  // Bytes the file system allocated for the entry, which differs from
+  // Size() for sparse, compressed and resident files. Set() clears it.
+  void SetAllocatedSize(uint32_t id, uint64_t size) {
+    allocatedSizes[id] = size;
+  }
+  void SetLastWriteTime(uint32_t id, uint64_t time) { times[id] = time; }
+  // The other timestamps and the FILE_ATTRIBUTE_* bits (the low 16, which
+  // hold hidden, system, reparse, compressed, sparse, encrypted and the
+  // like). Set() clears both, so readers set them after it.
+  void SetTimes(uint32_t id, const EntryTimes &entryTimes);
+  void SetAttributes(uint32_t id, uint32_t bits) {
+    attributes[id] = (uint16_t)bits;
+  }
+
+  // Ids run from 0 to IdLimit() - 1; check IsValid() before reading one.
+  uint32_t IdLimit() const { return (uint32_t)flags.size(); }
+  size_t Count() const { return count; }
+
+  bool IsValid(uint32_t id) const {
+    return id < flags.size() && (flags[id] & EntryFlag_Valid);
+  }
+  bool IsDirectory(uint32_t id) const {
+    return (flags[id] & EntryFlag_Directory) != 0;
+  }
+  uint32_t Parent(uint32_t id) const { return parents[id]; }
+  uint64_t Size(uint32_t id) const { return sizes[id]; }
+  uint64_t AllocatedSize(uint32_t id) const { return allocatedSizes[id]; }
+  uint64_t LastWriteTime(uint32_t id) const { return times[id]; }
+  uint64_t CreationTime(uint32_t id) const { return creationTimes[id]; }
+  uint64_t LastAccessTime(uint32_t id) const { return accessTimes[id]; }
+  uint64_t ChangeTime(uint32_t id) const { return changeTimes[id]; }
+  EntryTimes Times(uint32_t id) const;
+  uint32_t Attributes(uint32_t id) const { return attributes[id]; }
+  const wchar_t *Name(uint32_t id) const {
+    return names.data() + nameOffsets[id];
+  }
+  size_t NameLength(uint32_t id) const { return nameLengths[id]; }
+  std::wstring NameString(uint32_t id) const {
+    return std::wstring(Name(id), NameLength(id));
+  }
+
+  // An entry's further links, in the order added: FirstLink(id), then
+  // NextLink() until NoLink. Links live in their own columns and share the
+  // name arenas, so a heavily linked file stays one entry.
+  uint32_t FirstLink(uint32_t id) const {
+    return (flags[id] & EntryFlag_Linked) ? links.first.find(id)->second
+                                          : NoLink;
+  }
+  uint32_t NextLink(uint32_t link) const { return links.next[link]; }
+  // Every link, for scans that do not start from the owning entry. Check
+  // IsLinkValid() before reading one.
+  uint32_t LinkLimit() const { return (uint32_t)links.owners.size(); }
+  size_t LinkCount() const { return links.count; }
+  bool IsLinkValid(uint32_t link) const {
+    return links.owners[link] != NoParent;
+  }
+  uint32_t LinkOwner(uint32_t link) const { return links.owners[link]; }
+  uint32_t LinkParent(uint32_t link) const { return linkParents[link]; }
+  const wchar_t *LinkName(uint32_t link) const {
+    return names.data() + links.nameOffsets[link];
+  }
+  size_t LinkNameLength(uint32_t link) const {
+    return links.nameLengths[link];
+  }
+  const wchar_t *FoldedLinkName(uint32_t link) const {
+    return foldedNames.data() + links.nameOffsets[link];
+  }
+
+  // An entry's streams, walked the same way. A stream's name is stored as
+  // "file.txt:stream", so it matches and shows as a pseudo-entry next to
+  // its file; StreamSuffix() skips the file name and the colon.
+  uint32_t FirstStream(uint32_t id) const {
+    return (flags[id] & EntryFlag_Streams) ? streams.first.find(id)->second
+                                           : NoStream;
+  }
+  uint32_t NextStream(uint32_t stream) const { return streams.next[stream]; }
+  uint32_t StreamLimit() const { return (uint32_t)streams.owners.size(); }
+  size_t StreamCount() const { return streams.count; }
+  uint32_t StreamOwner(uint32_t stream) const {
+    return streams.owners[stream];
+  }
+  uint64_t StreamSize(uint32_t stream) const { return streamSizes[stream]; }
+  const wchar_t *StreamName(uint32_t stream) const {
+    return names.data() + streams.nameOffsets[stream];
+  }
+  size_t StreamNameLength(uint32_t stream) const {
+    return streams.nameLengths[stream];
+  }
+  const wchar_t *FoldedStreamName(uint32_t stream) const {
+    return foldedNames.data() + streams.nameOffsets[stream];
+  }
+  size_t StreamSuffix(uint32_t stream) const {
+    return NameLength(StreamOwner(stream)) + 1;
+  }
+
+  // Optional second name arena holding every name mapped through an
+  // upcase table (65536 entries, e.g. NTFS $UpCase), so case-insensitive
+  // matching folds only the query. Setting a table folds the names already
+  // stored; an empty table or Clear() drops the column.
+  void SetFoldTable(const std::vector<uint16_t> &table);
+  const uint16_t *FoldTable() const {
+    return foldTable.empty() ? nullptr : foldTable.data();
+  }
+  bool HasFoldedNames() const { return !foldTable.empty(); }
+  // Same length as Name(id); only valid when HasFoldedNames().
+  const wchar_t *FoldedName(uint32_t id) const {
+    return foldedNames.data() + nameOffsets[id];
+  }
+
+  // Bytes held by the columns and the name arenas.
+  size_t MemoryUsage() const;
+  // The folded arena's share of MemoryUsage().
+  size_t FoldedMemoryUsage() const {
+    return foldedNames.capacity() * sizeof(wchar_t);
+  }
+
+  // Change counters, so derived data knows when to rebuild: Generation()
+  // moves on any add, rename, move or removal, DirectoryGeneration() only
+  // when the entry involved is a directory.
+  uint64_t Generation() const { return generation; }
+  uint64_t DirectoryGeneration() const { return directoryGeneration; }
+  // Ids added, renamed, moved, removed or given links or streams after
+  // generation `since`, in change order and possibly repeated, so derived
+  // data can patch itself instead of rebuilding. Only the last
+  // ChangeLogLimit changes are kept; false when the log no longer reaches
+  // back to `since`.
+  bool ChangedSince(uint64_t since, std::vector<uint32_t> &ids) const;
+
+private:
+  std::vector<uint32_t> parents;
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> allocatedSizes;
+  std::vector<uint64_t> times;
+  std::vector<uint64_t> creationTimes;
+  std::vector<uint64_t> accessTimes;
+  std::vector<uint64_t> changeTimes;
+  std::vector<uint16_t> attributes;
+  std::vector<uint32_t> nameOffsets;
+  std::vector<uint8_t> nameLengths;
+  std::vector<uint8_t> flags;
+  std::vector<wchar_t> names; // Name arena, not NUL-terminated
+  std::vector<wchar_t> foldedNames; // Parallel to names, when folding
+  std::vector<uint16_t> foldTable;
+
+  // Extra names hung off an entry, in lists per entry. Columns are indexed
+  // by item; a dropped item's owner is NoParent.
+  struct NameList {
+    std::vector<uint32_t> owners;
+    std::vector<uint32_t> nameOffsets;
+    std::vector<uint16_t> nameLengths;
+    std::vector<uint32_t> next;
+    std::unordered_map<uint32_t, uint32_t> first; // Owners with items only
+    size_t count;                                 // Live items
+
+    NameList() : count(0) {}
+  };
+  NameList links;
+  std::vector<uint32_t> linkParents; // By link
+  NameList streams;
+  std::vector<uint64_t> streamSizes; // By stream
+
+  size_t count;         // Valid entries
+  size_t deadNameChars; // Arena chars no longer referenced
+  uint64_t generation;
+  uint64_t directoryGeneration;
+
+  static constexpr size_t ChangeLogLimit = 65536;
+  struct Change {
+    uint64_t generation; // After the change
+    uint32_t id;
+  };
+  std::vector<Change> changeLog;
+  uint64_t loggedSince; // The log holds every change after this generation
+
+  void Changed(uint32_t id);
+
+  void Grow(uint32_t id);
+  uint32_t AddToList(NameList &list, uint8_t flag, uint32_t id,
+                     const wchar_t *name, size_t nameLength);
+  void DropList(NameList &list, uint8_t flag, uint32_t id);
+  std::vector<uint32_t> CompactList(NameList &list,
+                                    std::vector<wchar_t> &compacted,
+                                    std::vector<wchar_t> &compactedFolded);
+  static void ClearList(NameList &list);
+  static size_t ListMemory(const NameList &list);
+  void CompactNames();
+  void AppendFolded(const wchar_t *name, size_t nameLength);
+};
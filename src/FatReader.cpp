@@ -1,10 +1,12 @@
 #include "FatReader.h"
+#include "IndexSearch.h"
+#include "UpcaseTable.h"
 #include <algorithm>
 #include <iostream>
-#include <regex>
-#include <sstream>
 
-FatReader::FatReader() : hVolume(INVALID_HANDLE_VALUE), currentDrive(0) {}
+FatReader::FatReader()
+    : hVolume(INVALID_HANDLE_VALUE), currentDrive(0),
+      history(new SearchHistory()), foldNames(false), cancelToken(nullptr) {}
 FatReader::~FatReader() { Close(); }
 
 void FatReader::SetError(const std::wstring &msg) {
@@ -19,17 +21,73 @@ void FatReader::SetError(const std::wstring &msg) {
     LocalFree(lpMsgBuf);
 }
 
-void FatReader::Close() {
+void FatReader::ReleaseVolume() {
   if (hVolume != INVALID_HANDLE_VALUE) {
     CloseHandle(hVolume);
     hVolume = INVALID_HANDLE_VALUE;
   }
-  fileMap.clear();
+}
+
+void FatReader::Close() {
+  ReleaseVolume();
+  entries.Clear();
+  tree.Clear();
+  totals.Clear();
+  history->Clear();
+  if (trigrams)
+    trigrams->Clear();
+  if (suffixes)
+    suffixes->Clear();
+  if (names)
+    names->Clear();
   fatCache.clear();
 }
 
 std::wstring FatReader::GetLastErrorMessage() const { return lastError; }
 
+// A FAT date and time pair as a FILETIME, or 0 when the date is unset.
+// `tenMs` is the creation time's extra 10 ms units (0-199).
+static uint64_t FatTimeToWin32(uint16_t date, uint16_t time, uint8_t tenMs) {
+  if (date == 0)
+    return 0;
+  SYSTEMTIME st = {0};
+  st.wYear = (WORD)(1980 + (date >> 9));
+  st.wMonth = (WORD)((date >> 5) & 0x0F);
+  st.wDay = (WORD)(date & 0x1F);
+  st.wHour = (WORD)(time >> 11);
+  st.wMinute = (WORD)((time >> 5) & 0x3F);
+  st.wSecond = (WORD)((time & 0x1F) * 2 + tenMs / 100);
+  st.wMilliseconds = (WORD)(tenMs % 100 * 10);
+
+  FILETIME ft;
+  if (!SystemTimeToFileTime(&st, &ft))
+    return 0;
+  return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+// Stores directory entry `de` under `parentId` with its times, attributes
+// and allocation, returning the new id. A directory's clusters are added as
+// ProcessDirectory() reads them.
+static uint32_t AddEntry(EntryStore &entries, uint32_t parentId,
+                         const std::wstring &name,
+                         const FAT_DIRECTORY_ENTRY *de, uint32_t clusterBytes) {
+  bool isDirectory = (de->Attributes & FAT_ATTR_DIRECTORY) != 0;
+  uint32_t id = entries.Append(parentId, name.c_str(), name.length(),
+                               de->FileSize,
+                               FatTimeToWin32(de->WriteDate, de->WriteTime, 0),
+                               isDirectory);
+  EntryTimes times;
+  times.creation =
+      FatTimeToWin32(de->CreateDate, de->CreateTime, de->CreateTimeTenth);
+  times.lastAccess = FatTimeToWin32(de->LastAccessDate, 0, 0);
+  entries.SetTimes(id, times);
+  entries.SetAttributes(id, de->Attributes);
+  if (!isDirectory)
+    entries.SetAllocatedSize(id, ((uint64_t)de->FileSize + clusterBytes - 1) /
+                                     clusterBytes * clusterBytes);
+  return id;
+}
+
 bool FatReader::Initialize(TCHAR driveLetter) {
   Close();
   currentDrive = driveLetter;
@@ -155,7 +213,7 @@ bool FatReader::Scan(int codePage, void (*progressCallback)(int, int, void *),
   if (isFat32) {
     if (totalUsedClusters == 0)
       totalUsedClusters = 1; // Prevent div/0
-    ProcessDirectory(rootCluster, 0, L"", codePage);
+    ProcessDirectory(rootCluster, EntryStore::NoParent, L"", codePage);
   } else {
     // FAT16 Root is fixed
     uint64_t rootOffset =
@@ -174,6 +232,8 @@ bool FatReader::Scan(int codePage, void (*progressCallback)(int, int, void *),
     // Manual processing of root buffer since it's not a cluster chain
     std::wstring lfn = L"";
     for (uint32_t i = 0; i < rootSize; i += 32) {
+      if (cancelToken && cancelToken->IsCancelled())
+        break;
       FAT_DIRECTORY_ENTRY *de = (FAT_DIRECTORY_ENTRY *)&buffer[i];
       if (de->Name[0] == 0x00)
         break;
@@ -197,17 +257,16 @@ bool FatReader::Scan(int codePage, void (*progressCallback)(int, int, void *),
         continue;
       }
 
-      Entry entry;
-      entry.FirstCluster =
+      uint32_t firstCluster =
           de->FirstClusterLow | ((uint32_t)de->FirstClusterHigh << 16);
-      entry.ParentFirstCluster = 0;
+      std::wstring name;
 
       if (!lfn.empty()) {
         // Trim trailing nulls or 0xFFFF from LFN
         size_t last = lfn.find_first_of(L"\0\xFFFF");
         if (last != std::wstring::npos)
           lfn.resize(last);
-        entry.Name = lfn;
+        name = lfn;
       } else {
         // SFN
         char sfn[13];
@@ -226,34 +285,36 @@ bool FatReader::Scan(int codePage, void (*progressCallback)(int, int, void *),
         int len = MultiByteToWideChar(codePage, 0, sfn, -1, NULL, 0);
         wchar_t *wname = new wchar_t[len];
         MultiByteToWideChar(codePage, 0, sfn, -1, wname, len);
-        entry.Name = wname;
+        name = wname;
         delete[] wname;
       }
 
-      entry.Size = de->FileSize;
-      entry.IsDirectory = (de->Attributes & FAT_ATTR_DIRECTORY) != 0;
-      entry.IsValid = true;
-
-      uint32_t id = entry.FirstCluster;
-      if (id == 0)
-        id = 0x80000000 + i;
-
-      fileMap[id] = entry;
+      bool isDirectory = (de->Attributes & FAT_ATTR_DIRECTORY) != 0;
+      uint32_t id = AddEntry(entries, EntryStore::NoParent, name, de,
+                             bytesPerSector * sectorsPerCluster);
       lfn = L"";
 
-      if (entry.IsDirectory && entry.FirstCluster != 0) {
-        ProcessDirectory(entry.FirstCluster, 0, entry.Name, codePage);
+      if (isDirectory && firstCluster != 0) {
+        ProcessDirectory(firstCluster, id, name, codePage);
       }
     }
   }
 
+  // The recursion unwinds on its own; the partial index is of no use
+  if (cancelToken && cancelToken->IsCancelled()) {
+    SetLastError(ERROR_CANCELLED);
+    SetError(L"Scan cancelled");
+    return false;
+  }
+
   if (progressCb)
     progressCb(100, 100, userPtr);
 
+  ApplyFolding();
   return true;
 }
 
-void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
+void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentId,
                                  const std::wstring &parentPath, int codePage) {
   uint32_t current = cluster;
   std::wstring lfn = L"";
@@ -263,6 +324,8 @@ void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
   std::vector<uint8_t> buffer(clusterBytes);
 
   while (current < (uint32_t)(isFat32 ? 0x0FFFFFF8 : 0xFFF8)) {
+    if (cancelToken && cancelToken->IsCancelled())
+      return;
     // Progress Update
     processedClusters++;
     if (progressCb && (processedClusters % 100 == 0)) {
@@ -279,6 +342,9 @@ void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
     if (!ReadFile(hVolume, buffer.data(), (DWORD)buffer.size(), &bytesRead,
                   NULL))
       break;
+    if (parentId != EntryStore::NoParent)
+      entries.SetAllocatedSize(parentId,
+                               entries.AllocatedSize(parentId) + clusterBytes);
 
     for (uint32_t i = 0; i < bytesRead; i += 32) {
       FAT_DIRECTORY_ENTRY *de = (FAT_DIRECTORY_ENTRY *)&buffer[i];
@@ -310,16 +376,15 @@ void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
         continue;
       }
 
-      Entry entry;
-      entry.FirstCluster =
+      uint32_t firstCluster =
           de->FirstClusterLow | ((uint32_t)de->FirstClusterHigh << 16);
-      entry.ParentFirstCluster = cluster;
+      std::wstring name;
 
       if (!lfn.empty()) {
         size_t last = lfn.find_first_of(L"\0\xFFFF");
         if (last != std::wstring::npos)
           lfn.resize(last);
-        entry.Name = lfn;
+        name = lfn;
       } else {
         char sfn[13];
         int p = 0;
@@ -337,30 +402,24 @@ void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
         int len = MultiByteToWideChar(codePage, 0, sfn, -1, NULL, 0);
         wchar_t *wname = new wchar_t[len];
         MultiByteToWideChar(codePage, 0, sfn, -1, wname, len);
-        entry.Name = wname;
+        name = wname;
         delete[] wname;
       }
 
-      entry.Size = de->FileSize;
-      entry.IsDirectory = (de->Attributes & FAT_ATTR_DIRECTORY) != 0;
-      entry.IsValid = true;
-
-      uint32_t id = entry.FirstCluster;
-      if (id == 0)
-        id = 0x80000000 + (uint32_t)fileMap.size(); // Simplified synthetic ID
-
-      fileMap[id] = entry;
+      uint64_t size = de->FileSize;
+      bool isDirectory = (de->Attributes & FAT_ATTR_DIRECTORY) != 0;
+      uint32_t id = AddEntry(entries, parentId, name, de, clusterBytes);
       lfn = L"";
 
       // If it's a file, we "processed" its clusters by skipping them
-      if (!entry.IsDirectory) {
-        uint32_t fileClusters = (entry.Size + clusterBytes - 1) / clusterBytes;
+      if (!isDirectory) {
+        uint32_t fileClusters = (size + clusterBytes - 1) / clusterBytes;
         processedClusters += fileClusters;
       }
 
-      if (entry.IsDirectory && entry.FirstCluster != 0) {
-        ProcessDirectory(entry.FirstCluster, cluster,
-                         parentPath + L"\\" + entry.Name, codePage);
+      if (isDirectory && firstCluster != 0) {
+        ProcessDirectory(firstCluster, id, parentPath + L"\\" + name,
+                         codePage);
       }
     }
 
@@ -368,198 +427,92 @@ void FatReader::ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
   }
 }
 
-std::wstring FatReader::BuildPath(const Entry &entry) {
-  std::wstring path = entry.Name;
-  uint32_t pc = entry.ParentFirstCluster;
-  while (pc != 0) {
-    auto it = fileMap.find(pc);
-    if (it == fileMap.end())
-      break;
-    path = it->second.Name + L"\\" + path;
-    pc = it->second.ParentFirstCluster;
-  }
-  std::wstring drive = L"";
-  drive += currentDrive;
-  drive += L":\\";
-  return drive + path;
+std::vector<FileResult>
+FatReader::Search(const std::wstring &query, const std::wstring &targetFolder,
+                  int codePage, const SearchOptions &options, int maxResults) {
+  std::vector<std::wstring> targets;
+  if (!targetFolder.empty())
+    targets.push_back(targetFolder);
+  return Search(query, targets, codePage, options, maxResults);
 }
 
-bool FatReader::MatchPattern(const std::wstring &str,
-                             const std::wstring &pattern,
-                             const SearchOptions &options) {
-  if (pattern.empty())
-    return true;
+std::vector<FileResult>
+FatReader::Search(const std::wstring &query,
+                  const std::vector<std::wstring> &targetFolders, int codePage,
+                  const SearchOptions &options, int maxResults) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(EntryStore::NoParent, rootPath);
+  return SearchEntries(entries, paths, tree, EntryStore::NoParent, query,
+                       targetFolders, options, maxResults, cancelToken,
+                       history.get(), trigrams.get(), suffixes.get(),
+                       names.get());
+}
 
-  bool matched = false;
+size_t FatReader::Search(const std::wstring &query,
+                         const std::vector<std::wstring> &targetFolders,
+                         int codePage, const SearchOptions &options,
+                         int maxResults, const ResultCallback &onResults) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(EntryStore::NoParent, rootPath);
+  return SearchEntries(entries, paths, tree, EntryStore::NoParent, query,
+                       targetFolders, options, maxResults, onResults,
+                       cancelToken, history.get(),
+                       trigrams.get(), suffixes.get(), names.get());
+}
 
-  if (options.mode == MatchMode_Exact) {
-    if (options.ignoreCase) {
-      matched = lstrcmpiW(str.c_str(), pattern.c_str()) == 0;
-    } else {
-      matched = wcscmp(str.c_str(), pattern.c_str()) == 0;
-    }
-  } else if (options.mode == MatchMode_RegEx) {
-    try {
-      std::regex_constants::syntax_option_type flags = std::regex::ECMAScript;
-      if (options.ignoreCase)
-        flags |= std::regex::icase;
-      std::wregex re(pattern, flags);
-      matched = std::regex_search(str, re);
-    } catch (...) {
-      matched = false;
-    }
-  } else if (options.mode == MatchMode_SpaceDivided) {
-    std::wstringstream ss(pattern);
-    std::wstring token;
-    bool allTokensFound = true;
-    while (ss >> token) {
-      bool tokenFound = false;
-      if (options.ignoreCase) {
-        auto it = std::search(str.begin(), str.end(), token.begin(),
-                              token.end(), [](wchar_t c1, wchar_t c2) {
-                                return towlower(c1) == towlower(c2);
-                              });
-        tokenFound = (it != str.end());
-      } else {
-        tokenFound = (str.find(token) != std::wstring::npos);
-      }
-      if (!tokenFound) {
-        allTokensFound = false;
-        break;
-      }
-    }
-    matched = allTokensFound;
-  } else {
-    // Default: Substring
-    if (options.ignoreCase) {
-      auto it = std::search(
-          str.begin(), str.end(), pattern.begin(), pattern.end(),
-          [](wchar_t c1, wchar_t c2) { return towlower(c1) == towlower(c2); });
-      matched = it != str.end();
-    } else {
-      matched = str.find(pattern) != std::wstring::npos;
-    }
-  }
+std::vector<DirectoryUsage> FatReader::DiskUsage(const std::wstring &folder,
+                                                 size_t count) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(EntryStore::NoParent, rootPath);
+  return ReportDiskUsage(entries, paths, tree, totals, EntryStore::NoParent,
+                         folder, count);
+}
 
-  if (options.invertMatch)
-    return !matched;
-  return matched;
+void FatReader::ExportSnapshot(SnapshotBuilder &builder) const {
+  ExportEntries(entries, builder);
 }
 
-std::vector<FileResult>
-FatReader::Search(const std::wstring &query, const std::wstring &targetFolder,
-                  int codePage, const SearchOptions &options, int maxResults) {
-  std::vector<FileResult> results;
-  for (auto const &[id, entry] : fileMap) {
-    if (MatchPattern(entry.Name, query, options)) {
-      std::wstring fullPath = BuildPath(entry);
-
-      // Filter by Target Folder
-      if (!targetFolder.empty()) {
-        if (fullPath.length() < targetFolder.length())
-          continue;
-        bool match = true;
-        for (size_t i = 0; i < targetFolder.length(); ++i) {
-          if (towlower(fullPath[i]) != towlower(targetFolder[i])) {
-            match = false;
-            break;
-          }
-        }
-        if (!match)
-          continue;
-      }
+bool FatReader::ImportSnapshot(const SnapshotView &view, TCHAR driveLetter) {
+  currentDrive = driveLetter;
+  ImportEntries(view, entries);
+  ApplyFolding();
+  return true;
+}
 
-      // Exclusion Filter
-      if (!options.excludePattern.empty()) {
-        bool excluded = false;
-        std::wstring targetForExclude = fullPath;
-        std::wstringstream ss(options.excludePattern);
-        std::wstring pattern;
-        while (std::getline(ss, pattern, L';')) {
-          if (pattern.empty())
-            continue;
-          if (options.ignoreCase) {
-            std::wstring targetLower = targetForExclude;
-            std::wstring patternLower = pattern;
-            for (auto &c : targetLower)
-              c = towlower(c);
-            for (auto &c : patternLower)
-              c = towlower(c);
-            if (targetLower.find(patternLower) != std::wstring::npos) {
-              excluded = true;
-              break;
-            }
-          } else {
-            if (targetForExclude.find(pattern) != std::wstring::npos) {
-              excluded = true;
-              break;
-            }
-          }
-        }
-        if (excluded)
-          continue;
-      }
+void FatReader::ApplyFolding() {
+  entries.SetFoldTable(foldNames ? DefaultUpcaseTable()
+                                 : std::vector<uint16_t>());
+}
 
-      // Match Query (Name or Full Path)
-      if (!MatchPattern(options.matchFullPath ? fullPath : entry.Name, query,
-                        options))
-        continue;
+void FatReader::SetFoldNames(bool enable) {
+  foldNames = enable;
+  if (entries.Count() > 0 && entries.HasFoldedNames() != enable)
+    ApplyFolding();
+}
 
-      // Metadata Filters
-      if (options.minSize > 0 && entry.Size < options.minSize)
-        continue;
-      if (options.maxSize > 0 && entry.Size > options.maxSize)
-        continue;
-      if (options.minDate > 0 && entry.LastWriteTime < options.minDate)
-        continue;
-      if (options.maxDate > 0 && entry.LastWriteTime > options.maxDate)
-        continue;
+void FatReader::SetTrigramIndex(bool enable) {
+  if (!enable)
+    trigrams.reset();
+  else if (!trigrams)
+    trigrams.reset(new NameTrigrams());
+}
 
-      // Type Filter
-      if (entry.IsDirectory) {
-        if (!options.includeFolders)
-          continue;
-      } else {
-        if (!options.includeFiles)
-          continue;
-
-        // Extension Filter (Logical AND with name match)
-        if (!options.extensionFilter.empty()) {
-          bool extMatch = false;
-          size_t dotPos = entry.Name.find_last_of(L'.');
-          std::wstring fileExt = (dotPos != std::wstring::npos)
-                                     ? entry.Name.substr(dotPos + 1)
-                                     : L"";
-          for (auto &c : fileExt)
-            c = towlower(c);
-
-          std::wstringstream ss(options.extensionFilter);
-          std::wstring extToken;
-          while (std::getline(ss, extToken, L';')) {
-            if (extToken.empty())
-              continue;
-            for (auto &c : extToken)
-              c = towlower(c);
-            if (fileExt == extToken) {
-              extMatch = true;
-              break;
-            }
-          }
-          if (!extMatch)
-            continue;
-        }
-      }
+void FatReader::SetSuffixIndex(bool enable) {
+  if (!enable)
+    suffixes.reset();
+  else if (!suffixes)
+    suffixes.reset(new NameSuffixArray());
+}
 
-      FileResult res;
-      res.Name = entry.Name;
-      res.FullPath = fullPath;
-      res.Size = entry.Size;
-      res.LastWriteTime = 0; // Simplified
-      res.IsDirectory = entry.IsDirectory;
-      results.push_back(res);
-      if (maxResults > 0 && (int)results.size() >= maxResults)
-        break;
-    }
-  }
-  return results;
+void FatReader::SetNameOrder(bool enable) {
+  if (!enable)
+    names.reset();
+  else if (!names)
+    names.reset(new NameOrder());
 }
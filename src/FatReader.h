@@ -3,7 +3,6 @@
 #include "MFTReader.h" // For FileResult and other shared structures
 #include <functional>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <windows.h>
 
@@ -14,6 +13,8 @@ public:
 
   bool Initialize(TCHAR driveLetter);
   void Close();
+  // Closes the volume handle but keeps the scanned index searchable.
+  void ReleaseVolume();
   bool Scan(int codePage, void (*progressCallback)(int, int, void *),
             void *userData,
             std::function<void(const std::wstring &)> onFileFound = nullptr);
@@ -21,36 +22,81 @@ public:
   void SetTraceCallback(std::function<void(const std::wstring &)> callback) {
     traceCallback = callback;
   }
+  // Scan() and Search() give up soon after `token` is raised: a scan fails
+  // with ERROR_CANCELLED, a search stops early. nullptr never cancels.
+  void SetCancelToken(const CancelToken *token) { cancelToken = token; }
 
   std::vector<FileResult> Search(const std::wstring &query,
                                  const std::wstring &targetFolder,
                                  int codePage = CP_OEMCP,
                                  const SearchOptions &options = SearchOptions(),
                                  int maxResults = -1);
+  // Entries under any of `targetFolders`, each matched once.
+  std::vector<FileResult> Search(const std::wstring &query,
+                                 const std::vector<std::wstring> &targetFolders,
+                                 int codePage = CP_OEMCP,
+                                 const SearchOptions &options = SearchOptions(),
+                                 int maxResults = -1);
+  // Streams the matches to `onResults` in batches as they are found instead
+  // of collecting them; returns how many were delivered.
+  size_t Search(const std::wstring &query,
+                const std::vector<std::wstring> &targetFolders, int codePage,
+                const SearchOptions &options, int maxResults,
+                const ResultCallback &onResults);
 
+  // Disk usage below `folder` (the volume when empty): the folder's own
+  // totals, then its `count` largest directories by allocated size.
+  std::vector<DirectoryUsage> DiskUsage(const std::wstring &folder,
+                                        size_t count);
   std::wstring GetLastErrorMessage() const;
 
+  void ExportSnapshot(SnapshotBuilder &builder) const;
+  bool ImportSnapshot(const SnapshotView &view, TCHAR driveLetter);
+
+  const EntryStore &GetEntries() const { return entries; }
+
+  // Keeps a towupper()-folded copy of every name for case-insensitive
+  // searches (2 bytes per name character). Off by default.
+  void SetFoldNames(bool enable);
+  // Answers substring queries from a trigram index over the names instead of
+  // matching every name. Built on the first search it serves and rebuilt
+  // after the index changed; off by default. Disabling frees it.
+  void SetTrigramIndex(bool enable);
+  // The trigram index, null unless enabled.
+  const NameTrigrams *GetTrigrams() const { return trigrams.get(); }
+  // Answers substring, space-divided and exact name queries from a suffix
+  // array over the names, whatever their length. Built on the first search
+  // it serves and patched through a small delta after the index changed;
+  // off by default. Disabling frees it.
+  void SetSuffixIndex(bool enable);
+  // The suffix array, null unless enabled.
+  const NameSuffixArray *GetSuffixes() const { return suffixes.get(); }
+  // Keeps every name in sorted order, so exact and prefix ("readme*")
+  // queries are a binary search and results carry a NameRank to sort by.
+  // Built on the first search and merged with later changes. Disabling
+  // frees it.
+  void SetNameOrder(bool enable);
+  // The name order, null unless enabled.
+  const NameOrder *GetNameOrder() const { return names.get(); }
+
 private:
   std::wstring lastError;
   void SetError(const std::wstring &msg);
 
-  struct Entry {
-    uint32_t FirstCluster;
-    uint32_t ParentFirstCluster;
-    std::wstring Name;
-    uint64_t Size;
-    uint64_t LastWriteTime;
-    bool IsDirectory;
-    bool IsValid;
-  };
-
   HANDLE hVolume;
   TCHAR currentDrive;
-  std::unordered_map<uint32_t, Entry>
-      fileMap; // Key: FirstCluster (unique for non-empty files/dirs)
-  // For FAT, since multiple files can have FirstCluster=0 (empty),
-  // we might need a better ID or store by full path.
-  // Actually, FAT directory structure is tree-based.
+  // Ids are assigned in discovery order; a directory's id is passed down to
+  // its children, so empty files (FirstCluster 0) need no synthetic keys.
+  EntryStore entries;
+  PathCache paths;
+  DirectoryTree tree; // Built on the first folder-filtered search
+  DirectoryTotals totals; // Built on the first DiskUsage()
+  std::unique_ptr<SearchHistory> history; // The last search, for narrowing
+  std::unique_ptr<NameTrigrams> trigrams; // Null unless enabled
+  std::unique_ptr<NameSuffixArray> suffixes; // Null unless enabled
+  std::unique_ptr<NameOrder> names; // Null unless enabled
+  bool foldNames;
+  const CancelToken *cancelToken;
 
   std::function<void(const std::wstring &)> traceCallback;
 
@@ -67,14 +113,11 @@ private:
   bool isFat32;
   uint32_t rootCluster; // For FAT32
 
-  void ProcessDirectory(uint32_t cluster, uint32_t parentCluster,
+  void ProcessDirectory(uint32_t cluster, uint32_t parentId,
                         const std::wstring &parentPath, int codePage);
   uint32_t GetNextCluster(uint32_t cluster);
   uint64_t ClusterToSector(uint32_t cluster);
 
-  std::wstring BuildPath(const Entry &entry);
-  bool MatchPattern(const std::wstring &str, const std::wstring &pattern,
-                    const SearchOptions &options);
 
   std::vector<uint8_t> fatCache;
   void LoadFat();
@@ -84,4 +127,5 @@ private:
   uint64_t processedClusters;
   void (*progressCb)(int, int, void *);
   void *userPtr;
+  void ApplyFolding();
 };
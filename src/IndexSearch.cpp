@@ -0,0 +1,403 @@
+#include "IndexSearch.h"
+#include "PreparedQuery.h"
+#include <chrono>
+#include <iterator>
+#include <memory>
+
+// Parent chains deeper than this are treated as corrupt and cut off
+static const int MaxPathDepth = 256;
+
+// Collects matches and hands them to the callback in batches: when a batch
+// is full, and otherwise once it has waited FlushInterval, checked every
+// ClockStride candidates, so sparse hits still show up promptly. The cancel
+// token is polled at the same stride and before each batch goes out.
+class ResultBatcher {
+public:
+  ResultBatcher(const ResultCallback &callback, int maxResults,
+                const CancelToken *cancel, const NameOrder *names)
+      : callback(callback), cancel(cancel), names(names),
+        maxResults(maxResults), delivered(0), sinceClock(0),
+        stopped(cancel && cancel->IsCancelled()) {
+    batch.reserve(BatchSize);
+  }
+
+  void Add(FileResult &result) {
+    if (batch.empty())
+      firstPending = std::chrono::steady_clock::now();
+    batch.push_back(std::move(result));
+    if (batch.size() >= BatchSize)
+      Flush();
+  }
+  // Called once per candidate visited.
+  void Tick() {
+    if (++sinceClock < ClockStride)
+      return;
+    sinceClock = 0;
+    if (cancel && cancel->IsCancelled()) {
+      stopped = true;
+      return;
+    }
+    if (!batch.empty() &&
+        std::chrono::steady_clock::now() - firstPending >= FlushInterval)
+      Flush();
+  }
+  // Cancelled, the callback asked to stop, or maxResults were found.
+  bool Done() const {
+    return stopped ||
+           (maxResults > 0 && delivered + batch.size() >= (size_t)maxResults);
+  }
+  size_t Finish() {
+    Flush();
+    return delivered;
+  }
+  // The order results are ranked in by name, null for none.
+  const NameOrder *Names() const { return names; }
+
+private:
+  static const size_t BatchSize = 1024;
+  static const unsigned ClockStride = 4096;
+  static constexpr std::chrono::milliseconds FlushInterval{10};
+
+  const ResultCallback &callback;
+  const CancelToken *cancel;
+  const NameOrder *names;
+  std::vector<FileResult> batch;
+  std::chrono::steady_clock::time_point firstPending;
+  int maxResults;
+  size_t delivered;
+  unsigned sinceClock;
+  bool stopped;
+
+  void Flush() {
+    if (batch.empty() || stopped)
+      return;
+    if (cancel && cancel->IsCancelled()) {
+      stopped = true;
+      return;
+    }
+    delivered += batch.size();
+    stopped = !callback(batch);
+    batch.clear();
+  }
+};
+
+static uint64_t FilterTime(const EntryStore &entries, uint32_t id,
+                           DateField field) {
+  switch (field) {
+  case DateField_Created:
+    return entries.CreationTime(id);
+  case DateField_Accessed:
+    return entries.LastAccessTime(id);
+  case DateField_Changed:
+    return entries.ChangeTime(id);
+  default:
+    return entries.LastWriteTime(id);
+  }
+}
+
+// Which name of an entry a candidate is: its own, one of its further hard
+// links (own name and path), or one of its named streams (own name and
+// size, shown as "file:stream").
+enum NameKind { Name_Own, Name_Link, Name_Stream };
+
+// Applies every filter to one candidate and adds it if it passes, noting it
+// in `matched` when given. `item` is the link or stream, unused for
+// Name_Own.
+static void MatchEntry(const EntryStore &entries, PathCache &paths,
+                       uint32_t id, NameKind kind, uint32_t item,
+                       const PreparedQuery &query,
+                       const SearchOptions &options, ResultBatcher &results,
+                       std::vector<SearchCandidate> *matched) {
+  results.Tick();
+  bool isStream = kind == Name_Stream;
+  uint64_t size = isStream ? entries.StreamSize(item) : entries.Size(id);
+  uint64_t lastWriteTime = entries.LastWriteTime(id);
+  bool isDirectory = !isStream && entries.IsDirectory(id);
+
+  // Column-only filters first; they need neither the name nor the path
+
+  // Type Filter
+  if (isDirectory ? !options.includeFolders : !options.includeFiles)
+    return;
+
+  // Metadata Filters
+  if (options.minSize > 0 && size < options.minSize)
+    return;
+  if (options.maxSize > 0 && size > options.maxSize)
+    return;
+  if (options.minDate > 0 || options.maxDate > 0) {
+    uint64_t time = FilterTime(entries, id, options.dateField);
+    if (options.minDate > 0 && time < options.minDate)
+      return;
+    if (options.maxDate > 0 && time > options.maxDate)
+      return;
+  }
+  uint32_t attributes = entries.Attributes(id);
+  if ((attributes & options.requiredAttributes) != options.requiredAttributes)
+    return;
+  if (attributes & options.excludedAttributes)
+    return;
+
+  // Name filters read the store directly
+  const wchar_t *entryName, *foldedName;
+  size_t entryNameLength;
+  if (kind == Name_Link) {
+    entryName = entries.LinkName(item);
+    entryNameLength = entries.LinkNameLength(item);
+    foldedName = entries.FoldedLinkName(item);
+  } else if (isStream) {
+    entryName = entries.StreamName(item);
+    entryNameLength = entries.StreamNameLength(item);
+    foldedName = entries.FoldedStreamName(item);
+  } else {
+    entryName = entries.Name(id);
+    entryNameLength = entries.NameLength(id);
+    foldedName = entries.FoldedName(id);
+  }
+  const wchar_t *matchName = query.UsesFoldedNames() ? foldedName : entryName;
+
+  // Extension Filter (Logical AND with name match)
+  if (!isDirectory && !query.MatchesExtension(matchName, entryNameLength))
+    return;
+
+  // Match Query (Name)
+  if (!options.matchFullPath && !query.Matches(matchName, entryNameLength))
+    return;
+
+  // Only entries that passed the name filters pay for their path
+  std::wstring fullPath = kind == Name_Link ? paths.LinkPath(entries, item)
+                                            : paths.FullPath(entries, id);
+  if (isStream) {
+    size_t suffix = entries.StreamSuffix(item) - 1; // Keep the colon
+    fullPath.append(entryName + suffix, entryNameLength - suffix);
+  }
+
+  // Exclusion Filter
+  if (query.IsExcluded(fullPath))
+    return;
+
+  // Match Query (Full Path)
+  if (options.matchFullPath && !query.Matches(fullPath))
+    return;
+
+  FileResult res;
+  res.Name.assign(entryName, entryNameLength);
+  res.FullPath = fullPath;
+  res.Size = size;
+  res.LastWriteTime = lastWriteTime;
+  res.IsDirectory = isDirectory;
+  res.NameRank = results.Names()
+                     ? results.Names()->Rank(entries, id, kind, item)
+                     : NoNameRank;
+  results.Add(res);
+  if (matched)
+    matched->push_back({id, item, (uint32_t)kind});
+}
+
+// Matches an entry's own name, then its streams until the search is done.
+static void MatchWithStreams(const EntryStore &entries, PathCache &paths,
+                             uint32_t id, const PreparedQuery &query,
+                             const SearchOptions &options,
+                             ResultBatcher &results,
+                             std::vector<SearchCandidate> *matched) {
+  MatchEntry(entries, paths, id, Name_Own, 0, query, options, results,
+             matched);
+  for (uint32_t stream = entries.FirstStream(id);
+       stream != EntryStore::NoStream && !results.Done();
+       stream = entries.NextStream(stream))
+    MatchEntry(entries, paths, id, Name_Stream, stream, query, options,
+               results, matched);
+}
+
+// Whether directory `dirId` is one of `targets` or lies below one.
+static bool UnderTargets(const EntryStore &entries, uint32_t rootId,
+                         uint32_t dirId, const std::vector<uint32_t> &targets) {
+  for (int depth = 0; depth < MaxPathDepth; depth++) {
+    for (uint32_t target : targets) {
+      if (dirId == target)
+        return true;
+    }
+    if (dirId == rootId || !entries.IsValid(dirId))
+      return false;
+    dirId = entries.Parent(dirId);
+  }
+  return false;
+}
+
+std::vector<FileResult>
+SearchEntries(const EntryStore &entries, PathCache &paths, DirectoryTree &tree,
+              uint32_t rootId, const std::wstring &query,
+              const std::vector<std::wstring> &targetFolders,
+              const SearchOptions &options, int maxResults,
+              const CancelToken *cancel, SearchHistory *history,
+              NameTrigrams *trigrams, NameSuffixArray *suffixes,
+              NameOrder *names) {
+  std::vector<FileResult> results;
+  SearchEntries(
+      entries, paths, tree, rootId, query, targetFolders, options, maxResults,
+      [&results](std::vector<FileResult> &batch) {
+        results.insert(results.end(), std::make_move_iterator(batch.begin()),
+                       std::make_move_iterator(batch.end()));
+        return true;
+      },
+      cancel, history, trigrams, suffixes, names);
+  return results;
+}
+
+// A pass over the target folders, or the whole volume. With `candidates`
+// (ascending ids) only those entries are visited, in the same order.
+static void SearchTargets(const EntryStore &entries, PathCache &paths,
+                          DirectoryTree &tree, uint32_t rootId,
+                          const std::vector<std::wstring> &targetFolders,
+                          const std::vector<uint32_t> *candidates,
+                          const PreparedQuery &prepared,
+                          const SearchOptions &options, ResultBatcher &results,
+                          std::vector<SearchCandidate> *matched) {
+  auto full = [&]() { return results.Done(); };
+
+  // Resolve the target folders to subtree ranges up front instead of
+  // comparing every candidate's path against them
+  bool wholeVolume = targetFolders.empty();
+  std::vector<DirectoryTree::Range> ranges;
+  for (const auto &target : targetFolders) {
+    if (wholeVolume)
+      break;
+    if (target.empty()) {
+      wholeVolume = true;
+      break;
+    }
+    if (!tree.IsCurrent(entries))
+      tree.Build(entries, rootId);
+    DirectoryTree::Range range;
+    if (!tree.Resolve(entries, target, range))
+      continue; // Folder not on this volume (any more)
+    if (range.first == 0 && range.second == tree.Size())
+      wholeVolume = true;
+    ranges.push_back(range);
+  }
+
+  if (wholeVolume) {
+    auto visit = [&](uint32_t id) {
+      MatchWithStreams(entries, paths, id, prepared, options, results,
+                       matched);
+      for (uint32_t link = entries.FirstLink(id);
+           link != EntryStore::NoLink && !full(); link = entries.NextLink(link))
+        MatchEntry(entries, paths, id, Name_Link, link, prepared, options,
+                   results, matched);
+    };
+    if (candidates) {
+      for (size_t i = 0; i < candidates->size() && !full(); i++) {
+        if (entries.IsValid((*candidates)[i]))
+          visit((*candidates)[i]);
+      }
+      return;
+    }
+    for (uint32_t id = 0; id < entries.IdLimit() && !full(); id++) {
+      if (entries.IsValid(id))
+        visit(id);
+    }
+    return;
+  }
+
+  // Candidates still go in tree order, so mark them rather than sort
+  std::vector<uint8_t> wanted;
+  if (candidates) {
+    wanted.assign(entries.IdLimit(), 0);
+    for (uint32_t id : *candidates)
+      wanted[id] = 1;
+  }
+  auto skip = [&](uint32_t id) { return candidates && !wanted[id]; };
+
+  const std::vector<uint32_t> &order = tree.Order();
+  std::vector<DirectoryTree::Range> merged = DirectoryTree::Merge(ranges);
+  for (const auto &range : merged) {
+    for (uint32_t p = range.first; p < range.second && !full(); p++) {
+      if (!skip(order[p]))
+        MatchWithStreams(entries, paths, order[p], prepared, options, results,
+                         matched);
+    }
+  }
+
+  // Further hard links are not in the tree; keep those whose directory is
+  // inside a target folder
+  if (entries.LinkCount() > 0) {
+    std::vector<uint32_t> targetDirs;
+    for (const auto &range : merged)
+      targetDirs.push_back(order[range.first]);
+    for (uint32_t link = 0; link < entries.LinkLimit() && !full(); link++) {
+      if (entries.IsLinkValid(link) && !skip(entries.LinkOwner(link)) &&
+          UnderTargets(entries, rootId, entries.LinkParent(link), targetDirs))
+        MatchEntry(entries, paths, entries.LinkOwner(link), Name_Link, link,
+                   prepared, options, results, matched);
+    }
+  }
+}
+
+size_t SearchEntries(const EntryStore &entries, PathCache &paths,
+                     DirectoryTree &tree, uint32_t rootId,
+                     const std::wstring &query,
+                     const std::vector<std::wstring> &targetFolders,
+                     const SearchOptions &options, int maxResults,
+                     const ResultCallback &onResults,
+                     const CancelToken *cancel, SearchHistory *history,
+                     NameTrigrams *trigrams, NameSuffixArray *suffixes,
+                     NameOrder *names) {
+  // Bringing the order up to date costs a merge over every name, so it is
+  // only paid for a query it answers or results that are to be ranked
+  bool ordered = names && NameOrder::Covers(query, options);
+  if (names && (ordered || options.rankNames))
+    names->Update(entries);
+  ResultBatcher results(onResults, maxResults, cancel,
+                        options.rankNames ? names : nullptr);
+  std::unique_ptr<PreparedQuery> prepared(
+      new PreparedQuery(query, options, entries.FoldTable()));
+  std::vector<SearchCandidate> matched;
+  std::vector<SearchCandidate> *record = history ? &matched : nullptr;
+
+  if (history &&
+      history->CanNarrow(entries, *prepared, targetFolders, options)) {
+    if (history->IsCurrent(entries)) {
+      // Only what the last query matched can match this one, in the same
+      // order
+      for (const auto &c : history->Candidates()) {
+        if (results.Done())
+          break;
+        MatchEntry(entries, paths, c.id, (NameKind)c.kind, c.item, *prepared,
+                   options, results, record);
+      }
+    } else {
+      // Entries changed since may match now as well
+      std::vector<uint32_t> candidates = history->CandidateIds(entries);
+      SearchTargets(entries, paths, tree, rootId, targetFolders, &candidates,
+                    *prepared, options, results, record);
+    }
+  } else if (ordered) {
+    // Only names equal to the query, or starting with it, can match it
+    std::vector<uint32_t> candidates =
+        names->Candidates(entries, query, options);
+    SearchTargets(entries, paths, tree, rootId, targetFolders, &candidates,
+                  *prepared, options, results, record);
+  } else if (suffixes && NameSuffixArray::Covers(query, options)) {
+    // Only names holding every term of the query can match it
+    suffixes->Update(entries);
+    std::vector<uint32_t> candidates =
+        suffixes->Candidates(entries, query, options);
+    SearchTargets(entries, paths, tree, rootId, targetFolders, &candidates,
+                  *prepared, options, results, record);
+  } else if (trigrams && NameTrigrams::Covers(query, options)) {
+    // Only names holding every trigram of the query can match it
+    trigrams->Update(entries);
+    std::vector<uint32_t> candidates =
+        trigrams->Candidates(entries, query, options);
+    SearchTargets(entries, paths, tree, rootId, targetFolders, &candidates,
+                  *prepared, options, results, record);
+  } else {
+    SearchTargets(entries, paths, tree, rootId, targetFolders, nullptr,
+                  *prepared, options, results, record);
+  }
+
+  if (history)
+    history->Remember(entries, std::move(prepared), targetFolders, options,
+                      matched, !results.Done());
+  return results.Finish();
+}
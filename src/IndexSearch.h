@@ -0,0 +1,55 @@
+#pragma once
+#include "DirectoryTree.h"
+#include "EntryStore.h"
+#include "MFTReader.h" // For FileResult and SearchOptions
+#include "NameOrder.h"
+#include "NameSuffixArray.h"
+#include "NameTrigrams.h"
+#include "PathCache.h"
+#include "SearchHistory.h"
+#include <string>
+#include <vector>
+
+// The search loop shared by all readers.
+//
+// Each target folder is resolved once to a subtree of `tree` (rebuilt when
+// the store changed) and only those entries are visited, in preorder.
+// Overlapping targets are visited once. No targets, or an empty one, means
+// the whole volume in id order. `rootId` is the root directory's id as given
+// to PathCache::SetRoot. Once `cancel` is raised the search stops within a
+// few thousand candidates. With a `history` the search records what it
+// matched and, when the next query only narrows this one, re-checks just
+// those names instead of the whole volume (see SearchHistory). With
+// `trigrams` (rebuilt when the store changed) a query it covers only visits
+// the entries its trigram postings allow. `suffixes` (brought up to date
+// when the store changed) is preferred over `trigrams` and covers shorter
+// terms too. With `names` (brought up to date first) exact and prefix
+// queries are a lookup in the sorted names, and every result carries its
+// NameRank.
+std::vector<FileResult>
+SearchEntries(const EntryStore &entries, PathCache &paths, DirectoryTree &tree,
+              uint32_t rootId, const std::wstring &query,
+              const std::vector<std::wstring> &targetFolders,
+              const SearchOptions &options, int maxResults,
+              const CancelToken *cancel = nullptr,
+              SearchHistory *history = nullptr,
+              NameTrigrams *trigrams = nullptr,
+              NameSuffixArray *suffixes = nullptr,
+              NameOrder *names = nullptr);
+
+// Same search, streamed: matches go to `onResults` in batches as they are
+// found (at the latest a few milliseconds after the first one of a batch), so
+// a caller can show or write them before the scan ends without holding them
+// all. Returns the number delivered; nothing more is delivered once `cancel`
+// is raised.
+size_t SearchEntries(const EntryStore &entries, PathCache &paths,
+                     DirectoryTree &tree, uint32_t rootId,
+                     const std::wstring &query,
+                     const std::vector<std::wstring> &targetFolders,
+                     const SearchOptions &options, int maxResults,
+                     const ResultCallback &onResults,
+                     const CancelToken *cancel = nullptr,
+                     SearchHistory *history = nullptr,
+                     NameTrigrams *trigrams = nullptr,
+                     NameSuffixArray *suffixes = nullptr,
+                     NameOrder *names = nullptr);
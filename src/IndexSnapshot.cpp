@@ -0,0 +1,382 @@
+#include "IndexSnapshot.h"
+
+static uint64_t AlignUp(uint64_t value) { return (value + 7) & ~7ULL; }
+
+void SnapshotBuilder::Reserve(size_t count) {
+  ids.reserve(count);
+  parents.reserve(count);
+  sizes.reserve(count);
+  allocatedSizes.reserve(count);
+  times.reserve(count);
+  creationTimes.reserve(count);
+  accessTimes.reserve(count);
+  changeTimes.reserve(count);
+  attributes.reserve(count);
+  nameOffsets.reserve(count);
+  nameLengths.reserve(count);
+  flags.reserve(count);
+  names.reserve(count * 16);
+}
+
+void SnapshotBuilder::Add(uint32_t id, uint32_t parentId, const wchar_t *name,
+                          size_t nameLength, uint64_t size,
+                          uint64_t allocatedSize, uint64_t lastWriteTime,
+                          const EntryTimes &entryTimes,
+                          uint32_t entryAttributes, uint8_t entryFlags) {
+  if (nameLength > 255)
+    nameLength = 255;
+  ids.push_back(id);
+  parents.push_back(parentId);
+  sizes.push_back(size);
+  allocatedSizes.push_back(allocatedSize);
+  times.push_back(lastWriteTime);
+  creationTimes.push_back(entryTimes.creation);
+  accessTimes.push_back(entryTimes.lastAccess);
+  changeTimes.push_back(entryTimes.change);
+  attributes.push_back((uint16_t)entryAttributes);
+  nameOffsets.push_back((uint32_t)names.size());
+  nameLengths.push_back((uint8_t)nameLength);
+  flags.push_back(entryFlags);
+  names.insert(names.end(), name, name + nameLength);
+}
+
+static bool WriteAll(HANDLE hFile, const void *data, uint64_t size) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (size > 0) {
+    DWORD chunk = (DWORD)(size > 0x10000000 ? 0x10000000 : size);
+    DWORD written = 0;
+    if (!WriteFile(hFile, p, chunk, &written, NULL) || written != chunk)
+      return false;
+    p += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+static bool WritePadded(HANDLE hFile, const void *data, uint64_t size,
+                        uint64_t &pos) {
+  static const uint8_t zeros[8] = {0};
+  if (size > 0 && !WriteAll(hFile, data, size))
+    return false;
+  pos += size;
+  uint64_t pad = AlignUp(pos) - pos;
+  if (pad > 0 && !WriteAll(hFile, zeros, pad))
+    return false;
+  pos += pad;
+  return true;
+}
+
+bool SnapshotBuilder::Write(const std::wstring &path, const SnapshotInfo &info,
+                            std::wstring &error) const {
+  uint64_t count = ids.size();
+
+  SNAPSHOT_HEADER hdr = {0};
+  hdr.Magic = SnapshotMagic;
+  hdr.Version = SnapshotVersion;
+  hdr.FileSystem = info.fileSystem;
+  hdr.CodePage = info.codePage;
+  hdr.VolumeSerial = info.volumeSerial;
+  hdr.MftLsn = info.mftLsn;
+  hdr.JournalId = info.journalId;
+  hdr.JournalUsn = info.journalUsn;
+  hdr.CreatedAt = info.createdAt;
+  hdr.Options = info.options;
+  hdr.IdLimit = count > 0 ? ids.back() + 1 : 0;
+  hdr.EntryCount = count;
+  hdr.NameChars = names.size();
+
+  uint64_t pos = AlignUp(sizeof(SNAPSHOT_HEADER));
+  hdr.IdsOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint32_t));
+  hdr.ParentsOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint32_t));
+  hdr.SizesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint64_t));
+  hdr.AllocatedSizesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint64_t));
+  hdr.TimesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint64_t));
+  hdr.CreationTimesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint64_t));
+  hdr.AccessTimesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint64_t));
+  hdr.ChangeTimesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint64_t));
+  hdr.AttributesOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint16_t));
+  hdr.NameOffsetsOffset = pos;
+  pos = AlignUp(pos + count * sizeof(uint32_t));
+  hdr.NameLengthsOffset = pos;
+  pos = AlignUp(pos + count);
+  hdr.FlagsOffset = pos;
+  pos = AlignUp(pos + count);
+  hdr.NamesOffset = pos;
+  pos = AlignUp(pos + names.size() * sizeof(wchar_t));
+  hdr.FileSize = pos;
+
+  std::wstring tempPath = path + L".tmp";
+  HANDLE hFile = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, NULL,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    error = L"Failed to create snapshot file";
+    return false;
+  }
+
+  uint64_t written = 0;
+  bool ok =
+      WritePadded(hFile, &hdr, sizeof(hdr), written) &&
+      WritePadded(hFile, ids.data(), count * sizeof(uint32_t), written) &&
+      WritePadded(hFile, parents.data(), count * sizeof(uint32_t), written) &&
+      WritePadded(hFile, sizes.data(), count * sizeof(uint64_t), written) &&
+      WritePadded(hFile, allocatedSizes.data(), count * sizeof(uint64_t),
+                  written) &&
+      WritePadded(hFile, times.data(), count * sizeof(uint64_t), written) &&
+      WritePadded(hFile, creationTimes.data(), count * sizeof(uint64_t),
+                  written) &&
+      WritePadded(hFile, accessTimes.data(), count * sizeof(uint64_t),
+                  written) &&
+      WritePadded(hFile, changeTimes.data(), count * sizeof(uint64_t),
+                  written) &&
+      WritePadded(hFile, attributes.data(), count * sizeof(uint16_t),
+                  written) &&
+      WritePadded(hFile, nameOffsets.data(), count * sizeof(uint32_t),
+                  written) &&
+      WritePadded(hFile, nameLengths.data(), count, written) &&
+      WritePadded(hFile, flags.data(), count, written) &&
+      WritePadded(hFile, names.data(), names.size() * sizeof(wchar_t),
+                  written);
+  CloseHandle(hFile);
+
+  if (!ok || written != hdr.FileSize) {
+    DeleteFileW(tempPath.c_str());
+    error = L"Failed to write snapshot file";
+    return false;
+  }
+  if (!MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFileW(tempPath.c_str());
+    error = L"Failed to replace snapshot file";
+    return false;
+  }
+  return true;
+}
+
+SnapshotView::SnapshotView()
+    : hFile(INVALID_HANDLE_VALUE), hMapping(NULL), base(nullptr), fileSize(0),
+      header(nullptr) {}
+
+SnapshotView::~SnapshotView() { Close(); }
+
+void SnapshotView::Close() {
+  if (base) {
+    UnmapViewOfFile(base);
+    base = nullptr;
+  }
+  header = nullptr;
+  if (hMapping) {
+    CloseHandle(hMapping);
+    hMapping = NULL;
+  }
+  if (hFile != INVALID_HANDLE_VALUE) {
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+  }
+  fileSize = 0;
+}
+
+bool SnapshotView::Open(const std::wstring &path, std::wstring &error) {
+  Close();
+  hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) {
+    error = L"Snapshot not found";
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(hFile, &size) ||
+      (uint64_t)size.QuadPart < sizeof(SNAPSHOT_HEADER)) {
+    error = L"Snapshot file too small";
+    Close();
+    return false;
+  }
+  fileSize = (uint64_t)size.QuadPart;
+
+  hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!hMapping) {
+    error = L"Failed to map snapshot file";
+    Close();
+    return false;
+  }
+  base = (const uint8_t *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+  if (!base) {
+    error = L"Failed to map snapshot file";
+    Close();
+    return false;
+  }
+  header = (const SNAPSHOT_HEADER *)base;
+
+  if (!Validate(error)) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool SnapshotView::Validate(std::wstring &error) const {
+  if (header->Magic != SnapshotMagic) {
+    error = L"Not a snapshot file";
+    return false;
+  }
+  if (header->Version != SnapshotVersion) {
+    error = L"Unsupported snapshot version";
+    return false;
+  }
+  if (header->FileSize != fileSize) {
+    error = L"Truncated snapshot file";
+    return false;
+  }
+
+  // Every column must lie inside the file
+  uint64_t n = header->EntryCount;
+  struct {
+    uint64_t offset;
+    uint64_t bytes;
+  } columns[] = {
+      {header->IdsOffset, n * sizeof(uint32_t)},
+      {header->ParentsOffset, n * sizeof(uint32_t)},
+      {header->SizesOffset, n * sizeof(uint64_t)},
+      {header->AllocatedSizesOffset, n * sizeof(uint64_t)},
+      {header->TimesOffset, n * sizeof(uint64_t)},
+      {header->CreationTimesOffset, n * sizeof(uint64_t)},
+      {header->AccessTimesOffset, n * sizeof(uint64_t)},
+      {header->ChangeTimesOffset, n * sizeof(uint64_t)},
+      {header->AttributesOffset, n * sizeof(uint16_t)},
+      {header->NameOffsetsOffset, n * sizeof(uint32_t)},
+      {header->NameLengthsOffset, n},
+      {header->FlagsOffset, n},
+      {header->NamesOffset, header->NameChars * sizeof(wchar_t)},
+  };
+  for (const auto &c : columns) {
+    if (c.offset % 8 != 0 || c.offset > fileSize ||
+        c.bytes > fileSize - c.offset) {
+      error = L"Corrupt snapshot layout";
+      return false;
+    }
+  }
+
+  // Names must stay inside the pool
+  const uint32_t *offsets = NameOffsets();
+  const uint8_t *lengths = NameLengths();
+  for (uint64_t i = 0; i < n; i++) {
+    if ((uint64_t)offsets[i] + lengths[i] > header->NameChars) {
+      error = L"Corrupt snapshot name table";
+      return false;
+    }
+  }
+
+  // Ids ascend; only a link or stream row repeats the id before it
+  const uint32_t *ids = Ids();
+  const uint8_t *flags = Flags();
+  for (uint64_t i = 0; i < n; i++) {
+    bool link = (flags[i] & (SnapshotFlag_Link | SnapshotFlag_Stream)) != 0;
+    if (i == 0 ? link
+               : (link ? ids[i] != ids[i - 1] : ids[i] <= ids[i - 1])) {
+      error = L"Corrupt snapshot id table";
+      return false;
+    }
+  }
+  // The store is sized by the last id; a damaged one must not make it
+  // reserve billions of rows
+  if (n > 0 && ids[n - 1] >= header->IdLimit) {
+    error = L"Corrupt snapshot id table";
+    return false;
+  }
+  return true;
+}
+
+SnapshotInfo SnapshotView::Info() const {
+  SnapshotInfo info;
+  info.fileSystem = header->FileSystem;
+  info.codePage = header->CodePage;
+  info.volumeSerial = header->VolumeSerial;
+  info.mftLsn = header->MftLsn;
+  info.journalId = header->JournalId;
+  info.journalUsn = header->JournalUsn;
+  info.createdAt = header->CreatedAt;
+  info.options = header->Options;
+  return info;
+}
+
+void ExportEntries(const EntryStore &store, SnapshotBuilder &builder) {
+  builder.Reserve(store.Count() + store.LinkCount() + store.StreamCount());
+  for (uint32_t id = 0; id < store.IdLimit(); id++) {
+    if (!store.IsValid(id))
+      continue;
+    uint8_t flags = store.IsDirectory(id) ? SnapshotFlag_Directory : 0;
+    builder.Add(id, store.Parent(id), store.Name(id), store.NameLength(id),
+                store.Size(id), store.AllocatedSize(id),
+                store.LastWriteTime(id), store.Times(id), store.Attributes(id),
+                flags);
+    for (uint32_t link = store.FirstLink(id); link != EntryStore::NoLink;
+         link = store.NextLink(link))
+      builder.Add(id, store.LinkParent(link), store.LinkName(link),
+                  store.LinkNameLength(link), store.Size(id), 0,
+                  store.LastWriteTime(id), EntryTimes(), 0,
+                  flags | SnapshotFlag_Link);
+    for (uint32_t stream = store.FirstStream(id);
+         stream != EntryStore::NoStream; stream = store.NextStream(stream)) {
+      size_t skip = store.StreamSuffix(stream);
+      builder.Add(id, store.Parent(id), store.StreamName(stream) + skip,
+                  store.StreamNameLength(stream) - skip,
+                  store.StreamSize(stream), 0, store.LastWriteTime(id),
+                  EntryTimes(), 0, SnapshotFlag_Stream);
+    }
+  }
+}
+
+void ImportEntries(const SnapshotView &view, EntryStore &store) {
+  size_t count = view.Count();
+  const uint32_t *ids = view.Ids();
+  const uint32_t *parents = view.Parents();
+  const uint64_t *sizes = view.Sizes();
+  const uint64_t *allocatedSizes = view.AllocatedSizes();
+  const uint64_t *times = view.Times();
+  const uint64_t *creationTimes = view.CreationTimes();
+  const uint64_t *accessTimes = view.AccessTimes();
+  const uint64_t *changeTimes = view.ChangeTimes();
+  const uint16_t *attributes = view.Attributes();
+  const uint32_t *nameOffsets = view.NameOffsets();
+  const uint8_t *nameLengths = view.NameLengths();
+  const uint8_t *flags = view.Flags();
+  const wchar_t *names = view.Names();
+
+  store.Clear();
+  // Ids are written in ascending order, so the last one bounds the columns
+  store.Reserve(count > 0 ? (size_t)ids[count - 1] + 1 : 0, view.NameChars());
+  for (size_t i = 0; i < count; i++) {
+    if (flags[i] & SnapshotFlag_Link) {
+      store.AddLink(ids[i], parents[i], names + nameOffsets[i],
+                    nameLengths[i]);
+    } else if (flags[i] & SnapshotFlag_Stream) {
+      store.AddStream(ids[i], names + nameOffsets[i], nameLengths[i],
+                      sizes[i]);
+    } else {
+      store.Set(ids[i], parents[i], names + nameOffsets[i], nameLengths[i],
+                sizes[i], times[i], (flags[i] & SnapshotFlag_Directory) != 0);
+      EntryTimes entryTimes;
+      entryTimes.creation = creationTimes[i];
+      entryTimes.lastAccess = accessTimes[i];
+      entryTimes.change = changeTimes[i];
+      store.SetAllocatedSize(ids[i], allocatedSizes[i]);
+      store.SetTimes(ids[i], entryTimes);
+      store.SetAttributes(ids[i], attributes[i]);
+    }
+  }
+}
+
+std::wstring SnapshotFileName(wchar_t drive, uint32_t volumeSerial) {
+  wchar_t buf[32];
+  swprintf(buf, 32, L"%c_%08X.ffsidx", (wchar_t)towupper(drive),
+           (unsigned)volumeSerial);
+  return buf;
+}
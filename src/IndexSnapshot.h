@@ -0,0 +1,198 @@
+#pragma once
+#include "EntryStore.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+// On-disk snapshot of a scanned volume index.
+//
+// Layout (little-endian, every section 8-byte aligned):
+//   SNAPSHOT_HEADER
+//   uint32_t Ids[EntryCount]          EntryStore id
+//   uint32_t Parents[EntryCount]      id of the parent directory, or
+//                                     EntryStore::NoParent at a FAT root
+//   uint64_t Sizes[EntryCount]
+//   uint64_t AllocatedSizes[EntryCount]
+//   uint64_t Times[EntryCount]        last write time (FILETIME)
+//   uint64_t CreationTimes[EntryCount]
+//   uint64_t AccessTimes[EntryCount]
+//   uint64_t ChangeTimes[EntryCount]
+//   uint16_t Attributes[EntryCount]   FILE_ATTRIBUTE_*, low 16 bits
+//   uint32_t NameOffsets[EntryCount]  into the name pool, in code units
+//   uint8_t  NameLengths[EntryCount]  in code units (names are <= 255)
+//   uint8_t  Flags[EntryCount]        SnapshotFlag_*
+//   wchar_t  Names[NameChars]         UTF-16 name pool, not terminated
+//
+// Ids ascend and stay below the header's IdLimit. A further hard link or a named stream of an entry is a row of
+// its own right after the entry's row, with the same id and SnapshotFlag_Link
+// or SnapshotFlag_Stream set. A stream row holds the stream's name and size;
+// link and stream rows leave the allocated size, the extra times and the
+// attributes 0.
+//
+// The file is mapped read-only on load and the columns are copied straight
+// into an EntryStore, without per-entry allocation.
+
+const uint32_t SnapshotMagic = 0x58444946; // "FIDX"
+const uint32_t SnapshotVersion = 7;
+
+const uint8_t SnapshotFlag_Directory = 0x01;
+const uint8_t SnapshotFlag_Link = 0x02;
+const uint8_t SnapshotFlag_Stream = 0x04;
+
+// What the scan that produced a snapshot included
+const uint32_t SnapshotOption_Streams = 0x01;
+
+// Identifies the volume state a snapshot was taken from.
+struct SnapshotInfo {
+  uint32_t fileSystem;   // VolumeFileSystem
+  uint32_t codePage;     // FAT short-name code page, 0 otherwise
+  uint64_t volumeSerial; // GetVolumeInformation serial
+  uint64_t mftLsn;       // NTFS: LSN of $MFT record 0 at scan time
+  uint64_t journalId;    // NTFS: USN journal id, 0 if no journal
+  uint64_t journalUsn;   // NTFS: next USN at scan time
+  uint64_t createdAt;    // FILETIME (UTC) when the snapshot was written
+  uint32_t options;      // SnapshotOption_*
+
+  SnapshotInfo()
+      : fileSystem(0), codePage(0), volumeSerial(0), mftLsn(0), journalId(0),
+        journalUsn(0), createdAt(0), options(0) {}
+};
+
+#pragma pack(push, 1)
+struct SNAPSHOT_HEADER {
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t FileSystem;
+  uint32_t CodePage;
+  uint64_t VolumeSerial;
+  uint64_t MftLsn;
+  uint64_t JournalId;
+  uint64_t JournalUsn;
+  uint64_t CreatedAt;
+  uint32_t Options;
+  uint32_t IdLimit; // Largest id + 1; bounds the id table when loading
+  uint64_t EntryCount;
+  uint64_t NameChars;
+  uint64_t IdsOffset;
+  uint64_t ParentsOffset;
+  uint64_t SizesOffset;
+  uint64_t AllocatedSizesOffset;
+  uint64_t TimesOffset;
+  uint64_t CreationTimesOffset;
+  uint64_t AccessTimesOffset;
+  uint64_t ChangeTimesOffset;
+  uint64_t AttributesOffset;
+  uint64_t NameOffsetsOffset;
+  uint64_t NameLengthsOffset;
+  uint64_t FlagsOffset;
+  uint64_t NamesOffset;
+  uint64_t FileSize;
+};
+#pragma pack(pop)
+
+// Collects entries column by column and writes them out in one go.
+class SnapshotBuilder {
+public:
+  void Reserve(size_t count);
+  void Add(uint32_t id, uint32_t parentId, const wchar_t *name,
+           size_t nameLength, uint64_t size, uint64_t allocatedSize,
+           uint64_t lastWriteTime, const EntryTimes &entryTimes,
+           uint32_t attributes, uint8_t flags);
+  size_t Count() const { return ids.size(); }
+
+  // Writes to a temporary file and renames it over `path`, so a crash never
+  // leaves a half-written snapshot behind.
+  bool Write(const std::wstring &path, const SnapshotInfo &info,
+             std::wstring &error) const;
+
+private:
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> parents;
+  std::vector<uint64_t> sizes;
+  std::vector<uint64_t> allocatedSizes;
+  std::vector<uint64_t> times;
+  std::vector<uint64_t> creationTimes;
+  std::vector<uint64_t> accessTimes;
+  std::vector<uint64_t> changeTimes;
+  std::vector<uint16_t> attributes;
+  std::vector<uint32_t> nameOffsets;
+  std::vector<uint8_t> nameLengths;
+  std::vector<uint8_t> flags;
+  std::vector<wchar_t> names;
+};
+
+// Read-only memory-mapped view of a snapshot file.
+class SnapshotView {
+public:
+  SnapshotView();
+  ~SnapshotView();
+
+  bool Open(const std::wstring &path, std::wstring &error);
+  void Close();
+  bool IsOpen() const { return base != nullptr; }
+
+  SnapshotInfo Info() const;
+  size_t Count() const { return (size_t)header->EntryCount; }
+  size_t NameChars() const { return (size_t)header->NameChars; }
+
+  const uint32_t *Ids() const { return Column<uint32_t>(header->IdsOffset); }
+  const uint32_t *Parents() const {
+    return Column<uint32_t>(header->ParentsOffset);
+  }
+  const uint64_t *Sizes() const {
+    return Column<uint64_t>(header->SizesOffset);
+  }
+  const uint64_t *AllocatedSizes() const {
+    return Column<uint64_t>(header->AllocatedSizesOffset);
+  }
+  const uint64_t *Times() const {
+    return Column<uint64_t>(header->TimesOffset);
+  }
+  const uint64_t *CreationTimes() const {
+    return Column<uint64_t>(header->CreationTimesOffset);
+  }
+  const uint64_t *AccessTimes() const {
+    return Column<uint64_t>(header->AccessTimesOffset);
+  }
+  const uint64_t *ChangeTimes() const {
+    return Column<uint64_t>(header->ChangeTimesOffset);
+  }
+  const uint16_t *Attributes() const {
+    return Column<uint16_t>(header->AttributesOffset);
+  }
+  const uint32_t *NameOffsets() const {
+    return Column<uint32_t>(header->NameOffsetsOffset);
+  }
+  const uint8_t *NameLengths() const {
+    return Column<uint8_t>(header->NameLengthsOffset);
+  }
+  const uint8_t *Flags() const { return Column<uint8_t>(header->FlagsOffset); }
+  const wchar_t *Names() const {
+    return Column<wchar_t>(header->NamesOffset);
+  }
+
+private:
+  HANDLE hFile;
+  HANDLE hMapping;
+  const uint8_t *base;
+  uint64_t fileSize;
+  const SNAPSHOT_HEADER *header;
+
+  template <typename T> const T *Column(uint64_t offset) const {
+    return (const T *)(base + offset);
+  }
+  bool Validate(std::wstring &error) const;
+
+  SnapshotView(const SnapshotView &) = delete;
+  SnapshotView &operator=(const SnapshotView &) = delete;
+};
+
+// Default snapshot file name for a volume, e.g. "C_1A2B3C4D.ffsidx".
+std::wstring SnapshotFileName(wchar_t drive, uint32_t volumeSerial);
+
+// Copies the valid entries of `store`, with their links and streams, into
+// `builder`.
+void ExportEntries(const EntryStore &store, SnapshotBuilder &builder);
+// Replaces the contents of `store` with the entries of `view`.
+void ImportEntries(const SnapshotView &view, EntryStore &store);
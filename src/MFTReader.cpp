@@ -1,7 +1,15 @@
 #include "MFTReader.h"
+#include "IndexSearch.h"
+#include "PipelinedReader.h"
+#include "UpcaseTable.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <future>
 #include <iostream>
-#include <regex>
-#include <sstream>
+#include <memory>
+#include <winioctl.h>
 #include <vector>
 
 // Helper to decode NTFS Data Runs
@@ -11,7 +19,11 @@ struct DataRun {
 };
 
 MFTReader::MFTReader()
-    : hVolume(INVALID_HANDLE_VALUE), currentDrive(0), mftStartLcn(0) {}
+    : hVolume(INVALID_HANDLE_VALUE), currentDrive(0),
+      history(new SearchHistory()), foldNames(false),
+      chunkSize(DefaultScanChunkSize), queueDepth(DefaultScanQueueDepth),
+      parseThreads(0), indexStreams(false), cancelToken(nullptr),
+      mftStartLcn(0) {}
 
 MFTReader::~MFTReader() { Close(); }
 
@@ -30,12 +42,27 @@ void MFTReader::SetError(const std::wstring &msg) {
     LocalFree(lpMsgBuf);
 }
 
-void MFTReader::Close() {
+void MFTReader::ReleaseVolume() {
   if (hVolume != INVALID_HANDLE_VALUE) {
     CloseHandle(hVolume);
     hVolume = INVALID_HANDLE_VALUE;
   }
-  fileMap.clear();
+}
+
+void MFTReader::Close() {
+  ReleaseVolume();
+  entries.Clear();
+  tree.Clear();
+  totals.Clear();
+  history->Clear();
+  if (trigrams)
+    trigrams->Clear();
+  if (suffixes)
+    suffixes->Clear();
+  if (names)
+    names->Clear();
+  upcase.clear();
+  splitRecords.clear();
 }
 
 bool MFTReader::Initialize(TCHAR driveLetter) {
@@ -45,9 +72,18 @@ bool MFTReader::Initialize(TCHAR driveLetter) {
   Close();
   currentDrive = driveLetter;
   lastError = L"";
+  return OpenVolume();
+}
+
+bool MFTReader::ReopenVolume() {
+  ReleaseVolume();
+  lastError = L"";
+  return OpenVolume();
+}
 
+bool MFTReader::OpenVolume() {
   std::wstring path = L"\\\\.\\";
-  path += driveLetter;
+  path += currentDrive;
   path += L":";
 
   hVolume = CreateFileW(path.c_str(), GENERIC_READ,
@@ -63,7 +99,7 @@ bool MFTReader::Initialize(TCHAR driveLetter) {
   if (!DeviceIoControl(hVolume, FSCTL_GET_NTFS_VOLUME_DATA, NULL, 0,
                        &volumeData, sizeof(volumeData), &bytesReturned, NULL)) {
     SetError(L"Failed to get NTFS volume data");
-    Close();
+    ReleaseVolume();
     return false;
   }
 
@@ -127,6 +163,150 @@ bool MFTReader::Initialize(TCHAR driveLetter) {
   return true;
 }
 
+enum FixupResult { Fixup_Ok = 0, Fixup_NotRecord, Fixup_Torn, Fixup_Corrupt };
+
+// Validates the update sequence of one record and restores the sector tails
+// it protects.
+static FixupResult FixupRecord(uint8_t *record, uint32_t recordSize) {
+  FILE_RECORD_HEADER *header = (FILE_RECORD_HEADER *)record;
+  if (header->Magic != FileRecordMagic)
+    return header->Magic == BadRecordMagic ? Fixup_Corrupt : Fixup_NotRecord;
+
+  uint32_t strides = recordSize / UpdateSequenceStride;
+  uint32_t usaBytes = (strides + 1) * sizeof(uint16_t);
+  if (strides == 0 || header->UpdateSequenceSize != strides + 1 ||
+      (header->UpdateSequenceOffset & 1) ||
+      header->UpdateSequenceOffset + usaBytes > UpdateSequenceStride - 2)
+    return Fixup_Corrupt;
+
+  uint16_t *usa = (uint16_t *)(record + header->UpdateSequenceOffset);
+  uint16_t usn = usa[0];
+  uint8_t *tail = record + UpdateSequenceStride - sizeof(uint16_t);
+  for (uint32_t i = 0; i < strides; i++, tail += UpdateSequenceStride) {
+    if (*(uint16_t *)tail != usn)
+      return Fixup_Torn;
+  }
+  tail = record + UpdateSequenceStride - sizeof(uint16_t);
+  for (uint32_t i = 0; i < strides; i++, tail += UpdateSequenceStride)
+    *(uint16_t *)tail = usa[i + 1];
+  return Fixup_Ok;
+}
+
+// Fixes up a batch of records read from the MFT. Records that fail are
+// counted and their signature cleared, so DecodeRecord skips them instead of
+// parsing a half-written record.
+static void FixupRecords(uint8_t *buffer, uint32_t count, uint32_t recordSize,
+                         NtfsScanStats &stats) {
+  for (uint32_t i = 0; i < count; i++) {
+    uint8_t *record = buffer + (size_t)i * recordSize;
+    FILE_RECORD_HEADER *header = (FILE_RECORD_HEADER *)record;
+    // Flags sit in the first stride, before any protected tail
+    bool inUse = header->Magic == FileRecordMagic && (header->Flags & 0x01);
+    stats.recordsRead++;
+
+    FixupResult result = FixupRecord(record, recordSize);
+    if (result == Fixup_Ok) {
+      if (inUse)
+        stats.recordsInUse++;
+      continue;
+    }
+    if (result == Fixup_Torn && inUse)
+      stats.tornRecords++;
+    else if (result == Fixup_Corrupt)
+      stats.corruptRecords++;
+    header->Magic = 0;
+  }
+}
+
+// Chunk of records copied out of the read buffer and decoded by a worker.
+struct MFTReader::RecordBatch {
+  std::vector<uint8_t> data;
+  uint32_t records;
+  std::vector<ParsedRecord> parsed; // Names point into `data`
+  NtfsScanStats stats;
+  std::future<void> done;
+
+  RecordBatch() : records(0) {}
+};
+
+void MFTReader::DecodeBatch(RecordBatch &batch, uint32_t recordSize,
+                            bool withStreams) {
+  batch.stats = NtfsScanStats();
+  batch.parsed.clear();
+  FixupRecords(batch.data.data(), batch.records, recordSize, batch.stats);
+  ParsedRecord record;
+  for (uint32_t i = 0; i < batch.records; i++) {
+    const FILE_RECORD_HEADER *header =
+        (const FILE_RECORD_HEADER *)(batch.data.data() +
+                                     (size_t)i * recordSize);
+    if (DecodeRecord(header, recordSize, withStreams, record))
+      batch.parsed.push_back(record);
+  }
+}
+
+void MFTReader::MergeBatch(const RecordBatch &batch) {
+  scanStats.recordsRead += batch.stats.recordsRead;
+  scanStats.recordsInUse += batch.stats.recordsInUse;
+  scanStats.tornRecords += batch.stats.tornRecords;
+  scanStats.corruptRecords += batch.stats.corruptRecords;
+  for (const auto &record : batch.parsed)
+    StoreRecord(record);
+}
+
+bool MFTReader::ReadMftBaseRecord(std::vector<uint8_t> &buffer) {
+  uint64_t mftOffset = mftStartLcn * bytesPerCluster;
+  buffer.resize(recordSize);
+
+  LARGE_INTEGER li;
+  li.QuadPart = mftOffset;
+  if (!SetFilePointerEx(hVolume, li, NULL, FILE_BEGIN)) {
+    SetError(L"Failed to seek to MFT start");
+    return false;
+  }
+
+  DWORD bytesRead;
+  if (!ReadFile(hVolume, buffer.data(), recordSize, &bytesRead, NULL) ||
+      bytesRead != recordSize) {
+    SetError(L"Failed to read MFT Header");
+    return false;
+  }
+  if (FixupRecord(buffer.data(), recordSize) != Fixup_Ok) {
+    lastError = L"$MFT record is damaged";
+    return false;
+  }
+  return true;
+}
+
+bool MFTReader::QueryChangeStamp(NtfsChangeStamp &stamp) {
+  if (hVolume == INVALID_HANDLE_VALUE) {
+    lastError = L"Volume not initialized";
+    return false;
+  }
+
+  std::vector<uint8_t> buffer;
+  if (!ReadMftBaseRecord(buffer))
+    return false;
+  const FILE_RECORD_HEADER *fr = (const FILE_RECORD_HEADER *)buffer.data();
+  if (fr->Magic != 0x454C4946) {
+    lastError = L"Invalid $MFT record";
+    return false;
+  }
+  stamp.mftLsn = fr->LogSequenceNumber;
+
+  // The journal is optional; without it only the LSN is compared
+  USN_JOURNAL_DATA journal;
+  DWORD bytesReturned;
+  if (DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &journal,
+                      sizeof(journal), &bytesReturned, NULL)) {
+    stamp.journalId = journal.UsnJournalID;
+    stamp.journalUsn = (uint64_t)journal.NextUsn;
+  } else {
+    stamp.journalId = 0;
+    stamp.journalUsn = 0;
+  }
+  return true;
+}
+
 std::vector<DataRun> DecodeDataRuns(const uint8_t *runList, uint64_t maxLen) {
   std::vector<DataRun> runs;
   uint64_t currentLcn = 0;
@@ -166,6 +346,94 @@ std::vector<DataRun> DecodeDataRuns(const uint8_t *runList, uint64_t maxLen) {
   return runs;
 }
 
+// Reads the first `size` bytes of a non-resident attribute through the
+// volume handle. Reads whole clusters, as the handle requires, so `data` may
+// end up a little longer.
+static bool ReadRuns(HANDLE volume, uint32_t bytesPerCluster,
+                     const std::vector<DataRun> &runs, uint64_t size,
+                     std::vector<uint8_t> &data) {
+  data.clear();
+  for (const auto &run : runs) {
+    if (data.size() >= size)
+      break;
+    if (run.LCN == 0)
+      return false; // Sparse; never the case for metadata read here
+    uint64_t clustersNeeded =
+        (size - data.size() + bytesPerCluster - 1) / bytesPerCluster;
+    uint64_t clusters = (std::min)(run.Length, clustersNeeded);
+    size_t start = data.size();
+    data.resize(start + (size_t)(clusters * bytesPerCluster));
+
+    LARGE_INTEGER li;
+    li.QuadPart = (LONGLONG)(run.LCN * bytesPerCluster);
+    DWORD bytesRead;
+    if (!SetFilePointerEx(volume, li, NULL, FILE_BEGIN) ||
+        !ReadFile(volume, data.data() + start, (DWORD)(data.size() - start),
+                  &bytesRead, NULL) ||
+        bytesRead != data.size() - start)
+      return false;
+  }
+  return data.size() >= size;
+}
+
+// Turns the $MFT data runs into the volume extents holding records marked in
+// use in `bitmap`. Extents are cut at `unit` (whole records and clusters)
+// granularity, and free spans shorter than `minGap` bytes are read through
+// rather than split into separate requests.
+static std::vector<ReadExtent>
+AllocatedExtents(const std::vector<DataRun> &runs, uint32_t bytesPerCluster,
+                 const std::vector<uint8_t> &bitmap, uint64_t recordCount,
+                 uint32_t recordSize, uint32_t unit, uint64_t minGap) {
+  // Byte spans of the $MFT stream (VCN space) worth reading
+  std::vector<std::pair<uint64_t, uint64_t>> spans;
+  uint64_t bits = (std::min)(recordCount, (uint64_t)bitmap.size() * 8);
+  uint64_t id = 0;
+  while (id < bits) {
+    if (bitmap[id / 8] == 0) { // Skip free bytes quickly
+      id = (id / 8 + 1) * 8;
+      continue;
+    }
+    if (!(bitmap[id / 8] & (1 << (id % 8)))) {
+      id++;
+      continue;
+    }
+    uint64_t first = id;
+    while (id < bits && (bitmap[id / 8] & (1 << (id % 8))))
+      id++;
+    uint64_t begin = first * recordSize / unit * unit;
+    uint64_t end = (id * recordSize + unit - 1) / unit * unit;
+    if (!spans.empty() && begin <= spans.back().second + minGap)
+      spans.back().second = end;
+    else
+      spans.push_back(std::make_pair(begin, end));
+  }
+
+  // Map each span onto the runs it crosses
+  std::vector<ReadExtent> extents;
+  size_t r = 0;
+  uint64_t runStart = 0; // VCN-space byte offset of runs[r]
+  for (const auto &span : spans) {
+    uint64_t pos = span.first;
+    while (pos < span.second && r < runs.size()) {
+      uint64_t runBytes = runs[r].Length * bytesPerCluster;
+      if (pos >= runStart + runBytes) {
+        runStart += runBytes;
+        r++;
+        continue;
+      }
+      uint64_t end = (std::min)(span.second, runStart + runBytes);
+      uint64_t offset = runs[r].LCN * bytesPerCluster + (pos - runStart);
+      if (!extents.empty() &&
+          extents.back().offset + extents.back().length == offset)
+        extents.back().length += end - pos;
+      else
+        extents.push_back({offset, end - pos});
+      pos = end;
+    }
+  }
+  return extents;
+}
+
 bool MFTReader::Scan(void (*progressCallback)(int, int, void *), void *userData,
                      std::function<void(const std::wstring &)> onFileFound) {
   scanDebugCallback = onFileFound;
@@ -174,32 +442,32 @@ bool MFTReader::Scan(void (*progressCallback)(int, int, void *), void *userData,
     return false;
   }
 
-  // 1. Read Record 0 ($MFT) to find the runs
-  if (traceCallback)
-    traceCallback(L"Scan: Reading $MFT record...");
-  uint64_t mftOffset = mftStartLcn * bytesPerCluster;
-  std::vector<uint8_t> buffer(recordSize);
+  entries.Clear();
+  splitRecords.clear();
+  scanStats = NtfsScanStats();
 
-  LARGE_INTEGER li;
-  li.QuadPart = mftOffset;
-  if (!SetFilePointerEx(hVolume, li, NULL, FILE_BEGIN)) {
-    SetError(L"Failed to seek to MFT start");
+  // Record the volume state before reading, so changes made during the scan
+  // make the stamp (and any snapshot taken from it) look stale, not current.
+  if (!QueryChangeStamp(scanStamp))
     return false;
-  }
 
-  DWORD bytesRead;
-  if (!ReadFile(hVolume, buffer.data(), recordSize, &bytesRead, NULL) ||
-      bytesRead != recordSize) {
-    SetError(L"Failed to read MFT Header");
+  // 1. Read Record 0 ($MFT) to find the runs
+  if (traceCallback)
+    traceCallback(L"Scan: Reading $MFT record...");
+  std::vector<uint8_t> buffer;
+  if (!ReadMftBaseRecord(buffer))
     return false;
-  }
 
   FILE_RECORD_HEADER *fr = (FILE_RECORD_HEADER *)buffer.data();
   if (fr->Magic != 0x454C4946)
     return false; // "FILE"
 
-  // Find DATA attribute (0x80)
+  // Find the DATA attribute (0x80) and the record allocation BITMAP (0xB0)
   std::vector<DataRun> runs;
+  std::vector<DataRun> bitmapRuns;
+  std::vector<uint8_t> bitmap;
+  uint64_t bitmapSize = 0;
+  bool haveBitmap = false;
   uint8_t *attrCursor = buffer.data() + fr->AttributeOffset;
 
   while (attrCursor < buffer.data() + fr->RealSize) {
@@ -209,7 +477,7 @@ bool MFTReader::Scan(void (*progressCallback)(int, int, void *), void *userData,
     if (ah->Length == 0)
       break;
 
-    if (ah->TypeID == AttributeData) { // 0x80
+    if (ah->TypeID == AttributeData && runs.empty()) { // 0x80
       if (ah->NonResidentFlag) {
         // Safety: Check if header is large enough
         if (ah->Length < 0x40) { // Non-resident header size is usually 0x40
@@ -248,7 +516,25 @@ bool MFTReader::Scan(void (*progressCallback)(int, int, void *), void *userData,
         // Resident: MFT is too small? Unlikely for $MFT on used volume.
         // But technically possible on empty tiny volume.
       }
-      break; // Found primary DATA
+    } else if (ah->TypeID == AttributeBitmap && ah->NameLength == 0 &&
+               !haveBitmap) {
+      if (!ah->NonResidentFlag) {
+        const RESIDENT_ATTRIBUTE_HEADER *res =
+            (const RESIDENT_ATTRIBUTE_HEADER *)ah;
+        if (res->ValueOffset + res->ValueLength <= ah->Length) {
+          bitmap.assign(attrCursor + res->ValueOffset,
+                        attrCursor + res->ValueOffset + res->ValueLength);
+          haveBitmap = true;
+        }
+      } else if (ah->Length >= 0x40) {
+        uint16_t runOffset = *(uint16_t *)(attrCursor + 0x20);
+        if (runOffset < ah->Length) {
+          bitmapRuns =
+              DecodeDataRuns(attrCursor + runOffset, ah->Length - runOffset);
+          bitmapSize = *(uint64_t *)(attrCursor + 0x30);
+          haveBitmap = !bitmapRuns.empty();
+        }
+      }
     }
     attrCursor += ah->Length;
   }
@@ -260,114 +546,424 @@ bool MFTReader::Scan(void (*progressCallback)(int, int, void *), void *userData,
   if (traceCallback)
     traceCallback(L"Scan: Processing " + std::to_wstring(runs.size()) +
                   L" runs.");
-  const uint32_t BUFFER_SIZE = 1024 * 1024; // 1MB buffer
-  std::vector<uint8_t> readBuf(BUFFER_SIZE);
+
+  uint64_t mftBytes = 0;
+  for (auto &r : runs) {
+    mftBytes += r.Length * bytesPerCluster;
+    if (traceCallback)
+      traceCallback(L"Scan: Run LCN=" + std::to_wstring(r.LCN) + L", Len=" +
+                    std::to_wstring(r.Length));
+  }
+  uint64_t mftRecords = mftBytes / recordSize;
+  // Whole records and whole clusters per read (both powers of two)
+  uint32_t unit = (std::max)(recordSize, bytesPerCluster);
+  uint32_t chunk = (std::max)(chunkSize / unit, 1u) * unit;
+
+  // Free records need not be read at all: $MFT:$BITMAP marks the ones in
+  // use. Free spans shorter than a chunk are read through, as skipping them
+  // would only split one request into two.
+  std::vector<ReadExtent> extents;
+  if (haveBitmap && !bitmapRuns.empty() &&
+      !ReadRuns(hVolume, bytesPerCluster, bitmapRuns, bitmapSize, bitmap)) {
+    bitmap.clear();
+    haveBitmap = false;
+    if (traceCallback)
+      traceCallback(L"Scan: $MFT:$BITMAP unreadable, reading every record");
+  }
+  if (haveBitmap) {
+    extents = AllocatedExtents(runs, bytesPerCluster, bitmap, mftRecords,
+                               recordSize, unit, chunk);
+  } else {
+    for (auto &r : runs)
+      extents.push_back({r.LCN * bytesPerCluster, r.Length * bytesPerCluster});
+  }
 
   // Estimate total records for progress
   uint64_t totalRecords = 0;
-  for (auto &r : runs)
-    totalRecords += (r.Length * bytesPerCluster) / recordSize;
+  for (auto &e : extents)
+    totalRecords += e.length / recordSize;
+  if (traceCallback)
+    traceCallback(L"Scan: Reading " + std::to_wstring(totalRecords) + L" of " +
+                  std::to_wstring(mftRecords) + L" records (" +
+                  std::to_wstring(totalRecords * recordSize / (1024 * 1024)) +
+                  L" of " + std::to_wstring(mftBytes / (1024 * 1024)) +
+                  L" MB) in " + std::to_wstring(extents.size()) +
+                  L" extents");
   uint64_t processedRecords = 0;
   bool firstChunkProcessed = false;
-  uint32_t totalRecordsRead = 0;
-
-  for (auto &run : runs) {
-    if (traceCallback)
-      traceCallback(L"Scan: Run LCN=" + std::to_wstring(run.LCN) + L", Len=" +
-                    std::to_wstring(run.Length));
-    uint64_t runBytes = run.Length * bytesPerCluster;
-    uint64_t runStart = run.LCN * bytesPerCluster;
-    uint64_t currentOffset = 0;
-
-    LARGE_INTEGER seekPos;
-    seekPos.QuadPart = runStart;
-    SetFilePointerEx(hVolume, seekPos, NULL, FILE_BEGIN);
-
-    while (currentOffset < runBytes) {
-      uint32_t toRead =
-          (uint32_t)min((uint64_t)BUFFER_SIZE, runBytes - currentOffset);
-      if (!ReadFile(hVolume, readBuf.data(), toRead, &bytesRead, NULL)) {
-        lastError = L"ReadFile failed";
-        return false;
-      }
-
-      // Debug: Check if we read anything
-      // if (bytesRead == 0) break;
-
-      // We rely on bytesToRead vs bytesRead?
-      // MFT might be fragmented, so bytesRead might be less than bytesToRead?
-      // If bytesRead < recordSize, we can't parse a record.
-
-      if (bytesRead < recordSize) {
-        // Less than one record? End of MFT?
-        // Just break for now.
-        break;
-      }
+  entries.Reserve((size_t)mftRecords, (size_t)totalRecords * 16);
 
-      uint32_t recordsRead = bytesRead / recordSize;
-      if (scanDebugCallback && !firstChunkProcessed) {
-        scanDebugCallback(L"First chunk read: " + std::to_wstring(bytesRead) +
-                          L" bytes (" + std::to_wstring(recordsRead) +
-                          L" records)");
-        firstChunkProcessed = true;
-      }
-
-      // Process buffer
-      for (uint32_t i = 0; i < bytesRead; i += recordSize) {
-        if (i + recordSize > bytesRead)
-          break;
-        ParseRecord((FILE_RECORD_HEADER *)(readBuf.data() + i));
-        processedRecords++;
-      }
+  // A second, unbuffered overlapped handle keeps several reads in flight
+  // while records are parsed. Without one the reads run one at a time on
+  // the volume handle.
+  std::wstring path = L"\\\\.\\";
+  path += currentDrive;
+  path += L":";
+  HANDLE scanHandle = CreateFileW(
+      path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+      OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING, NULL);
+  bool overlapped = scanHandle != INVALID_HANDLE_VALUE;
+  uint32_t depth = overlapped ? queueDepth : 1;
+  if (traceCallback)
+    traceCallback(L"Scan: Reading " + std::to_wstring(chunk / 1024) +
+                  L" KB chunks, " + std::to_wstring(depth) +
+                  (overlapped ? L" in flight" : L" at a time (synchronous)"));
 
-      currentOffset += bytesRead;
-      if (progressCallback && (processedRecords % 1000 == 0)) {
+  unsigned threads =
+      parseThreads ? parseThreads : WorkerPool::DefaultThreadCount();
+  if (traceCallback)
+    traceCallback(L"Scan: Parsing on " + std::to_wstring(threads) +
+                  L" thread(s)");
+
+  ULONGLONG readStart = GetTickCount64();
+  uint64_t bytesRead = 0;
+  DWORD readError = 0;
+  bool cancelled = false;
+  {
+    // Declared before the pool, so workers are joined before batches go
+    std::deque<std::unique_ptr<RecordBatch>> pending; // In read order
+    std::vector<std::unique_ptr<RecordBatch>> spare;
+    std::unique_ptr<WorkerPool> pool;
+    if (threads > 1)
+      pool.reset(new WorkerPool(threads));
+
+    auto reportProgress = [&]() {
+      if (progressCallback && totalRecords > 0)
         progressCallback((int)((processedRecords * 100) / totalRecords), 100,
                          userData);
+    };
+    // Batches are merged strictly in read order, so the index comes out
+    // identical to a serial parse whatever the thread count
+    auto mergeOldest = [&]() {
+      std::unique_ptr<RecordBatch> batch = std::move(pending.front());
+      pending.pop_front();
+      batch->done.get();
+      MergeBatch(*batch);
+      processedRecords += batch->records;
+      reportProgress();
+      spare.push_back(std::move(batch));
+    };
+
+    PipelinedReader reader(overlapped ? scanHandle : hVolume, chunk, depth);
+    uint8_t *data;
+    uint32_t length;
+    if (reader.Start(extents)) {
+      while (reader.Next(data, length)) {
+        if (cancelToken && cancelToken->IsCancelled()) {
+          // Queued batches are finished by the pool, then dropped
+          cancelled = true;
+          break;
+        }
+        uint32_t recordsRead = length / recordSize;
+        if (scanDebugCallback && !firstChunkProcessed) {
+          scanDebugCallback(L"First chunk read: " + std::to_wstring(length) +
+                            L" bytes (" + std::to_wstring(recordsRead) +
+                            L" records)");
+          firstChunkProcessed = true;
+        }
+
+        if (!pool) {
+          // Fix up and parse in place while the next reads complete
+          FixupRecords(data, recordsRead, recordSize, scanStats);
+          for (uint32_t i = 0; i < recordsRead; i++)
+            ParseRecord((FILE_RECORD_HEADER *)(data + (size_t)i * recordSize));
+          processedRecords += recordsRead;
+          reportProgress();
+          continue;
+        }
+
+        // Merge whatever is finished; block only when every worker has a
+        // couple of chunks queued
+        while (!pending.empty() &&
+               (pending.size() >= 2 * (size_t)pool->ThreadCount() ||
+                pending.front()->done.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready))
+          mergeOldest();
+
+        std::unique_ptr<RecordBatch> batch;
+        if (spare.empty()) {
+          batch.reset(new RecordBatch());
+        } else {
+          batch = std::move(spare.back());
+          spare.pop_back();
+        }
+        // The read buffer is reused by the next Next(), so the batch keeps
+        // its own copy
+        batch->data.assign(data, data + (size_t)recordsRead * recordSize);
+        batch->records = recordsRead;
+        RecordBatch *job = batch.get();
+        uint32_t size = recordSize;
+        bool streams = indexStreams;
+        job->done = pool->Submit(
+            [job, size, streams]() { DecodeBatch(*job, size, streams); });
+        pending.push_back(std::move(batch));
       }
     }
+    while (!cancelled && !pending.empty())
+      mergeOldest();
+    // Every extension record has been seen now
+    if (!cancelled)
+      StitchExtensions();
+    readError = reader.Error();
+    bytesRead = reader.BytesRead();
+  }
+  if (overlapped)
+    CloseHandle(scanHandle);
+  if (cancelled) {
+    SetLastError(ERROR_CANCELLED);
+    SetError(L"Scan cancelled");
+    return false;
+  }
+  if (readError) {
+    SetLastError(readError);
+    SetError(L"Failed to read $MFT");
+    return false;
+  }
+
+  if (traceCallback) {
+    ULONGLONG readMs = GetTickCount64() - readStart;
+    traceCallback(L"Scan: " + std::to_wstring(bytesRead / (1024 * 1024)) +
+                  L" MB read and parsed in " + std::to_wstring(readMs) +
+                  L" ms");
   }
 
   if (progressCallback)
     progressCallback(100, 100, userData);
 
+  if (traceCallback)
+    traceCallback(L"Scan: " + std::to_wstring(scanStats.recordsRead) +
+                  L" records read, " +
+                  std::to_wstring(scanStats.recordsInUse) + L" in use, " +
+                  std::to_wstring(scanStats.tornRecords) + L" torn, " +
+                  std::to_wstring(scanStats.corruptRecords) + L" corrupt");
+  if (traceCallback && indexStreams)
+    traceCallback(L"Scan: " + std::to_wstring(entries.StreamCount()) +
+                  L" named streams");
+
+  ApplyFolding();
   scanDebugCallback = nullptr;
   return true;
 }
 
 void MFTReader::ParseRecord(const FILE_RECORD_HEADER *header) {
-  if (header->Magic != 0x454C4946)
+  ParsedRecord record;
+  if (DecodeRecord(header, recordSize, indexStreams, record))
+    StoreRecord(record);
+}
+
+void MFTReader::StoreRecord(const ParsedRecord &record) {
+  if (record.isExtension) {
+    // Held until the base record has been seen as well
+    SplitRecord &split = splitRecords[record.id];
+    if (record.hasName) {
+      if (split.names.empty() && !record.hasDataSize)
+        split.nameSize = record.size;
+      KeepNames(record, split.names);
+    }
+    if (record.hasDataSize) {
+      split.hasDataSize = true;
+      split.dataSize = record.size;
+    }
+    split.allocatedSize += record.allocatedSize;
+    KeepStreams(record, split.streams);
     return;
+  }
+
+  if (record.hasAttributeList) {
+    SplitRecord &split = splitRecords[record.id];
+    split.baseSeen = true;
+    split.baseHasDataSize = record.hasDataSize;
+    split.baseSize = record.size;
+    split.allocatedSize += record.allocatedSize;
+    split.lastWriteTime = record.lastWriteTime;
+    split.times = record.times;
+    split.attributes = record.attributes;
+    split.isDirectory = record.isDirectory;
+    if (record.hasName)
+      KeepNames(record, split.baseNames);
+    KeepStreams(record, split.baseStreams);
+  }
+  if (!record.hasName)
+    return; // Named by an extension record, see StitchExtensions()
+
+  entries.Set(record.id, record.parent, record.name, record.nameLength,
+              record.size, record.lastWriteTime, record.isDirectory);
+  entries.SetAllocatedSize(record.id, record.allocatedSize);
+  entries.SetTimes(record.id, record.times);
+  entries.SetAttributes(record.id, record.attributes);
+  for (const auto &link : record.links)
+    entries.AddLink(record.id, link.parent, link.name, link.nameLength);
+  for (const auto &stream : record.streams)
+    entries.AddStream(record.id, stream.name, stream.nameLength, stream.size);
+  if (scanDebugCallback)
+    scanDebugCallback(std::wstring(record.name, record.nameLength));
+}
+
+// Copies a record's names out of the read buffer, shown name first.
+void MFTReader::KeepNames(const ParsedRecord &record,
+                          std::vector<SplitName> &names) {
+  SplitName name;
+  name.parent = record.parent;
+  name.name.assign(record.name, record.nameLength);
+  name.rank = record.nameRank;
+  names.push_back(name);
+  for (const auto &link : record.links) {
+    name.parent = link.parent;
+    name.name.assign(link.name, link.nameLength);
+    name.rank = link.rank;
+    names.push_back(name);
+  }
+}
+
+void MFTReader::KeepStreams(const ParsedRecord &record,
+                            std::vector<SplitStream> &streams) {
+  for (const auto &stream : record.streams) {
+    SplitStream kept;
+    kept.name.assign(stream.name, stream.nameLength);
+    kept.size = stream.size;
+    streams.push_back(kept);
+  }
+}
+
+// Completes base records whose $FILE_NAME or $DATA sizes were found in
+// extension records. The best ranked name wherever it lives is shown, the
+// other non-DOS names become links, and the unnamed $DATA sizes beat the
+// copy in $FILE_NAME.
+void MFTReader::StitchExtensions() {
+  for (auto &item : splitRecords) {
+    uint32_t id = item.first;
+    SplitRecord &split = item.second;
+    if (!split.baseSeen)
+      continue; // Base record free or unreadable
+
+    bool baseNamed = !split.baseNames.empty();
+    uint64_t size = split.baseSize;
+    if (!split.baseHasDataSize) {
+      if (split.hasDataSize)
+        size = split.dataSize;
+      else if (!baseNamed)
+        size = split.nameSize;
+    }
+    if (split.names.empty()) {
+      if (baseNamed && size != split.baseSize)
+        entries.SetSize(id, size);
+      if (baseNamed)
+        entries.SetAllocatedSize(id, split.allocatedSize);
+      // The base record's own streams are in the index already
+      for (const auto &stream : split.streams)
+        entries.AddStream(id, stream.name.data(), stream.name.length(),
+                          stream.size);
+      continue;
+    }
+
+    std::vector<SplitName> &names = split.baseNames;
+    names.insert(names.end(), split.names.begin(), split.names.end());
+    size_t shown = 0;
+    for (size_t i = 1; i < names.size(); i++) {
+      if (names[i].rank > names[shown].rank)
+        shown = i;
+    }
+    const SplitName &primary = names[shown];
+    entries.Set(id, primary.parent, primary.name.data(),
+                primary.name.length(), size, split.lastWriteTime,
+                split.isDirectory);
+    entries.SetAllocatedSize(id, split.allocatedSize);
+    entries.SetTimes(id, split.times);
+    entries.SetAttributes(id, split.attributes);
+    for (size_t i = 0; i < names.size(); i++) {
+      if (i != shown && names[i].rank > 0)
+        entries.AddLink(id, names[i].parent, names[i].name.data(),
+                        names[i].name.length());
+    }
+    for (const auto *list : {&split.baseStreams, &split.streams}) {
+      for (const auto &stream : *list)
+        entries.AddStream(id, stream.name.data(), stream.name.length(),
+                          stream.size);
+    }
+    if (scanDebugCallback)
+      scanDebugCallback(primary.name);
+  }
+  splitRecords.clear();
+}
+
+// The value of a resident $FILE_NAME attribute, or null if it does not fit.
+static const FILE_NAME_ATTRIBUTE *
+ResidentFileName(const ATTRIBUTE_HEADER *attr) {
+  if (attr->NonResidentFlag)
+    return nullptr;
+  const RESIDENT_ATTRIBUTE_HEADER *res =
+      (const RESIDENT_ATTRIBUTE_HEADER *)attr;
+  if (res->ValueOffset + sizeof(FILE_NAME_ATTRIBUTE) > attr->Length)
+    return nullptr;
+  const FILE_NAME_ATTRIBUTE *fn =
+      (const FILE_NAME_ATTRIBUTE *)((const uint8_t *)attr + res->ValueOffset);
+  size_t nameBytes = fn->NameLength * sizeof(wchar_t);
+  if ((const uint8_t *)fn->Name + nameBytes >
+      (const uint8_t *)attr + attr->Length)
+    return nullptr;
+  return fn;
+}
+
+// Preference among a record's names for the one shown: Win32 (or Win32 and
+// DOS in one), then POSIX, then a DOS-only short name.
+static uint8_t NameRank(uint8_t nameType) {
+  if (nameType == 0x01 || nameType == 0x03)
+    return 2;
+  return nameType == 0x00 ? 1 : 0;
+}
+
+// Bytes allocated to a non-resident attribute, read from its VCN 0 piece:
+// the clusters actually in use for a compressed or sparse stream, else the
+// allocated size.
+static uint64_t AllocatedBytes(const ATTRIBUTE_HEADER *attr) {
+  const uint8_t *a = (const uint8_t *)attr;
+  if ((attr->Flags & 0x80FF) && attr->Length >= 0x48)
+    return *(const uint64_t *)(a + 0x40); // TotalAllocated
+  return *(const uint64_t *)(a + 0x28);
+}
+
+// Reads one fixed-up record without touching the index, so worker threads
+// can decode records in parallel. `out.name` points into the record.
+// Extension records decode too, reporting their base record as `out.id`;
+// base records without a $FILE_NAME only when an attribute list may carry it.
+bool MFTReader::DecodeRecord(const FILE_RECORD_HEADER *header,
+                             uint32_t recordSize, bool withStreams,
+                             ParsedRecord &out) {
+  if (header->Magic != 0x454C4946)
+    return false;
   if (!(header->Flags & 0x01))
-    return; // Not in use
-
-  uint64_t mftRef = header->MFTRecordNumber;
-  // If MFTRecordNumber is 0 (older NTFS), we need to track index manually.
-  // ideally we pass index to this func. But standard usually has it.
-  // If 0 and it's not the $MFT itself, it could be unreliable.
-  // Better strategy: The loop in Scan knows the index.
-  // But let's rely on MFTRecordNumber for now or pass it.
-  // Actually, let's fix: We can't trust MFTRecordNumber on all versions.
-  // However, for this simplified version, let's assume valid or skip.
-  // Better: Scan caller passes the ID. But that requires refactoring Scan loop.
-  // Let's assume header->MFTRecordNumber is correct (Valid on XP+).
-
-  Entry entry;
-  entry.RefID = header->MFTRecordNumber;
-  entry.IsValid = false;
-  entry.IsDirectory = (header->Flags & 0x02) != 0;
+    return false; // Not in use
+
+  // MFTRecordNumber is valid on XP and later volumes
+  uint64_t baseRef = header->BaseFileRecord & 0xFFFFFFFFFFFF;
+  bool isExtension = baseRef != 0;
+  bool isDirectory = (header->Flags & 0x02) != 0;
+  uint64_t parentRef = 0;
+  const wchar_t *name = nullptr;
+  size_t nameLength = 0;
+  uint8_t nameRank = 0;
+  size_t linkNames = 0; // Names that are not DOS-only
+  uint64_t nameSize = 0; // $FILE_NAME copy, used when $DATA is elsewhere
+  uint64_t dataSize = 0;
+  bool hasDataSize = false;
+  uint64_t allocatedSize = 0;
+  uint64_t lastWriteTime = 0;
+  EntryTimes times;
+  uint32_t attributes = 0;
+  bool hasAttributeList = false;
 
   if (header->RealSize > recordSize)
-    return; // Corrupt record
+    return false; // Corrupt record
   const uint8_t *ptr = (const uint8_t *)header;
   const uint8_t *end = ptr + header->RealSize;
 
   if (header->AttributeOffset >= header->RealSize)
-    return;
+    return false;
   const ATTRIBUTE_HEADER *attr =
       (const ATTRIBUTE_HEADER *)(ptr + header->AttributeOffset);
 
   bool gotName = false;
+  out.streams.clear();
 
   while ((const uint8_t *)attr + sizeof(ATTRIBUTE_HEADER) <= end &&
          attr->TypeID != AttributeEnd) {
@@ -376,31 +972,26 @@ void MFTReader::ParseRecord(const FILE_RECORD_HEADER *header) {
     if ((const uint8_t *)attr + attr->Length > end)
       break; // OOB
 
-    if (attr->TypeID == AttributeFileName) { // 0x30
-      const FILE_NAME_ATTRIBUTE *fn;
-      if (!attr->NonResidentFlag) {
-        const RESIDENT_ATTRIBUTE_HEADER *res =
-            (const RESIDENT_ATTRIBUTE_HEADER *)attr;
-
-        // Safety check for offset
-        if (res->ValueOffset + sizeof(FILE_NAME_ATTRIBUTE) <= attr->Length) {
-          fn = (const FILE_NAME_ATTRIBUTE *)((const uint8_t *)attr +
-                                             res->ValueOffset);
+    // Every $DATA stream and directory index takes disk space; resident
+    // ones live inside the record
+    if (attr->NonResidentFlag && attr->Length >= 0x40 &&
+        (attr->TypeID == AttributeData ||
+         attr->TypeID == AttributeIndexAllocation) &&
+        *(const uint64_t *)((const uint8_t *)attr + 0x10) == 0)
+      allocatedSize += AllocatedBytes(attr);
 
-          // Check Name Length
-          size_t nameBytes = fn->NameLength * sizeof(wchar_t);
-          if ((const uint8_t *)fn->Name + nameBytes <=
-              (const uint8_t *)attr + attr->Length) {
-            bool isWin32 = (fn->NameType == 0x01 || fn->NameType == 0x03);
-            if (!gotName || isWin32) {
-              entry.ParentRefID = fn->ParentDirectoryRef & 0xFFFFFFFFFFFF;
-              entry.Size = fn->DataSize;
-              if (fn->NameLength > 0)
-                entry.Name.assign(fn->Name, fn->NameLength);
-              gotName = true;
-              entry.IsValid = true;
-            }
-          }
+    if (attr->TypeID == AttributeFileName) { // 0x30
+      if (const FILE_NAME_ATTRIBUTE *fn = ResidentFileName(attr)) {
+        uint8_t rank = NameRank(fn->NameType);
+        if (rank > 0)
+          linkNames++;
+        if (!gotName || rank > nameRank) {
+          parentRef = fn->ParentDirectoryRef & 0xFFFFFFFFFFFF;
+          nameSize = fn->DataSize;
+          name = fn->Name;
+          nameLength = fn->NameLength;
+          nameRank = rank;
+          gotName = true;
         }
       }
     } else if (attr->TypeID == AttributeStandardInformation) {
@@ -411,244 +1002,451 @@ void MFTReader::ParseRecord(const FILE_RECORD_HEADER *header) {
           const STANDARD_INFORMATION *si =
               (const STANDARD_INFORMATION *)((const uint8_t *)attr +
                                              res->ValueOffset);
-          entry.LastWriteTime = si->FileChangeTime;
+          lastWriteTime = si->LastWriteTime;
+          times.creation = si->CreationTime;
+          times.lastAccess = si->LastAccessTime;
+          times.change = si->ChangeTime;
+          attributes = si->FileAttributes;
         }
       }
-    } else if (attr->TypeID == AttributeData) { // 0x80
+    } else if (attr->TypeID == AttributeAttributeList) { // 0x20
+      hasAttributeList = true;
+    } else if (attr->TypeID == AttributeData && attr->NameLength == 0) {
+      // Only the unnamed stream is the file's size; named ones are ADS
       if (!attr->NonResidentFlag) {
         // Resident
         const RESIDENT_ATTRIBUTE_HEADER *res =
             (const RESIDENT_ATTRIBUTE_HEADER *)attr;
-        entry.Size = res->ValueLength;
-      } else {
-        // Non-Resident
-        // DataSize is at offset 0x30
-        if (attr->Length >= 0x40) {
-          entry.Size = *(const uint64_t *)((const uint8_t *)attr + 0x30);
+        dataSize = res->ValueLength;
+        hasDataSize = true;
+      } else if (attr->Length >= 0x40) {
+        // Non-Resident. A fragmented stream may be split across records;
+        // only the piece starting at VCN 0 carries the sizes (DataSize at
+        // offset 0x30)
+        const uint8_t *a = (const uint8_t *)attr;
+        if (*(const uint64_t *)(a + 0x10) == 0) {
+          dataSize = *(const uint64_t *)(a + 0x30);
+          hasDataSize = true;
         }
       }
+    } else if (attr->TypeID == AttributeData && withStreams &&
+               attr->NameOffset + attr->NameLength * sizeof(wchar_t) <=
+                   attr->Length) {
+      // A named stream; like the unnamed one, only its VCN 0 piece has sizes
+      StreamRef stream;
+      stream.name =
+          (const wchar_t *)((const uint8_t *)attr + attr->NameOffset);
+      stream.nameLength = attr->NameLength;
+      const uint8_t *a = (const uint8_t *)attr;
+      if (!attr->NonResidentFlag) {
+        stream.size = ((const RESIDENT_ATTRIBUTE_HEADER *)attr)->ValueLength;
+        out.streams.push_back(stream);
+      } else if (attr->Length >= 0x40 && *(const uint64_t *)(a + 0x10) == 0) {
+        stream.size = *(const uint64_t *)(a + 0x30);
+        out.streams.push_back(stream);
+      }
     }
 
     attr = (const ATTRIBUTE_HEADER *)((const uint8_t *)attr + attr->Length);
   }
 
-  if (entry.IsValid) {
-    fileMap[entry.RefID] = entry;
-    if (scanDebugCallback) {
-      scanDebugCallback(entry.Name);
+  if (!gotName && !isExtension && !hasAttributeList)
+    return false;
+  out.id = isExtension ? (uint32_t)baseRef : header->MFTRecordNumber;
+  out.isExtension = isExtension;
+  out.hasAttributeList = hasAttributeList;
+  out.hasName = gotName;
+  out.nameRank = nameRank;
+  out.parent = (uint32_t)parentRef;
+  out.name = name;
+  out.nameLength = nameLength;
+  out.hasDataSize = hasDataSize;
+  out.size = hasDataSize ? dataSize : nameSize;
+  out.allocatedSize = allocatedSize;
+  out.lastWriteTime = lastWriteTime;
+  out.times = times;
+  // $STANDARD_INFORMATION leaves the directory bit to the record flags
+  out.attributes =
+      attributes | (isDirectory ? (uint32_t)FILE_ATTRIBUTE_DIRECTORY : 0);
+  out.isDirectory = isDirectory;
+
+  // Every other name outside the DOS namespace is a further hard link. Rare
+  // enough to walk the attributes a second time rather than collect always
+  out.links.clear();
+  if (linkNames > 1) {
+    for (attr = (const ATTRIBUTE_HEADER *)(ptr + header->AttributeOffset);
+         (const uint8_t *)attr + sizeof(ATTRIBUTE_HEADER) <= end &&
+         attr->TypeID != AttributeEnd && attr->Length != 0 &&
+         (const uint8_t *)attr + attr->Length <= end;
+         attr = (const ATTRIBUTE_HEADER *)((const uint8_t *)attr +
+                                           attr->Length)) {
+      if (attr->TypeID != AttributeFileName)
+        continue;
+      const FILE_NAME_ATTRIBUTE *fn = ResidentFileName(attr);
+      if (!fn || fn->Name == name || NameRank(fn->NameType) == 0)
+        continue;
+      NameRef link;
+      link.parent = (uint32_t)(fn->ParentDirectoryRef & 0xFFFFFFFFFFFF);
+      link.name = fn->Name;
+      link.nameLength = fn->NameLength;
+      link.rank = NameRank(fn->NameType);
+      out.links.push_back(link);
     }
   }
+  return true;
 }
 
-std::wstring MFTReader::BuildPath(uint64_t refId) {
-  // Prevent infinite loop
-  std::wstring path = L"";
-  int depth = 0;
-  while (refId != 0x05 && depth < 256) { // 0x05 is Root Directory
-    auto it = fileMap.find(refId);
-    if (it == fileMap.end())
-      break;
+std::vector<FileResult> MFTReader::Search(const std::wstring &query,
+                                          const std::wstring &targetFolder,
+                                          const SearchOptions &options,
+                                          int maxResults) {
+  std::vector<std::wstring> targets;
+  if (!targetFolder.empty())
+    targets.push_back(targetFolder);
+  return Search(query, targets, options, maxResults);
+}
 
-    path = L"\\" + it->second.Name + path;
-    refId = it->second.ParentRefID;
-    depth++;
-  }
+std::vector<FileResult>
+MFTReader::Search(const std::wstring &query,
+                  const std::vector<std::wstring> &targetFolders,
+                  const SearchOptions &options, int maxResults) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(0x05, rootPath); // 0x05 is Root Directory
+  return SearchEntries(entries, paths, tree, 0x05, query, targetFolders,
+                       options, maxResults, cancelToken, history.get(),
+                       trigrams.get(), suffixes.get(), names.get());
+}
 
-  std::wstring drivePrefix = L"";
-  drivePrefix += currentDrive;
-  drivePrefix += L":";
+size_t MFTReader::Search(const std::wstring &query,
+                         const std::vector<std::wstring> &targetFolders,
+                         const SearchOptions &options, int maxResults,
+                         const ResultCallback &onResults) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(0x05, rootPath);
+  return SearchEntries(entries, paths, tree, 0x05, query, targetFolders,
+                       options, maxResults, onResults, cancelToken,
+                       history.get(), trigrams.get(), suffixes.get(),
+                       names.get());
+}
 
-  return drivePrefix + path;
+std::vector<DirectoryUsage> MFTReader::DiskUsage(const std::wstring &folder,
+                                                 size_t count) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(0x05, rootPath);
+  return ReportDiskUsage(entries, paths, tree, totals, 0x05, folder, count);
 }
 
-bool MFTReader::MatchPattern(const std::wstring &str,
-                             const std::wstring &pattern,
-                             const SearchOptions &options) {
-  if (pattern.empty())
-    return true;
+void MFTReader::ExportSnapshot(SnapshotBuilder &builder) const {
+  ExportEntries(entries, builder);
+}
 
-  bool matched = false;
+bool MFTReader::ImportSnapshot(const SnapshotView &view, TCHAR driveLetter) {
+  currentDrive = driveLetter;
 
-  if (options.mode == MatchMode_Exact) {
-    if (options.ignoreCase) {
-      matched = lstrcmpiW(str.c_str(), pattern.c_str()) == 0;
-    } else {
-      matched = wcscmp(str.c_str(), pattern.c_str()) == 0;
-    }
-  } else if (options.mode == MatchMode_RegEx) {
-    try {
-      std::regex_constants::syntax_option_type flags = std::regex::ECMAScript;
-      if (options.ignoreCase)
-        flags |= std::regex::icase;
-      std::wregex re(pattern, flags);
-      matched = std::regex_search(str, re);
-    } catch (...) {
-      matched = false;
+  SnapshotInfo info = view.Info();
+  scanStamp.mftLsn = info.mftLsn;
+  scanStamp.journalId = info.journalId;
+  scanStamp.journalUsn = info.journalUsn;
+
+  ImportEntries(view, entries);
+  ApplyFolding();
+  return true;
+}
+
+bool MFTReader::UpdateFromJournal(size_t *changesApplied) {
+  if (changesApplied)
+    *changesApplied = 0;
+  if (hVolume == INVALID_HANDLE_VALUE) {
+    lastError = L"Volume not initialized";
+    return false;
+  }
+  if (scanStamp.journalId == 0) {
+    lastError = L"USN journal was not active at scan time";
+    return false;
+  }
+
+  USN_JOURNAL_DATA journal;
+  DWORD bytesReturned;
+  if (!DeviceIoControl(hVolume, FSCTL_QUERY_USN_JOURNAL, NULL, 0, &journal,
+                       sizeof(journal), &bytesReturned, NULL)) {
+    SetError(L"Failed to query USN journal");
+    return false;
+  }
+  if ((uint64_t)journal.UsnJournalID != scanStamp.journalId) {
+    lastError = L"USN journal was recreated";
+    return false;
+  }
+  if ((int64_t)scanStamp.journalUsn < journal.FirstUsn) {
+    lastError = L"USN journal no longer covers the index";
+    return false;
+  }
+
+  READ_USN_JOURNAL_DATA_V0 readData = {0};
+  readData.StartUsn = (USN)scanStamp.journalUsn;
+  readData.ReasonMask = 0xFFFFFFFF;
+  readData.ReturnOnlyOnClose = FALSE;
+  readData.UsnJournalID = journal.UsnJournalID;
+
+  const DWORD BUFFER_SIZE = 64 * 1024;
+  std::vector<uint8_t> buffer(BUFFER_SIZE);
+  std::vector<UsnRecord> records;
+  UsnChangeSet changeSet;
+  size_t recordCount = 0;
+
+  // Read up to the NextUsn seen above; later changes are picked up next time
+  while (readData.StartUsn < journal.NextUsn) {
+    if (!DeviceIoControl(hVolume, FSCTL_READ_USN_JOURNAL, &readData,
+                         sizeof(readData), buffer.data(), BUFFER_SIZE,
+                         &bytesReturned, NULL)) {
+      SetError(L"Failed to read USN journal");
+      return false;
     }
-  } else if (options.mode == MatchMode_SpaceDivided) {
-    std::wstringstream ss(pattern);
-    std::wstring token;
-    bool allTokensFound = true;
-    while (ss >> token) {
-      bool tokenFound = false;
-      if (options.ignoreCase) {
-        auto it = std::search(str.begin(), str.end(), token.begin(),
-                              token.end(), [](wchar_t c1, wchar_t c2) {
-                                return towlower(c1) == towlower(c2);
-                              });
-        tokenFound = (it != str.end());
-      } else {
-        tokenFound = (str.find(token) != std::wstring::npos);
-      }
-      if (!tokenFound) {
-        allTokensFound = false;
-        break;
-      }
-    }
-    matched = allTokensFound;
-  } else {
-    // Default: Substring
-    if (options.ignoreCase) {
-      auto it = std::search(
-          str.begin(), str.end(), pattern.begin(), pattern.end(),
-          [](wchar_t c1, wchar_t c2) { return towlower(c1) == towlower(c2); });
-      matched = it != str.end();
-    } else {
-      matched = str.find(pattern) != std::wstring::npos;
+    int64_t nextUsn = 0;
+    std::wstring error;
+    records.clear();
+    if (!ParseUsnReadBuffer(buffer.data(), bytesReturned, nextUsn, records,
+                            &error)) {
+      lastError = error;
+      return false;
     }
+    changeSet.Add(records);
+    recordCount += records.size();
+    if (nextUsn <= readData.StartUsn)
+      break;
+    readData.StartUsn = nextUsn;
   }
 
-  if (options.invertMatch)
-    return !matched;
-  return matched;
+  std::vector<UsnFileChange> changes = changeSet.Changes();
+  if (!ApplyChanges(changes)) {
+    lastError = L"A file with several names changed and could not be re-read";
+    return false;
+  }
+  if (traceCallback)
+    traceCallback(L"Journal: " + std::to_wstring(recordCount) +
+                  L" records, " + std::to_wstring(changes.size()) +
+                  L" files changed");
+
+  NtfsChangeStamp current;
+  if (QueryChangeStamp(current))
+    scanStamp.mftLsn = current.mftLsn;
+  scanStamp.journalUsn = (uint64_t)readData.StartUsn;
+  if (changesApplied)
+    *changesApplied = changes.size();
+  return true;
 }
 
-std::vector<FileResult> MFTReader::Search(const std::wstring &query,
-                                          const std::wstring &targetFolder,
-                                          const SearchOptions &options,
-                                          int maxResults) {
-  std::vector<FileResult> results;
-
-  // Resolve targetFolder to RefID?
-  // For now, let's just filter by string path prefix if targetFolder is set.
-  // It's slower but coding RefID resolution for input string is extra step.
-
-  for (const auto &pair : fileMap) {
-    const auto &entry = pair.second;
-    if (!entry.IsValid)
-      continue;
+bool MFTReader::ApplyChanges(const std::vector<UsnFileChange> &changes) {
+  if (hVolume == INVALID_HANDLE_VALUE)
+    return ApplyUsnChanges(entries, changes);
+  // The MFT record is authoritative for the Win32 name, size and time
+  return ApplyUsnChanges(
+      entries, changes,
+      [this](uint64_t fileRef) { return RefreshRecord(fileRef); });
+}
 
-    // Reconstruct Path
-    std::wstring fullPath = BuildPath(entry.RefID);
+// Reads record `refId` through the file system. False if the request failed;
+// `record` is null when the record is not in use.
+bool MFTReader::FetchRecord(uint64_t refId, std::vector<uint8_t> &output,
+                            const FILE_RECORD_HEADER *&record) {
+  NTFS_FILE_RECORD_INPUT_BUFFER input;
+  input.FileReferenceNumber.QuadPart = (LONGLONG)refId;
+  output.assign(sizeof(NTFS_FILE_RECORD_OUTPUT_BUFFER) + recordSize, 0);
+  DWORD bytesReturned;
+  record = nullptr;
+  if (!DeviceIoControl(hVolume, FSCTL_GET_NTFS_FILE_RECORD, &input,
+                       sizeof(input), output.data(), (DWORD)output.size(),
+                       &bytesReturned, NULL))
+    return false;
 
-    // Filter by Target Folder
-    if (!targetFolder.empty()) {
-      if (fullPath.length() < targetFolder.length())
-        continue;
+  const NTFS_FILE_RECORD_OUTPUT_BUFFER *out =
+      (const NTFS_FILE_RECORD_OUTPUT_BUFFER *)output.data();
+  // For a free record the nearest lower in-use record is returned instead
+  if (((uint64_t)out->FileReferenceNumber.QuadPart & 0xFFFFFFFFFFFF) ==
+          (refId & 0xFFFFFFFFFFFF) &&
+      out->FileRecordLength >= recordSize)
+    record = (const FILE_RECORD_HEADER *)out->FileRecordBuffer;
+  return true;
+}
 
-      // Case-insensitive prefix check
-      bool match = true;
-      for (size_t i = 0; i < targetFolder.length(); ++i) {
-        if (towlower(fullPath[i]) != towlower(targetFolder[i])) {
-          match = false;
-          break;
+// Collects the other records named by the $ATTRIBUTE_LIST of base record
+// `header` that hold a $FILE_NAME or $DATA attribute. A long list is itself
+// non-resident and is read from the volume.
+static void ListedRecords(HANDLE volume, uint32_t bytesPerCluster,
+                          const FILE_RECORD_HEADER *header,
+                          uint32_t recordSize, uint64_t baseId,
+                          std::vector<uint64_t> &records) {
+  records.clear();
+  const uint8_t *record = (const uint8_t *)header;
+  std::vector<uint8_t> data;
+  const uint8_t *list = nullptr;
+  size_t listSize = 0;
+  uint32_t offset = header->AttributeOffset;
+  while (offset + sizeof(ATTRIBUTE_HEADER) <= recordSize) {
+    const ATTRIBUTE_HEADER *ah = (const ATTRIBUTE_HEADER *)(record + offset);
+    if (ah->TypeID == 0xFFFFFFFF || ah->Length == 0 ||
+        offset + ah->Length > recordSize)
+      break;
+    if (ah->TypeID == AttributeAttributeList) {
+      if (!ah->NonResidentFlag) {
+        const RESIDENT_ATTRIBUTE_HEADER *res =
+            (const RESIDENT_ATTRIBUTE_HEADER *)ah;
+        if (res->ValueOffset + res->ValueLength <= ah->Length) {
+          list = record + offset + res->ValueOffset;
+          listSize = res->ValueLength;
         }
-      }
-      if (!match)
-        continue;
-    }
-
-    // Exclusion Filter
-    if (!options.excludePattern.empty()) {
-      bool excluded = false;
-      std::wstring targetForExclude = fullPath;
-      std::wstringstream ss(options.excludePattern);
-      std::wstring pattern;
-      while (std::getline(ss, pattern, L';')) {
-        if (pattern.empty())
-          continue;
-        if (options.ignoreCase) {
-          std::wstring targetLower = targetForExclude;
-          std::wstring patternLower = pattern;
-          for (auto &c : targetLower)
-            c = towlower(c);
-          for (auto &c : patternLower)
-            c = towlower(c);
-          if (targetLower.find(patternLower) != std::wstring::npos) {
-            excluded = true;
-            break;
-          }
-        } else {
-          if (targetForExclude.find(pattern) != std::wstring::npos) {
-            excluded = true;
-            break;
-          }
+      } else if (ah->Length >= 0x40) {
+        uint16_t runOffset = *(const uint16_t *)(record + offset + 0x20);
+        uint64_t size = *(const uint64_t *)(record + offset + 0x30);
+        if (runOffset < ah->Length &&
+            ReadRuns(volume, bytesPerCluster,
+                     DecodeDataRuns(record + offset + runOffset,
+                                    ah->Length - runOffset),
+                     size, data)) {
+          list = data.data();
+          listSize = (size_t)size;
         }
       }
-      if (excluded)
-        continue;
+      break;
     }
+    offset += ah->Length;
+  }
 
-    // Match Query (Name or Full Path)
-    if (!MatchPattern(options.matchFullPath ? fullPath : entry.Name, query,
-                      options))
-      continue;
+  // Entries: type (4), length (2), name length and offset (1 + 1), starting
+  // VCN (8), then the reference of the record holding the attribute (8)
+  for (size_t pos = 0; pos + 0x18 <= listSize;) {
+    uint32_t type = *(const uint32_t *)(list + pos);
+    uint16_t length = *(const uint16_t *)(list + pos + 4);
+    if (length < 0x18 || pos + length > listSize)
+      break;
+    uint64_t ref = *(const uint64_t *)(list + pos + 0x10) & 0xFFFFFFFFFFFF;
+    if ((type == AttributeFileName || type == AttributeData) &&
+        ref != baseId &&
+        std::find(records.begin(), records.end(), ref) == records.end())
+      records.push_back(ref);
+    pos += length;
+  }
+}
 
-    // Metadata Filters
-    if (options.minSize > 0 && entry.Size < options.minSize)
-      continue;
-    if (options.maxSize > 0 && entry.Size > options.maxSize)
-      continue;
-    if (options.minDate > 0 && entry.LastWriteTime < options.minDate)
-      continue;
-    if (options.maxDate > 0 && entry.LastWriteTime > options.maxDate)
-      continue;
+bool MFTReader::RefreshRecord(uint64_t refId) {
+  std::vector<uint8_t> output;
+  const FILE_RECORD_HEADER *record;
+  if (!FetchRecord(refId, output, record))
+    return false;
 
-    // Type Filter
-    if (entry.IsDirectory) {
-      if (!options.includeFolders)
-        continue;
-    } else {
-      if (!options.includeFiles)
-        continue;
+  uint32_t id = (uint32_t)refId;
+  entries.Remove(id);
+  // NTFS hands out the record with its update sequence already applied
+  ParsedRecord parsed;
+  if (!record || !DecodeRecord(record, recordSize, indexStreams, parsed) ||
+      parsed.isExtension)
+    return true;
+  StoreRecord(parsed);
+  if (!parsed.hasAttributeList)
+    return true;
 
-      // Extension Filter
-      if (!options.extensionFilter.empty()) {
-        bool extMatch = false;
-        size_t dotPos = entry.Name.find_last_of(L'.');
-        std::wstring fileExt = (dotPos != std::wstring::npos)
-                                   ? entry.Name.substr(dotPos + 1)
-                                   : L"";
-        for (auto &c : fileExt)
-          c = towlower(c);
-
-        std::wstringstream ss(options.extensionFilter);
-        std::wstring extToken;
-        while (std::getline(ss, extToken, L';')) {
-          if (extToken.empty())
-            continue;
-          for (auto &c : extToken)
-            c = towlower(c);
-          if (fileExt == extToken) {
-            extMatch = true;
-            break;
-          }
-        }
-        if (!extMatch)
-          continue;
+  // The name or size live in extension records; fetch just those
+  std::vector<uint64_t> listed;
+  ListedRecords(hVolume, bytesPerCluster, record, recordSize, parsed.id,
+                listed);
+  std::vector<uint8_t> extensionOutput;
+  for (uint64_t ref : listed) {
+    const FILE_RECORD_HEADER *extension;
+    ParsedRecord part;
+    if (FetchRecord(ref, extensionOutput, extension) && extension &&
+        DecodeRecord(extension, recordSize, indexStreams, part) &&
+        part.isExtension &&
+        part.id == parsed.id)
+      StoreRecord(part);
+  }
+  StitchExtensions();
+  return true;
+}
+
+bool MFTReader::ReadUpcaseTable(std::vector<uint16_t> &table) {
+  const uint64_t UpcaseRecord = 10; // $UpCase
+  std::vector<uint8_t> output;
+  const FILE_RECORD_HEADER *fr;
+  if (!FetchRecord(UpcaseRecord, output, fr) || !fr)
+    return false;
+
+  // The unnamed $DATA attribute is always non-resident (128KB)
+  const uint8_t *record = (const uint8_t *)fr;
+  std::vector<DataRun> runs;
+  uint32_t offset = fr->AttributeOffset;
+  while (offset + sizeof(ATTRIBUTE_HEADER) <= recordSize) {
+    const ATTRIBUTE_HEADER *ah = (const ATTRIBUTE_HEADER *)(record + offset);
+    if (ah->TypeID == 0xFFFFFFFF || ah->Length == 0 ||
+        offset + ah->Length > recordSize)
+      break;
+    if (ah->TypeID == AttributeData && ah->NameLength == 0) {
+      if (ah->NonResidentFlag && ah->Length >= 0x40) {
+        uint16_t runOffset = *(const uint16_t *)(record + offset + 0x20);
+        if (runOffset < ah->Length)
+          runs = DecodeDataRuns(record + offset + runOffset,
+                                ah->Length - runOffset);
       }
+      break;
     }
+    offset += ah->Length;
+  }
 
-    FileResult res;
-    res.Name = entry.Name;
-    res.FullPath = fullPath;
-    res.Size = entry.Size;
-    res.LastWriteTime = entry.LastWriteTime;
-    res.IsDirectory = entry.IsDirectory;
-    results.push_back(res);
+  std::vector<uint8_t> data;
+  if (!ReadRuns(hVolume, bytesPerCluster, runs, UpcaseTableSize * 2, data))
+    return false;
+  return ParseUpcaseTable(data.data(), data.size(), table);
+}
 
-    if (maxResults > 0 && (int)results.size() >= maxResults)
-      break;
+void MFTReader::ApplyFolding() {
+  if (!foldNames) {
+    entries.SetFoldTable(std::vector<uint16_t>());
+    return;
   }
-  return results;
+  // $UpCase is what NTFS itself compares names with; read it once per volume
+  if (upcase.empty() && hVolume != INVALID_HANDLE_VALUE &&
+      !ReadUpcaseTable(upcase)) {
+    upcase.clear();
+    if (traceCallback)
+      traceCallback(L"Scan: $UpCase unreadable, folding with towupper()");
+  }
+  entries.SetFoldTable(upcase.empty() ? DefaultUpcaseTable() : upcase);
+}
+
+void MFTReader::SetFoldNames(bool enable) {
+  foldNames = enable;
+  if (entries.Count() > 0 && entries.HasFoldedNames() != enable)
+    ApplyFolding();
 }
+
+void MFTReader::SetTrigramIndex(bool enable) {
+  if (!enable)
+    trigrams.reset();
+  else if (!trigrams)
+    trigrams.reset(new NameTrigrams());
+}
+
+void MFTReader::SetSuffixIndex(bool enable) {
+  if (!enable)
+    suffixes.reset();
+  else if (!suffixes)
+    suffixes.reset(new NameSuffixArray());
+}
+
+void MFTReader::SetNameOrder(bool enable) {
+  if (!enable)
+    names.reset();
+  else if (!names)
+    names.reset(new NameOrder());
+}
+
+void MFTReader::SetReadAhead(uint32_t chunkBytes, uint32_t depth) {
+  chunkSize = chunkBytes ? chunkBytes : DefaultScanChunkSize;
+  queueDepth = depth ? depth : DefaultScanQueueDepth;
+}
+
+void MFTReader::SetParseThreads(unsigned threads) { parseThreads = threads; }
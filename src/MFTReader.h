@@ -1,11 +1,27 @@
 #pragma once
+#include "CancelToken.h"
+#include "DirectoryTotals.h"
+#include "DirectoryTree.h"
+#include "EntryStore.h"
+#include "IndexSnapshot.h"
 #include "NtfsStructs.h"
+#include "PathCache.h"
+#include "UsnJournal.h"
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <windows.h>
 
 #include <functional>
+#include <map>
+#include <memory>
+
+class NameOrder;
+class NameSuffixArray;
+class NameTrigrams;
+class SearchHistory;
+
+// A name's rank when its volume keeps no name order.
+const uint32_t NoNameRank = 0xFFFFFFFF;
 
 struct FileResult {
   std::wstring Name;
@@ -13,8 +29,16 @@ struct FileResult {
   uint64_t Size;
   uint64_t LastWriteTime;
   bool IsDirectory;
+  // Position of Name in its volume's NameOrder: results from one volume sort
+  // by name by comparing these. NoNameRank without an order, or unless
+  // SearchOptions::rankNames asked for it.
+  uint32_t NameRank;
 };
 
+// Receives search results in batches while the search runs. The callback may
+// move the results out of the batch; returning false stops the search.
+typedef std::function<bool(std::vector<FileResult> &batch)> ResultCallback;
+
 enum MatchMode {
   MatchMode_Substring = 0,
   MatchMode_Exact,
@@ -22,6 +46,14 @@ enum MatchMode {
   MatchMode_RegEx
 };
 
+// Which timestamp the date filter reads.
+enum DateField {
+  DateField_Modified = 0, // Last write
+  DateField_Created,
+  DateField_Accessed,
+  DateField_Changed // NTFS metadata change
+};
+
 struct SearchOptions {
   MatchMode mode;
   bool ignoreCase;
@@ -31,6 +63,9 @@ struct SearchOptions {
   uint64_t maxSize;
   uint64_t minDate; // FILETIME as uint64
   uint64_t maxDate; // FILETIME as uint64
+  DateField dateField;
+  uint32_t requiredAttributes; // FILE_ATTRIBUTE_* bits all set
+  uint32_t excludedAttributes; // FILE_ATTRIBUTE_* bits all clear
 
   bool includeFiles;
   bool includeFolders;
@@ -40,13 +75,49 @@ struct SearchOptions {
   std::wstring excludePattern; // e.g. "temp;cache"
   bool invertMatch;
 
+  // Fill FileResult::NameRank from the volume's name order, which first
+  // catches up with any change to the volume. Only worth it when the
+  // results are about to be sorted by name.
+  bool rankNames;
+
   SearchOptions()
       : mode(MatchMode_Substring), ignoreCase(true), minSize(0), maxSize(0),
-        minDate(0), maxDate(0), includeFiles(true), includeFolders(true),
-        extensionFilter(L""), matchFullPath(false), excludePattern(L""),
-        invertMatch(false) {}
+        minDate(0), maxDate(0), dateField(DateField_Modified),
+        requiredAttributes(0), excludedAttributes(0), includeFiles(true),
+        includeFolders(true), extensionFilter(L""), matchFullPath(false),
+        excludePattern(L""), invertMatch(false), rankNames(false) {}
 };
 
+// Volume state an index was built from. Unchanged stamps mean the index is
+// still current.
+struct NtfsChangeStamp {
+  uint64_t mftLsn;     // LSN of $MFT record 0
+  uint64_t journalId;  // USN journal id, 0 if the journal is inactive
+  uint64_t journalUsn; // Next USN of the journal
+
+  NtfsChangeStamp() : mftLsn(0), journalId(0), journalUsn(0) {}
+  bool operator==(const NtfsChangeStamp &o) const {
+    return mftLsn == o.mftLsn && journalId == o.journalId &&
+           journalUsn == o.journalUsn;
+  }
+  bool operator!=(const NtfsChangeStamp &o) const { return !(*this == o); }
+};
+
+// Record counts from the last Scan().
+struct NtfsScanStats {
+  uint64_t recordsRead;
+  uint64_t recordsInUse;
+  uint64_t tornRecords;    // Update sequence mismatch from an interrupted write
+  uint64_t corruptRecords; // Invalid update sequence array or "BAAD" record
+
+  NtfsScanStats()
+      : recordsRead(0), recordsInUse(0), tornRecords(0), corruptRecords(0) {}
+};
+
+// $MFT read-ahead used by Scan() unless SetReadAhead() says otherwise.
+const uint32_t DefaultScanChunkSize = 1024 * 1024;
+const uint32_t DefaultScanQueueDepth = 4;
+
 class MFTReader {
 public:
   MFTReader();
@@ -54,33 +125,115 @@ public:
 
   bool Initialize(TCHAR driveLetter);
   void Close();
+  // Closes the volume handle but keeps the scanned index searchable.
+  void ReleaseVolume();
+  // Reopens the volume handle of the current drive, keeping the index.
+  bool ReopenVolume();
   bool Scan(void (*progressCallback)(int, int, void *), void *userData,
             std::function<void(const std::wstring &)> onFileFound = nullptr);
   void SetTraceCallback(std::function<void(const std::wstring &)> callback) {
     traceCallback = callback;
   }
+  // Chunk size in bytes (rounded to whole records and clusters) and number
+  // of reads kept in flight while Scan() parses; 0 selects the default.
+  void SetReadAhead(uint32_t chunkBytes, uint32_t depth);
+  // Threads decoding records during Scan(); 0 = one per logical processor,
+  // 1 = parse on the scan thread. The index is the same either way.
+  void SetParseThreads(unsigned threads);
+  // Index named $DATA streams (ADS) as "file:stream" entries with their own
+  // sizes on the next Scan(). Off by default.
+  void SetIndexStreams(bool enable) { indexStreams = enable; }
+  bool IndexesStreams() const { return indexStreams; }
+  // Scan() and Search() give up soon after `token` is raised: a scan fails
+  // with ERROR_CANCELLED, a search stops early. nullptr never cancels.
+  void SetCancelToken(const CancelToken *token) { cancelToken = token; }
   std::vector<FileResult> Search(const std::wstring &query,
                                  const std::wstring &targetFolder,
                                  const SearchOptions &options = SearchOptions(),
                                  int maxResults = -1);
+  // Entries under any of `targetFolders`, each matched once.
+  std::vector<FileResult> Search(const std::wstring &query,
+                                 const std::vector<std::wstring> &targetFolders,
+                                 const SearchOptions &options = SearchOptions(),
+                                 int maxResults = -1);
+  // Streams the matches to `onResults` in batches as they are found instead
+  // of collecting them; returns how many were delivered.
+  size_t Search(const std::wstring &query,
+                const std::vector<std::wstring> &targetFolders,
+                const SearchOptions &options, int maxResults,
+                const ResultCallback &onResults);
+  // Disk usage below `folder` (the volume when empty): the folder's own
+  // totals, then its `count` largest directories by allocated size.
+  std::vector<DirectoryUsage> DiskUsage(const std::wstring &folder,
+                                        size_t count);
   std::wstring GetLastErrorMessage() const;
 
+  bool QueryChangeStamp(NtfsChangeStamp &stamp);
+  const NtfsChangeStamp &GetScanStamp() const { return scanStamp; }
+  const NtfsScanStats &GetScanStats() const { return scanStats; }
+
+  void ExportSnapshot(SnapshotBuilder &builder) const;
+  bool ImportSnapshot(const SnapshotView &view, TCHAR driveLetter);
+
+  const EntryStore &GetEntries() const { return entries; }
+
+  // Keeps a copy of every name folded through the volume's $UpCase table so
+  // case-insensitive searches skip per-character folding. Costs 2 bytes per
+  // name character; off by default. Applies to the loaded index at once.
+  void SetFoldNames(bool enable);
+  // Answers substring queries from a trigram index over the names instead of
+  // matching every name. Built on the first search it serves and rebuilt
+  // after the index changed; off by default. Disabling frees it.
+  void SetTrigramIndex(bool enable);
+  // The trigram index, null unless enabled.
+  const NameTrigrams *GetTrigrams() const { return trigrams.get(); }
+  // Answers substring, space-divided and exact name queries from a suffix
+  // array over the names, whatever their length. Built on the first search
+  // it serves and patched through a small delta after the index changed;
+  // off by default. Disabling frees it.
+  void SetSuffixIndex(bool enable);
+  // The suffix array, null unless enabled.
+  const NameSuffixArray *GetSuffixes() const { return suffixes.get(); }
+  // Keeps every name in sorted order, so exact and prefix ("readme*")
+  // queries are a binary search and results carry a NameRank to sort by.
+  // Built on the first search and merged with later changes. Disabling
+  // frees it.
+  void SetNameOrder(bool enable);
+  // The name order, null unless enabled.
+  const NameOrder *GetNameOrder() const { return names.get(); }
+
+  // Brings the index up to date from the USN journal instead of rescanning.
+  // Fails when the journal no longer covers everything since the scan
+  // (inactive, recreated or wrapped) or a change could not be applied
+  // without losing names; the caller must rescan then.
+  bool UpdateFromJournal(size_t *changesApplied = nullptr);
+  // Applies coalesced journal changes. Created and modified files are re-read
+  // from the MFT while the volume is open, otherwise the journal's name is
+  // used. False when a renamed file with several names could not be re-read;
+  // the index must be rescanned then.
+  bool ApplyChanges(const std::vector<UsnFileChange> &changes);
+
 private:
   std::wstring lastError;
   void SetError(const std::wstring &msg);
-  struct Entry {
-    uint64_t RefID;
-    uint64_t ParentRefID;
-    std::wstring Name;
-    uint64_t Size;
-    uint64_t LastWriteTime;
-    bool IsDirectory;
-    bool IsValid;
-  };
 
   HANDLE hVolume;
   TCHAR currentDrive;
-  std::unordered_map<uint64_t, Entry> fileMap;
+  EntryStore entries; // Indexed by MFT record number
+  PathCache paths;
+  DirectoryTree tree; // Built on the first folder-filtered search
+  DirectoryTotals totals; // Built on the first DiskUsage()
+  std::unique_ptr<SearchHistory> history; // The last search, for narrowing
+  std::unique_ptr<NameTrigrams> trigrams; // Null unless enabled
+  std::unique_ptr<NameSuffixArray> suffixes; // Null unless enabled
+  std::unique_ptr<NameOrder> names; // Null unless enabled
+  bool foldNames;
+  std::vector<uint16_t> upcase; // $UpCase, read on first use
+  uint32_t chunkSize;  // Scan read-ahead
+  uint32_t queueDepth;
+  unsigned parseThreads;
+  bool indexStreams;
+  const CancelToken *cancelToken;
   std::function<void(const std::wstring &)> scanDebugCallback; // For -v (files)
   std::function<void(const std::wstring &)> traceCallback; // For -t (stages)
 
@@ -91,9 +244,99 @@ private:
   uint32_t bytesPerCluster;
   uint32_t recordSize;
 
+  NtfsChangeStamp scanStamp;
+  NtfsScanStats scanStats;
+
+  bool OpenVolume();
+  bool ReadMftBaseRecord(std::vector<uint8_t> &buffer);
+
+  // One further $FILE_NAME of a record. Rank orders the namespaces for the
+  // name shown: Win32 2, POSIX 1, DOS-only 0.
+  struct NameRef {
+    uint32_t parent;
+    const wchar_t *name; // Points into the record
+    size_t nameLength;
+    uint8_t rank;
+  };
+  // One named $DATA attribute
+  struct StreamRef {
+    const wchar_t *name; // Points into the record
+    size_t nameLength;
+    uint64_t size;
+  };
+  // Fields of one in-use record, as stored in the index
+  struct ParsedRecord {
+    uint32_t id; // Base record number, also for extension records
+    bool isExtension;
+    bool hasAttributeList;
+    bool hasName;
+    uint8_t nameRank;
+    uint32_t parent;
+    const wchar_t *name; // Points into the record
+    size_t nameLength;
+    std::vector<NameRef> links; // Other hard links, no DOS-only names
+    std::vector<StreamRef> streams; // Only when indexing streams
+    bool hasDataSize; // Else `size` is the copy in $FILE_NAME
+    uint64_t size;
+    uint64_t allocatedSize; // Non-resident $DATA and index pieces here
+    uint64_t lastWriteTime;
+    EntryTimes times;
+    uint32_t attributes;
+    bool isDirectory;
+  };
+  struct SplitName {
+    uint32_t parent;
+    std::wstring name;
+    uint8_t rank;
+  };
+  struct SplitStream {
+    std::wstring name;
+    uint64_t size;
+  };
+  // A base record with an $ATTRIBUTE_LIST and what its extension records
+  // hold, merged into the index once every record has been seen
+  struct SplitRecord {
+    bool baseSeen;
+    bool baseHasDataSize;
+    uint64_t baseSize;
+    uint64_t allocatedSize; // Base and extension records together
+    uint64_t lastWriteTime;
+    EntryTimes times;
+    uint32_t attributes;
+    bool isDirectory;
+    std::vector<SplitName> baseNames; // Shown name first, if any
+    std::vector<SplitName> names;     // From the extension records
+    std::vector<SplitStream> baseStreams;
+    std::vector<SplitStream> streams; // From the extension records
+    uint64_t nameSize;
+    bool hasDataSize;
+    uint64_t dataSize;
+
+    SplitRecord()
+        : baseSeen(false), baseHasDataSize(false), baseSize(0),
+          allocatedSize(0), lastWriteTime(0), attributes(0),
+          isDirectory(false), nameSize(0), hasDataSize(false), dataSize(0) {}
+  };
+  std::map<uint32_t, SplitRecord> splitRecords; // By base record
+  struct RecordBatch;
+
   void ProcessBuffer(const uint8_t *buffer, size_t size);
   void ParseRecord(const FILE_RECORD_HEADER *record);
-  std::wstring BuildPath(uint64_t refId);
-  bool MatchPattern(const std::wstring &str, const std::wstring &pattern,
-                    const SearchOptions &options);
+  static bool DecodeRecord(const FILE_RECORD_HEADER *header,
+                           uint32_t recordSize, bool withStreams,
+                           ParsedRecord &out);
+  static void DecodeBatch(RecordBatch &batch, uint32_t recordSize,
+                          bool withStreams);
+  void MergeBatch(const RecordBatch &batch);
+  void StoreRecord(const ParsedRecord &record);
+  static void KeepNames(const ParsedRecord &record,
+                        std::vector<SplitName> &names);
+  static void KeepStreams(const ParsedRecord &record,
+                          std::vector<SplitStream> &streams);
+  void StitchExtensions();
+  bool FetchRecord(uint64_t refId, std::vector<uint8_t> &output,
+                   const FILE_RECORD_HEADER *&record);
+  bool RefreshRecord(uint64_t refId);
+  bool ReadUpcaseTable(std::vector<uint16_t> &table);
+  void ApplyFolding();
 };
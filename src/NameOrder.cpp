@@ -0,0 +1,241 @@
+#include "NameOrder.h"
+#include "PreparedQuery.h"
+#include <algorithm>
+
+// Kinds as in SearchCandidate
+static const uint32_t Kind_Own = 0;
+static const uint32_t Kind_Link = 1;
+static const uint32_t Kind_Stream = 2;
+
+// A slot with its name's text: pre-folded when the store keeps folded names,
+// as stored otherwise.
+struct NameOrder::Named {
+  Slot slot;
+  const wchar_t *text;
+  size_t length;
+};
+
+struct NameOrder::NameLess {
+  bool foldEach; // Text is not pre-folded
+
+  uint16_t Key(wchar_t c) const {
+    return foldEach ? PreparedQuery::FoldUnit(nullptr, c) : (uint16_t)c;
+  }
+  bool operator()(const Named &a, const Named &b) const {
+    size_t common = (std::min)(a.length, b.length);
+    for (size_t i = 0; i < common; i++) {
+      uint16_t x = Key(a.text[i]), y = Key(b.text[i]);
+      if (x != y)
+        return x < y;
+    }
+    if (a.length != b.length)
+      return a.length < b.length;
+    if (a.slot.id != b.slot.id)
+      return a.slot.id < b.slot.id;
+    return a.slot.name < b.slot.name;
+  }
+};
+
+NameOrder::NameOrder() : foldedWithTable(false), generation(0), built(false) {}
+
+void NameOrder::Clear() {
+  std::vector<Slot>().swap(slots);
+  std::vector<uint32_t>().swap(ownRanks);
+  std::unordered_map<uint64_t, uint32_t>().swap(otherRanks);
+  built = false;
+}
+
+size_t NameOrder::MemoryUsage() const {
+  return slots.capacity() * sizeof(Slot) +
+         ownRanks.capacity() * sizeof(uint32_t) +
+         otherRanks.size() * (sizeof(uint64_t) + sizeof(uint32_t) +
+                              2 * sizeof(void *));
+}
+
+static uint64_t RankKey(uint32_t id, uint32_t name) {
+  return ((uint64_t)id << 32) | name;
+}
+
+NameOrder::Named NameOrder::Resolve(const EntryStore &store, Slot slot) {
+  bool folded = store.HasFoldedNames();
+  uint32_t kind = slot.name >> KindShift;
+  uint32_t position = slot.name & ((1u << KindShift) - 1);
+  Named named;
+  named.slot = slot;
+  if (kind == Kind_Link) {
+    uint32_t link = store.FirstLink(slot.id);
+    for (; position > 0; position--)
+      link = store.NextLink(link);
+    named.text = folded ? store.FoldedLinkName(link) : store.LinkName(link);
+    named.length = store.LinkNameLength(link);
+  } else if (kind == Kind_Stream) {
+    uint32_t stream = store.FirstStream(slot.id);
+    for (; position > 0; position--)
+      stream = store.NextStream(stream);
+    named.text =
+        folded ? store.FoldedStreamName(stream) : store.StreamName(stream);
+    named.length = store.StreamNameLength(stream);
+  } else {
+    named.text = folded ? store.FoldedName(slot.id) : store.Name(slot.id);
+    named.length = store.NameLength(slot.id);
+  }
+  return named;
+}
+
+void NameOrder::AddNames(const EntryStore &store, uint32_t id,
+                         std::vector<Named> &out) {
+  Slot slot;
+  slot.id = id;
+  slot.name = Kind_Own << KindShift;
+  out.push_back(Resolve(store, slot));
+  uint32_t position = 0;
+  for (uint32_t link = store.FirstLink(id); link != EntryStore::NoLink;
+       link = store.NextLink(link)) {
+    slot.name = (Kind_Link << KindShift) | position++;
+    out.push_back(Resolve(store, slot));
+  }
+  position = 0;
+  for (uint32_t stream = store.FirstStream(id);
+       stream != EntryStore::NoStream; stream = store.NextStream(stream)) {
+    slot.name = (Kind_Stream << KindShift) | position++;
+    out.push_back(Resolve(store, slot));
+  }
+}
+
+// Takes `named` as the new order and indexes the ranks.
+void NameOrder::Finish(const EntryStore &store,
+                       const std::vector<Named> &named) {
+  slots.resize(named.size());
+  ownRanks.assign(store.IdLimit(), NoNameRank);
+  otherRanks.clear();
+  for (uint32_t rank = 0; rank < (uint32_t)named.size(); rank++) {
+    Slot slot = named[rank].slot;
+    slots[rank] = slot;
+    if (slot.name >> KindShift == Kind_Own)
+      ownRanks[slot.id] = rank;
+    else
+      otherRanks[RankKey(slot.id, slot.name)] = rank;
+  }
+  foldedWithTable = store.FoldTable() != nullptr;
+  generation = store.Generation();
+  built = true;
+}
+
+void NameOrder::Build(const EntryStore &store) {
+  std::vector<Named> named;
+  named.reserve(store.Count() + store.LinkCount() + store.StreamCount());
+  for (uint32_t id = 0; id < store.IdLimit(); id++) {
+    if (store.IsValid(id))
+      AddNames(store, id, named);
+  }
+  NameLess less = {store.FoldTable() == nullptr};
+  std::sort(named.begin(), named.end(), less);
+  Finish(store, named);
+}
+
+void NameOrder::Update(const EntryStore &store) {
+  if (IsCurrent(store))
+    return;
+  std::vector<uint32_t> changed;
+  if (!built || foldedWithTable != (store.FoldTable() != nullptr) ||
+      !store.ChangedSince(generation, changed)) {
+    Build(store);
+    return;
+  }
+
+  // Names of unchanged entries keep their order; the changed entries'
+  // current names are sorted apart and merged in
+  std::vector<uint8_t> isChanged(store.IdLimit(), 0);
+  std::vector<Named> fresh;
+  for (uint32_t id : changed) {
+    if (isChanged[id])
+      continue;
+    isChanged[id] = 1;
+    if (store.IsValid(id))
+      AddNames(store, id, fresh);
+  }
+  std::vector<Named> kept;
+  kept.reserve(slots.size());
+  for (Slot slot : slots) {
+    if (!isChanged[slot.id])
+      kept.push_back(Resolve(store, slot));
+  }
+  NameLess less = {store.FoldTable() == nullptr};
+  std::sort(fresh.begin(), fresh.end(), less);
+  std::vector<Named> named(kept.size() + fresh.size());
+  std::merge(kept.begin(), kept.end(), fresh.begin(), fresh.end(),
+             named.begin(), less);
+  Finish(store, named);
+}
+
+bool NameOrder::Covers(const std::wstring &query,
+                       const SearchOptions &options) {
+  if (options.mode != MatchMode_Exact || options.invertMatch ||
+      options.matchFullPath)
+    return false;
+  return !PreparedQuery::Terms(query, options).empty();
+}
+
+std::vector<uint32_t>
+NameOrder::Candidates(const EntryStore &store, const std::wstring &query,
+                      const SearchOptions &options) const {
+  bool prefix = PreparedQuery::IsPrefix(query, options);
+  const uint16_t *foldTable = store.FoldTable();
+  std::vector<uint16_t> term;
+  for (const auto &text : PreparedQuery::Terms(query, options)) {
+    for (wchar_t c : text)
+      term.push_back(PreparedQuery::FoldUnit(foldTable, c));
+  }
+
+  // <0, 0 or >0 as the slot's name sorts before, matches or sorts after
+  // the term
+  NameLess less = {foldTable == nullptr};
+  auto compare = [&](Slot slot) {
+    Named named = Resolve(store, slot);
+    size_t common = (std::min)(named.length, term.size());
+    for (size_t i = 0; i < common; i++) {
+      uint16_t c = less.Key(named.text[i]);
+      if (c != term[i])
+        return c < term[i] ? -1 : 1;
+    }
+    if (named.length < term.size())
+      return -1;
+    return prefix || named.length == term.size() ? 0 : 1;
+  };
+  auto first = std::partition_point(
+      slots.begin(), slots.end(), [&](Slot slot) { return compare(slot) < 0; });
+  auto last = std::partition_point(
+      first, slots.end(), [&](Slot slot) { return compare(slot) == 0; });
+
+  std::vector<uint32_t> ids;
+  ids.reserve(last - first);
+  for (auto it = first; it != last; ++it)
+    ids.push_back(it->id);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+uint32_t NameOrder::Rank(const EntryStore &store, uint32_t id, uint32_t kind,
+                         uint32_t item) const {
+  if (kind == Kind_Own)
+    return id < ownRanks.size() ? ownRanks[id] : NoNameRank;
+  uint32_t position = 0;
+  if (kind == Kind_Link) {
+    for (uint32_t link = store.FirstLink(id); link != item;
+         link = store.NextLink(link)) {
+      if (link == EntryStore::NoLink)
+        return NoNameRank;
+      position++;
+    }
+  } else {
+    for (uint32_t stream = store.FirstStream(id); stream != item;
+         stream = store.NextStream(stream)) {
+      if (stream == EntryStore::NoStream)
+        return NoNameRank;
+      position++;
+    }
+  }
+  auto it = otherRanks.find(RankKey(id, (kind << KindShift) | position));
+  return it != otherRanks.end() ? it->second : NoNameRank;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "EntryStore.h"
+#include "MFTReader.h" // For SearchOptions and NoNameRank
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Every name in an EntryStore (own, further hard links, streams) sorted
+// case-folded, so an exact or prefix ("readme*") name query is a binary
+// search and results sort by name by comparing two ranks.
+//
+// Names are folded the way the search compares them: through the store's
+// fold table when it has one, with towlower() otherwise. Equal folded names
+// order by entry id. A slot names an entry and which of its names is meant
+// (kind and position in the entry's list) rather than a list item, so it
+// stays valid when the store compacts its names.
+//
+// Costs 8 bytes per name for the order and 4 per id for the ranks of own
+// names. After the store changed, the changed entries' names are taken out,
+// sorted on their own and merged back in one pass; it is sorted whole only
+// when the store's change log no longer reaches back.
+class NameOrder {
+public:
+  NameOrder();
+
+  void Build(const EntryStore &store);
+  // Merges in what changed in the store since, or rebuilds.
+  void Update(const EntryStore &store);
+  bool IsCurrent(const EntryStore &store) const {
+    return built && generation == store.Generation() &&
+           foldedWithTable == (store.FoldTable() != nullptr);
+  }
+  void Clear();
+
+  // Whether Candidates() can answer `query` under `options`: a non-inverted
+  // exact name query, where a trailing '*' asks for names starting with the
+  // rest.
+  static bool Covers(const std::wstring &query, const SearchOptions &options);
+  // Ascending ids of the entries with a folded name equal to the query, or
+  // starting with it: a superset of the matches, which the search still
+  // verifies. Only for queries Covers() accepts, and only while
+  // IsCurrent(store).
+  std::vector<uint32_t> Candidates(const EntryStore &store,
+                                   const std::wstring &query,
+                                   const SearchOptions &options) const;
+
+  // Position of a name in the order, `kind` and `item` as in
+  // SearchCandidate; NoNameRank for a name not in it. Only while
+  // IsCurrent(store).
+  uint32_t Rank(const EntryStore &store, uint32_t id, uint32_t kind,
+                uint32_t item) const;
+
+  size_t NameCount() const { return slots.size(); }
+  // Bytes held by the order and the ranks.
+  size_t MemoryUsage() const;
+
+private:
+  static constexpr int KindShift = 30; // Slot::name is kind, then position
+
+  struct Slot {
+    uint32_t id;
+    uint32_t name;
+  };
+  struct Named;
+  struct NameLess;
+
+  std::vector<Slot> slots;         // In name order
+  std::vector<uint32_t> ownRanks;  // By id
+  std::unordered_map<uint64_t, uint32_t> otherRanks; // By id and Slot::name
+  bool foldedWithTable;            // Else towlower()
+  uint64_t generation;
+  bool built;
+
+  static Named Resolve(const EntryStore &store, Slot slot);
+  static void AddNames(const EntryStore &store, uint32_t id,
+                       std::vector<Named> &out);
+  void Finish(const EntryStore &store, const std::vector<Named> &named);
+};
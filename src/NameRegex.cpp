@@ -0,0 +1,845 @@
+#include "NameRegex.h"
+#include <algorithm>
+#include <cwctype>
+
+// Compile() gives up past these and the caller falls back to std::wregex
+static const int MaxNfaNodes = 20000;
+static const int MaxRepeat = 1000;
+static const int MaxNesting = 200;
+// The DFA cache is flushed and rebuilt from the current state beyond these
+static const size_t MaxDfaStates = 4096;
+static const size_t MaxTransitions = 4 * 1024 * 1024;
+
+static const uint32_t CodeUnits = 0x10000;
+
+static const uint16_t *FoldTable() {
+  static const std::vector<uint16_t> table = [] {
+    std::vector<uint16_t> t(CodeUnits);
+    for (uint32_t u = 0; u < CodeUnits; u++) {
+      wint_t lower = towlower((wint_t)u);
+      t[u] = lower < CodeUnits ? (uint16_t)lower : (uint16_t)u;
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+namespace {
+
+struct CharSet {
+  std::vector<std::pair<uint16_t, uint16_t>> ranges;
+  bool negated;
+
+  CharSet() : negated(false) {}
+  void Add(uint32_t lo, uint32_t hi) {
+    if (lo < CodeUnits)
+      ranges.push_back(std::make_pair((uint16_t)lo,
+                                      (uint16_t)(std::min)(hi, CodeUnits - 1)));
+  }
+  // Adds the complement of `other` (which must not be negated)
+  void AddComplement(const CharSet &other) {
+    std::vector<std::pair<uint16_t, uint16_t>> sorted = other.ranges;
+    std::sort(sorted.begin(), sorted.end());
+    uint32_t next = 0;
+    for (const auto &r : sorted) {
+      if (r.first > next)
+        Add(next, r.first - 1);
+      next = (std::max)(next, (uint32_t)r.second + 1);
+    }
+    if (next < CodeUnits)
+      Add(next, CodeUnits - 1);
+  }
+  bool InRanges(uint32_t u) const {
+    for (const auto &r : ranges) {
+      if (u >= r.first && u <= r.second)
+        return true;
+    }
+    return false;
+  }
+  bool IsSingle() const {
+    return !negated && ranges.size() == 1 &&
+           ranges[0].first == ranges[0].second;
+  }
+  bool operator==(const CharSet &o) const {
+    return negated == o.negated && ranges == o.ranges;
+  }
+};
+
+enum AstKind {
+  Ast_Empty = 0,
+  Ast_Set,
+  Ast_Concat,
+  Ast_Alt,
+  Ast_Repeat,
+  Ast_LineStart,
+  Ast_LineEnd
+};
+
+struct AstNode {
+  AstKind kind;
+  int set;
+  int min;
+  int max; // -1 = unbounded
+  std::vector<int> children;
+};
+
+} // namespace
+
+// Parses the pattern to a syntax tree and compiles that to the NFA.
+class NameRegexCompiler {
+public:
+  NameRegexCompiler(NameRegex &re, const std::wstring &pattern)
+      : re(re), p(pattern), pos(0), depth(0), tooLarge(false) {}
+
+  bool Compile() {
+    int root;
+    if (!ParseAlt(root) || pos != p.length())
+      return false;
+    AnalyzeLiterals(root);
+    if (re.isLiteral)
+      return true;
+
+    Fragment f = Build(root);
+    int match = Emit(NameRegex::Nfa_Match);
+    Patch(f.outs, match);
+    if (tooLarge)
+      return false;
+    re.nfaStart = f.start;
+    BuildClasses();
+    return true;
+  }
+
+private:
+  NameRegex &re;
+  const std::wstring &p;
+  size_t pos;
+  int depth;
+  bool tooLarge;
+  std::vector<AstNode> ast;
+  std::vector<CharSet> sets;
+
+  // Parsing
+
+  int NewNode(AstKind kind) {
+    AstNode n;
+    n.kind = kind;
+    n.set = -1;
+    n.min = n.max = 0;
+    ast.push_back(n);
+    return (int)ast.size() - 1;
+  }
+  int NewSetNode(const CharSet &set) {
+    int n = NewNode(Ast_Set);
+    // Literal patterns repeat sets; share them
+    for (size_t i = 0; i < sets.size(); i++) {
+      if (sets[i] == set) {
+        ast[n].set = (int)i;
+        return n;
+      }
+    }
+    sets.push_back(set);
+    ast[n].set = (int)sets.size() - 1;
+    return n;
+  }
+  bool More() const { return pos < p.length(); }
+  static bool IsQuantifier(wchar_t c) {
+    return c == L'*' || c == L'+' || c == L'?' || c == L'{';
+  }
+
+  bool ParseAlt(int &out) {
+    if (++depth > MaxNesting)
+      return false;
+    std::vector<int> branches;
+    int branch;
+    if (!ParseConcat(branch))
+      return false;
+    branches.push_back(branch);
+    while (More() && p[pos] == L'|') {
+      pos++;
+      if (!ParseConcat(branch))
+        return false;
+      branches.push_back(branch);
+    }
+    depth--;
+    if (branches.size() == 1) {
+      out = branches[0];
+    } else {
+      out = NewNode(Ast_Alt);
+      ast[out].children = branches;
+    }
+    return true;
+  }
+
+  bool ParseConcat(int &out) {
+    std::vector<int> items;
+    while (More() && p[pos] != L'|' && p[pos] != L')') {
+      int item;
+      if (!ParseRepeat(item))
+        return false;
+      items.push_back(item);
+    }
+    if (items.empty()) {
+      out = NewNode(Ast_Empty);
+    } else if (items.size() == 1) {
+      out = items[0];
+    } else {
+      out = NewNode(Ast_Concat);
+      ast[out].children = items;
+    }
+    return true;
+  }
+
+  bool ParseNumber(int &value) {
+    size_t start = pos;
+    value = 0;
+    while (More() && p[pos] >= L'0' && p[pos] <= L'9') {
+      if (value > MaxRepeat)
+        return false;
+      value = value * 10 + (p[pos++] - L'0');
+    }
+    return pos > start;
+  }
+
+  bool ParseRepeat(int &out) {
+    int atom;
+    if (!ParseAtom(atom))
+      return false;
+    out = atom;
+    if (!More() || !IsQuantifier(p[pos]))
+      return true;
+    if (ast[atom].kind == Ast_LineStart || ast[atom].kind == Ast_LineEnd)
+      return false;
+
+    int min, max;
+    wchar_t q = p[pos++];
+    if (q == L'*') {
+      min = 0;
+      max = -1;
+    } else if (q == L'+') {
+      min = 1;
+      max = -1;
+    } else if (q == L'?') {
+      min = 0;
+      max = 1;
+    } else {
+      if (!ParseNumber(min))
+        return false;
+      max = min;
+      if (More() && p[pos] == L',') {
+        pos++;
+        max = -1;
+        if (More() && p[pos] != L'}' && !ParseNumber(max))
+          return false;
+      }
+      if (!More() || p[pos] != L'}')
+        return false;
+      pos++;
+    }
+    if (More() && p[pos] == L'?')
+      pos++; // Lazy; whether a name matches does not depend on it
+    if (More() && IsQuantifier(p[pos]))
+      return false;
+    if (min > MaxRepeat || max > MaxRepeat || (max >= 0 && max < min))
+      return false;
+
+    out = NewNode(Ast_Repeat);
+    ast[out].min = min;
+    ast[out].max = max;
+    ast[out].children.push_back(atom);
+    return true;
+  }
+
+  bool ParseAtom(int &out) {
+    wchar_t c = p[pos++];
+    switch (c) {
+    case L'(': {
+      if (More() && p[pos] == L'?') {
+        if (pos + 1 < p.length() && p[pos + 1] == L':')
+          pos += 2;
+        else
+          return false; // Lookaround or named groups
+      }
+      if (!ParseAlt(out))
+        return false;
+      if (!More() || p[pos] != L')')
+        return false;
+      pos++;
+      return true;
+    }
+    case L'[':
+      return ParseClass(out);
+    case L'.': {
+      CharSet set;
+      set.negated = true;
+      set.Add(L'\n', L'\n');
+      set.Add(L'\r', L'\r');
+      set.Add(0x2028, 0x2029);
+      out = NewSetNode(set);
+      return true;
+    }
+    case L'^':
+      out = NewNode(Ast_LineStart);
+      return true;
+    case L'$':
+      out = NewNode(Ast_LineEnd);
+      return true;
+    case L'\\': {
+      CharSet set;
+      int ch;
+      if (!ParseEscape(set, ch, false))
+        return false;
+      if (ch >= 0)
+        set.Add(ch, ch);
+      out = NewSetNode(set);
+      return true;
+    }
+    case L'*':
+    case L'+':
+    case L'?':
+    case L'{':
+    case L'}':
+    case L']':
+      return false;
+    default: {
+      CharSet set;
+      set.Add(c, c);
+      out = NewSetNode(set);
+      return true;
+    }
+    }
+  }
+
+  static int HexValue(wchar_t c) {
+    if (c >= L'0' && c <= L'9')
+      return c - L'0';
+    if (c >= L'a' && c <= L'f')
+      return c - L'a' + 10;
+    if (c >= L'A' && c <= L'F')
+      return c - L'A' + 10;
+    return -1;
+  }
+
+  bool ParseHex(int digits, int &value) {
+    value = 0;
+    for (int i = 0; i < digits; i++) {
+      if (!More() || HexValue(p[pos]) < 0)
+        return false;
+      value = value * 16 + HexValue(p[pos++]);
+    }
+    return true;
+  }
+
+  static void AddClassEscape(CharSet &set, wchar_t kind) {
+    CharSet base;
+    switch (towlower(kind)) {
+    case L'd':
+      base.Add(L'0', L'9');
+      break;
+    case L'w':
+      base.Add(L'0', L'9');
+      base.Add(L'A', L'Z');
+      base.Add(L'_', L'_');
+      base.Add(L'a', L'z');
+      break;
+    default: // s
+      base.Add(L'\t', L'\r');
+      base.Add(L' ', L' ');
+      base.Add(0xA0, 0xA0);
+      base.Add(0x1680, 0x1680);
+      base.Add(0x2000, 0x200A);
+      base.Add(0x2028, 0x2029);
+      base.Add(0x202F, 0x202F);
+      base.Add(0x205F, 0x205F);
+      base.Add(0x3000, 0x3000);
+      base.Add(0xFEFF, 0xFEFF);
+      break;
+    }
+    if (iswupper(kind))
+      set.AddComplement(base);
+    else
+      set.ranges.insert(set.ranges.end(), base.ranges.begin(),
+                        base.ranges.end());
+  }
+
+  // A single character goes to `ch`; class escapes are added to `set` and
+  // leave `ch` at -1.
+  bool ParseEscape(CharSet &set, int &ch, bool inClass) {
+    if (!More())
+      return false;
+    wchar_t c = p[pos++];
+    ch = -1;
+    switch (c) {
+    case L'd':
+    case L'D':
+    case L'w':
+    case L'W':
+    case L's':
+    case L'S':
+      AddClassEscape(set, c);
+      return true;
+    case L't':
+      ch = L'\t';
+      return true;
+    case L'n':
+      ch = L'\n';
+      return true;
+    case L'r':
+      ch = L'\r';
+      return true;
+    case L'f':
+      ch = L'\f';
+      return true;
+    case L'v':
+      ch = L'\v';
+      return true;
+    case L'0':
+      if (More() && p[pos] >= L'0' && p[pos] <= L'9')
+        return false;
+      ch = 0;
+      return true;
+    case L'x':
+      return ParseHex(2, ch);
+    case L'u':
+      return ParseHex(4, ch);
+    case L'b':
+      if (!inClass)
+        return false; // Word boundary
+      ch = 8;
+      return true;
+    default:
+      // Backreferences, \B, \c, \k, \p and unknown letters are left to
+      // std::wregex
+      if (iswalnum(c))
+        return false;
+      ch = c;
+      return true;
+    }
+  }
+
+  bool ParseClassAtom(CharSet &set, int &ch) {
+    if (!More())
+      return false;
+    wchar_t c = p[pos++];
+    if (c == L'\\')
+      return ParseEscape(set, ch, true);
+    ch = c;
+    return true;
+  }
+
+  bool ParseClass(int &out) {
+    CharSet set;
+    if (More() && p[pos] == L'^') {
+      set.negated = true;
+      pos++;
+    }
+    for (;;) {
+      if (!More())
+        return false;
+      if (p[pos] == L']') {
+        pos++;
+        break;
+      }
+      int lo;
+      if (!ParseClassAtom(set, lo))
+        return false;
+      if (More() && p[pos] == L'-' && pos + 1 < p.length() &&
+          p[pos + 1] != L']') {
+        pos++;
+        int hi;
+        if (!ParseClassAtom(set, hi) || lo < 0 || hi < 0 || hi < lo)
+          return false;
+        set.Add(lo, hi);
+      } else if (lo >= 0) {
+        set.Add(lo, lo);
+      }
+    }
+    out = NewSetNode(set);
+    return true;
+  }
+
+  // Literals
+
+  bool IsLiteralChar(int node) const {
+    return ast[node].kind == Ast_Set && sets[ast[node].set].IsSingle();
+  }
+  wchar_t LiteralChar(int node) const {
+    wchar_t c = (wchar_t)sets[ast[node].set].ranges[0].first;
+    return re.ignoreCase ? (wchar_t)re.fold[(uint16_t)c] : c;
+  }
+
+  void AnalyzeLiterals(int root) {
+    std::vector<int> items;
+    if (ast[root].kind == Ast_Concat)
+      items = ast[root].children;
+    else if (ast[root].kind != Ast_Empty)
+      items.push_back(root);
+
+    size_t first = 0, last = items.size();
+    bool start = false, end = false;
+    if (first < last && ast[items[first]].kind == Ast_LineStart) {
+      start = true;
+      first++;
+    }
+    if (first < last && ast[items[last - 1]].kind == Ast_LineEnd) {
+      end = true;
+      last--;
+    }
+
+    // The longest run of literal characters every match must contain
+    std::wstring run, best;
+    bool allLiteral = true;
+    for (size_t i = first; i < last; i++) {
+      if (IsLiteralChar(items[i])) {
+        run += LiteralChar(items[i]);
+        if (run.length() > best.length())
+          best = run;
+      } else {
+        run.clear();
+        allLiteral = false;
+      }
+    }
+
+    if (allLiteral) {
+      re.isLiteral = true;
+      re.anchoredStart = start;
+      re.anchoredEnd = end;
+      re.literal = best;
+      re.literalSearch = SubstringSearch(best, re.ignoreCase);
+    } else if (best.length() >= 2) {
+      re.requiredSearch = SubstringSearch(best, re.ignoreCase);
+      re.hasRequired = true;
+    }
+  }
+
+  // NFA construction
+
+  struct Fragment {
+    int start;
+    std::vector<std::pair<int, int>> outs; // (node, 0 = out / 1 = out1)
+  };
+
+  int Emit(int kind, int set = -1, int out = -1, int out1 = -1) {
+    if ((int)re.nfa.size() >= MaxNfaNodes)
+      tooLarge = true;
+    NameRegex::NfaNode n;
+    n.kind = (uint8_t)kind;
+    n.set = set;
+    n.out = out;
+    n.out1 = out1;
+    re.nfa.push_back(n);
+    return (int)re.nfa.size() - 1;
+  }
+
+  void Patch(const std::vector<std::pair<int, int>> &outs, int target) {
+    for (const auto &o : outs) {
+      if (o.second == 0)
+        re.nfa[o.first].out = target;
+      else
+        re.nfa[o.first].out1 = target;
+    }
+  }
+
+  Fragment Single(int kind, int set = -1) {
+    Fragment f;
+    f.start = Emit(kind, set);
+    f.outs.push_back(std::make_pair(f.start, 0));
+    return f;
+  }
+
+  void Append(Fragment &f, bool &empty, Fragment next) {
+    if (empty) {
+      f = next;
+      empty = false;
+    } else {
+      Patch(f.outs, next.start);
+      f.outs = next.outs;
+    }
+  }
+
+  Fragment Build(int node) {
+    if (tooLarge)
+      return Single(NameRegex::Nfa_Jump);
+    const AstNode &n = ast[node];
+    switch (n.kind) {
+    case Ast_Set:
+      return Single(NameRegex::Nfa_Set, n.set);
+    case Ast_LineStart:
+      return Single(NameRegex::Nfa_LineStart);
+    case Ast_LineEnd:
+      return Single(NameRegex::Nfa_LineEnd);
+    case Ast_Concat: {
+      Fragment f;
+      bool empty = true;
+      for (int child : n.children)
+        Append(f, empty, Build(child));
+      return f;
+    }
+    case Ast_Alt: {
+      Fragment f = Build(n.children.back());
+      for (size_t i = n.children.size() - 1; i-- > 0;) {
+        Fragment branch = Build(n.children[i]);
+        int split = Emit(NameRegex::Nfa_Split, -1, branch.start, f.start);
+        f.start = split;
+        f.outs.insert(f.outs.end(), branch.outs.begin(), branch.outs.end());
+      }
+      return f;
+    }
+    case Ast_Repeat: {
+      Fragment f;
+      bool empty = true;
+      int child = n.children[0];
+      for (int i = 0; i < n.min && !tooLarge; i++)
+        Append(f, empty, Build(child));
+      if (n.max < 0) {
+        Fragment body = Build(child);
+        int split = Emit(NameRegex::Nfa_Split, -1, body.start);
+        Patch(body.outs, split);
+        Fragment loop;
+        loop.start = split;
+        loop.outs.push_back(std::make_pair(split, 1));
+        Append(f, empty, loop);
+      } else {
+        for (int i = n.min; i < n.max && !tooLarge; i++) {
+          Fragment body = Build(child);
+          Fragment optional;
+          optional.start = Emit(NameRegex::Nfa_Split, -1, body.start);
+          optional.outs = body.outs;
+          optional.outs.push_back(std::make_pair(optional.start, 1));
+          Append(f, empty, optional);
+        }
+      }
+      if (empty)
+        return Single(NameRegex::Nfa_Jump);
+      return f;
+    }
+    default:
+      return Single(NameRegex::Nfa_Jump);
+    }
+  }
+
+  // Splits the code units into classes no set tells apart, so DFA
+  // transitions are indexed by class instead of by character.
+  void BuildClasses() {
+    re.classOf.assign(CodeUnits, 0);
+    re.classCount = 1;
+    std::vector<std::vector<uint8_t>> members(sets.size());
+    for (size_t s = 0; s < sets.size(); s++) {
+      const CharSet &set = sets[s];
+      std::vector<uint8_t> &m = members[s];
+      m.assign(CodeUnits, 0);
+      if (re.ignoreCase) {
+        // A character matches when its fold equals any member's fold
+        std::vector<uint8_t> folded(CodeUnits, 0);
+        for (const auto &r : set.ranges) {
+          for (uint32_t u = r.first; u <= r.second; u++)
+            folded[re.fold[u]] = 1;
+        }
+        for (uint32_t u = 0; u < CodeUnits; u++)
+          m[u] = folded[re.fold[u]];
+      } else {
+        for (const auto &r : set.ranges) {
+          for (uint32_t u = r.first; u <= r.second; u++)
+            m[u] = 1;
+        }
+      }
+      if (set.negated) {
+        for (auto &v : m)
+          v ^= 1;
+      }
+
+      std::vector<int> remap((size_t)re.classCount * 2, -1);
+      uint32_t next = 0;
+      for (uint32_t u = 0; u < CodeUnits; u++) {
+        int &slot = remap[(size_t)re.classOf[u] * 2 + m[u]];
+        if (slot < 0)
+          slot = (int)next++;
+        re.classOf[u] = (uint16_t)slot;
+      }
+      re.classCount = next;
+    }
+
+    std::vector<uint32_t> representative(re.classCount, CodeUnits);
+    for (uint32_t u = CodeUnits; u-- > 0;)
+      representative[re.classOf[u]] = u;
+    re.setAccepts.assign(sets.size() * re.classCount, 0);
+    for (size_t s = 0; s < sets.size(); s++) {
+      for (uint32_t c = 0; c < re.classCount; c++)
+        re.setAccepts[s * re.classCount + c] = members[s][representative[c]];
+    }
+  }
+};
+
+NameRegex::NameRegex()
+    : ignoreCase(false), fold(nullptr), isLiteral(false), anchoredStart(false),
+      anchoredEnd(false), hasRequired(false), nfaStart(0), classCount(0), dfaInitial(0),
+      markStamp(0) {}
+
+bool NameRegex::Compile(const std::wstring &pattern, bool icase) {
+  *this = NameRegex();
+  ignoreCase = icase;
+  fold = FoldTable();
+  NameRegexCompiler compiler(*this, pattern);
+  if (!compiler.Compile()) {
+    *this = NameRegex();
+    return false;
+  }
+  if (!isLiteral) {
+    marks.assign(nfa.size(), 0);
+    ResetDfa();
+  }
+  return true;
+}
+
+bool NameRegex::SearchLiteral(const wchar_t *str, size_t length) const {
+  if (!anchoredStart && !anchoredEnd)
+    return literalSearch.Find(str, length);
+  if (literal.length() > length)
+    return false;
+  if (anchoredStart && anchoredEnd && literal.length() != length)
+    return false;
+  const wchar_t *at = anchoredStart ? str : str + length - literal.length();
+  for (size_t i = 0; i < literal.length(); i++) {
+    wchar_t c = ignoreCase ? (wchar_t)fold[(uint16_t)at[i]] : at[i];
+    if (c != literal[i])
+      return false;
+  }
+  return true;
+}
+
+// Follows epsilon edges from `stack`, leaving the sorted consuming, LineEnd
+// and Match nodes in `out`. '^' passes only at the start, '$' only at the end.
+void NameRegex::Closure(std::vector<int> &stack, bool atStart, bool atEnd,
+                        std::vector<int> &out) {
+  if (++markStamp == 0) {
+    std::fill(marks.begin(), marks.end(), 0);
+    markStamp = 1;
+  }
+  out.clear();
+  while (!stack.empty()) {
+    int n = stack.back();
+    stack.pop_back();
+    if (n < 0 || marks[n] == markStamp)
+      continue;
+    marks[n] = markStamp;
+    const NfaNode &node = nfa[n];
+    switch (node.kind) {
+    case Nfa_Jump:
+      stack.push_back(node.out);
+      break;
+    case Nfa_Split:
+      stack.push_back(node.out1);
+      stack.push_back(node.out);
+      break;
+    case Nfa_LineStart:
+      if (atStart)
+        stack.push_back(node.out);
+      break;
+    case Nfa_LineEnd:
+      if (atEnd)
+        stack.push_back(node.out);
+      else
+        out.push_back(n);
+      break;
+    default:
+      out.push_back(n);
+      break;
+    }
+  }
+  std::sort(out.begin(), out.end());
+}
+
+int NameRegex::Intern(std::vector<int> &set, bool atStart) {
+  // '^' may still pass at the end of the initial state only, so it never
+  // shares an entry with a later state of the same NFA nodes
+  std::vector<int> key = set;
+  if (atStart)
+    key.push_back(-1);
+  auto it = dfaIndex.find(key);
+  if (it != dfaIndex.end())
+    return it->second;
+
+  DfaState state;
+  state.nfa = set;
+  state.matched = false;
+  for (int n : set) {
+    if (nfa[n].kind == Nfa_Match)
+      state.matched = true;
+  }
+  state.dead = set.empty();
+
+  // Would the input ending here satisfy the pending '$'s?
+  state.matchedAtEnd = state.matched;
+  if (!state.matched) {
+    std::vector<int> stack, reached;
+    for (int n : set) {
+      if (nfa[n].kind == Nfa_LineEnd)
+        stack.push_back(nfa[n].out);
+    }
+    Closure(stack, atStart, true, reached);
+    for (int n : reached) {
+      if (nfa[n].kind == Nfa_Match)
+        state.matchedAtEnd = true;
+    }
+  }
+
+  int id = (int)dfa.size();
+  dfa.push_back(state);
+  transitions.resize(transitions.size() + classCount, -1);
+  dfaIndex[key] = id;
+  return id;
+}
+
+void NameRegex::ResetDfa() {
+  dfa.clear();
+  transitions.clear();
+  dfaIndex.clear();
+  std::vector<int> stack(1, nfaStart), set;
+  Closure(stack, true, false, set);
+  dfaInitial = Intern(set, true);
+}
+
+int NameRegex::Step(int state, uint32_t cls) {
+  if (dfa.size() >= MaxDfaStates || transitions.size() >= MaxTransitions) {
+    std::vector<int> current = dfa[state].nfa;
+    ResetDfa();
+    state = Intern(current, false);
+  }
+
+  // Advance every consuming node that accepts the class, and start a new
+  // match attempt at the next position
+  std::vector<int> stack(1, nfaStart), next;
+  for (int n : dfa[state].nfa) {
+    const NfaNode &node = nfa[n];
+    if (node.kind == Nfa_Set && setAccepts[node.set * classCount + cls])
+      stack.push_back(node.out);
+  }
+  Closure(stack, false, false, next);
+  int target = Intern(next, false);
+  transitions[(size_t)state * classCount + cls] = target;
+  return target;
+}
+
+bool NameRegex::Search(const wchar_t *str, size_t length) {
+  if (isLiteral)
+    return SearchLiteral(str, length);
+  if (nfa.empty())
+    return false;
+  if (hasRequired && !requiredSearch.Find(str, length))
+    return false;
+
+  int state = dfaInitial;
+  if (dfa[state].matched)
+    return true;
+  for (size_t i = 0; i < length; i++) {
+    uint32_t cls = classOf[(uint16_t)str[i]];
+    int32_t next = transitions[(size_t)state * classCount + cls];
+    if (next < 0)
+      next = Step(state, cls);
+    state = next;
+    if (dfa[state].matched)
+      return true;
+    if (dfa[state].dead)
+      return false;
+  }
+  return dfa[state].matchedAtEnd;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "SubstringSearch.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Regular expression matcher for file names and paths.
+//
+// Covers the ECMAScript subset typed into a search box: literals and escapes,
+// '.', classes with ranges and \d \w \s, '^' and '$', groups, alternation
+// and the * + ? {n,m} quantifiers (lazy forms accept the same names).
+// Compile() rejects anything else, such as backreferences, lookaround or \b,
+// so the caller can fall back to std::wregex.
+//
+// The pattern becomes an NFA that runs as a DFA built lazily, one state per
+// set of NFA states reached, so a match costs one table step per character
+// whatever the pattern. Pure literals skip the automaton and use a plain
+// substring, prefix or suffix compare. Ignoring case compares towlower()
+// folds. Works on UTF-16 code units.
+//
+// Not thread-safe: Search() grows the DFA cache.
+class NameRegex {
+public:
+  NameRegex();
+
+  bool Compile(const std::wstring &pattern, bool ignoreCase);
+
+  // True when the pattern matches anywhere in `str`.
+  bool Search(const wchar_t *str, size_t length);
+  bool Search(const std::wstring &str) {
+    return Search(str.data(), str.length());
+  }
+
+  // DFA states built so far, for diagnostics.
+  size_t StateCount() const { return dfa.size(); }
+
+private:
+  friend class NameRegexCompiler;
+
+  enum NfaKind {
+    Nfa_Set = 0, // Consumes one character in `set`
+    Nfa_Split,   // Epsilon to both `out` and `out1`
+    Nfa_Jump,    // Epsilon to `out`
+    Nfa_LineStart,
+    Nfa_LineEnd,
+    Nfa_Match
+  };
+  struct NfaNode {
+    uint8_t kind;
+    int set;
+    int out;
+    int out1;
+  };
+  struct DfaState {
+    std::vector<int> nfa; // Sorted Set, LineEnd and Match nodes
+    bool matched;         // Match reached; the rest of the input is irrelevant
+    bool matchedAtEnd;    // Match reached if the input ends here
+    bool dead;            // No match possible any more
+  };
+
+  bool ignoreCase;
+  const uint16_t *fold; // Shared towlower() table when ignoring case
+
+  // Literal patterns
+  bool isLiteral;
+  bool anchoredStart;
+  bool anchoredEnd;
+  std::wstring literal; // Folded when ignoring case
+  SubstringSearch literalSearch;
+  SubstringSearch requiredSearch; // Literal every match contains, if any
+  bool hasRequired;
+
+  // Automaton
+  std::vector<NfaNode> nfa;
+  int nfaStart;
+  std::vector<uint16_t> classOf; // Code unit -> character class
+  uint32_t classCount;
+  std::vector<uint8_t> setAccepts; // [set * classCount + class]
+
+  // Lazily built DFA
+  std::vector<DfaState> dfa;
+  std::vector<int32_t> transitions; // [state * classCount + class], -1 = todo
+  std::map<std::vector<int>, int> dfaIndex;
+  int dfaInitial;
+  std::vector<uint32_t> marks; // Closure visit stamps per NFA node
+  uint32_t markStamp;
+
+  bool SearchLiteral(const wchar_t *str, size_t length) const;
+
+  void Closure(std::vector<int> &stack, bool atStart, bool atEnd,
+               std::vector<int> &out);
+  int Intern(std::vector<int> &set, bool atStart);
+  void ResetDfa();
+  int Step(int state, uint32_t cls);
+};
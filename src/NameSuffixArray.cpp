@@ -0,0 +1,273 @@
+#include "NameSuffixArray.h"
+#include "PreparedQuery.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <future>
+
+// Slices smaller than this are not worth a thread
+static const size_t MinParallelSuffixes = 1 << 16;
+
+NameSuffixArray::NameSuffixArray()
+    : mainGeneration(0), foldedWithTable(false), generation(0),
+      built(false) {}
+
+void NameSuffixArray::Segment::Clear() {
+  std::vector<uint16_t>().swap(text);
+  std::vector<uint32_t>().swap(suffixes);
+  std::vector<uint32_t>().swap(nameStarts);
+  std::vector<uint32_t>().swap(nameOwners);
+}
+
+size_t NameSuffixArray::Segment::MemoryUsage() const {
+  return text.capacity() * sizeof(uint16_t) +
+         (suffixes.capacity() + nameStarts.capacity() +
+          nameOwners.capacity()) *
+             sizeof(uint32_t);
+}
+
+void NameSuffixArray::Clear() {
+  main.Clear();
+  delta.Clear();
+  std::vector<uint32_t>().swap(deltaIds);
+  std::vector<uint8_t>().swap(replaced);
+  built = false;
+}
+
+size_t NameSuffixArray::MemoryUsage() const {
+  return main.MemoryUsage() + delta.MemoryUsage() +
+         deltaIds.capacity() * sizeof(uint32_t) + replaced.capacity();
+}
+
+// Orders suffixes by their text up to the next separator, then by position.
+struct SuffixLess {
+  const uint16_t *text;
+
+  bool operator()(uint32_t a, uint32_t b) const {
+    if (text[a] != text[b])
+      return text[a] < text[b];
+    for (a++, b++;; a++, b++) {
+      if (text[a] != text[b])
+        return text[a] < text[b];
+      if (text[a] == 0)
+        return a < b;
+    }
+  }
+};
+
+void NameSuffixArray::BuildSegment(Segment &segment, const EntryStore &store,
+                                   const std::vector<uint32_t> *ids,
+                                   unsigned threads) {
+  segment.Clear();
+  const uint16_t *foldTable = store.FoldTable();
+  auto addName = [&](uint32_t id, const wchar_t *name, size_t length) {
+    segment.nameStarts.push_back((uint32_t)segment.text.size());
+    segment.nameOwners.push_back(id);
+    segment.text.push_back(0);
+    for (size_t i = 0; i < length; i++)
+      segment.text.push_back(PreparedQuery::FoldUnit(foldTable, name[i]));
+  };
+  auto addEntry = [&](uint32_t id) {
+    if (!store.IsValid(id))
+      return;
+    addName(id, store.Name(id), store.NameLength(id));
+    for (uint32_t link = store.FirstLink(id); link != EntryStore::NoLink;
+         link = store.NextLink(link))
+      addName(id, store.LinkName(link), store.LinkNameLength(link));
+    for (uint32_t stream = store.FirstStream(id);
+         stream != EntryStore::NoStream; stream = store.NextStream(stream))
+      addName(id, store.StreamName(stream), store.StreamNameLength(stream));
+  };
+  if (ids) {
+    for (uint32_t id : *ids)
+      addEntry(id);
+  } else {
+    for (uint32_t id = 0; id < store.IdLimit(); id++)
+      addEntry(id);
+  }
+  if (segment.text.empty())
+    return;
+  segment.text.push_back(0); // Ends the last name; not a suffix itself
+
+  size_t count = segment.text.size() - 1;
+  segment.suffixes.resize(count);
+  for (size_t i = 0; i < count; i++)
+    segment.suffixes[i] = (uint32_t)i;
+
+  // Sort slices in parallel, then merge neighbours pairwise
+  SuffixLess less = {segment.text.data()};
+  if (threads == 0)
+    threads = WorkerPool::DefaultThreadCount();
+  size_t slices = (std::min)((size_t)threads, count / MinParallelSuffixes);
+  if (slices <= 1) {
+    std::sort(segment.suffixes.begin(), segment.suffixes.end(), less);
+    return;
+  }
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= slices; i++)
+    bounds.push_back(count * i / slices);
+  WorkerPool pool((unsigned)slices);
+  std::vector<std::future<void>> done;
+  uint32_t *suffixes = segment.suffixes.data();
+  for (size_t i = 0; i < slices; i++)
+    done.push_back(pool.Submit([=]() {
+      std::sort(suffixes + bounds[i], suffixes + bounds[i + 1], less);
+    }));
+  for (auto &job : done)
+    job.get();
+  for (size_t width = 1; width < slices; width *= 2) {
+    done.clear();
+    for (size_t i = 0; i + width < slices; i += 2 * width) {
+      size_t first = bounds[i], middle = bounds[i + width];
+      size_t last = bounds[(std::min)(i + 2 * width, slices)];
+      done.push_back(pool.Submit([=]() {
+        std::inplace_merge(suffixes + first, suffixes + middle,
+                           suffixes + last, less);
+      }));
+    }
+    for (auto &job : done)
+      job.get();
+  }
+}
+
+void NameSuffixArray::Build(const EntryStore &store, unsigned threads) {
+  Clear();
+  BuildSegment(main, store, nullptr, threads);
+  foldedWithTable = store.FoldTable() != nullptr;
+  mainGeneration = store.Generation();
+  generation = mainGeneration;
+  built = true;
+}
+
+void NameSuffixArray::Update(const EntryStore &store, unsigned threads) {
+  if (IsCurrent(store))
+    return;
+  std::vector<uint32_t> changed;
+  if (!built || foldedWithTable != (store.FoldTable() != nullptr) ||
+      !store.ChangedSince(mainGeneration, changed)) {
+    Build(store, threads);
+    return;
+  }
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+  if (changed.size() > main.nameOwners.size() / DeltaShare) {
+    Build(store, threads);
+    return;
+  }
+
+  // Everything changed since the main build, indexed again as it is now
+  BuildSegment(delta, store, &changed, threads);
+  deltaIds.swap(changed);
+  replaced.assign(store.IdLimit(), 0);
+  for (uint32_t id : deltaIds) {
+    if (id < replaced.size())
+      replaced[id] = 1;
+  }
+  generation = store.Generation();
+}
+
+// Ids of the names in `segment` holding `pattern`, ascending and unique.
+void NameSuffixArray::Find(const Segment &segment,
+                           const std::vector<uint16_t> &pattern,
+                           uint32_t idLimit, std::vector<uint32_t> &ids) {
+  ids.clear();
+  if (segment.suffixes.empty())
+    return;
+  const uint16_t *text = segment.text.data();
+  // <0, 0 or >0 as the suffix sorts before, starts with or sorts after the
+  // pattern. Separators inside the pattern only ever meet the text's own.
+  auto compare = [&](uint32_t position) {
+    for (size_t k = 0; k < pattern.size(); k++) {
+      uint16_t c = text[position + k];
+      if (c != pattern[k])
+        return c < pattern[k] ? -1 : 1;
+    }
+    return 0;
+  };
+  auto first = std::partition_point(
+      segment.suffixes.begin(), segment.suffixes.end(),
+      [&](uint32_t position) { return compare(position) < 0; });
+  auto last = std::partition_point(
+      first, segment.suffixes.end(),
+      [&](uint32_t position) { return compare(position) == 0; });
+
+  auto ownerAt = [&](uint32_t position) {
+    size_t name = std::upper_bound(segment.nameStarts.begin(),
+                                   segment.nameStarts.end(), position) -
+                  segment.nameStarts.begin() - 1;
+    return segment.nameOwners[name];
+  };
+  size_t hits = last - first;
+  if (hits > idLimit / 8) {
+    // Many hits: mark them, then read the ids off in order
+    std::vector<uint8_t> seen(idLimit, 0);
+    for (auto it = first; it != last; ++it)
+      seen[ownerAt(*it)] = 1;
+    for (uint32_t id = 0; id < idLimit; id++) {
+      if (seen[id])
+        ids.push_back(id);
+    }
+    return;
+  }
+  ids.reserve(hits);
+  for (auto it = first; it != last; ++it)
+    ids.push_back(ownerAt(*it));
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+bool NameSuffixArray::Covers(const std::wstring &query,
+                             const SearchOptions &options) {
+  return !options.invertMatch && !options.matchFullPath &&
+         options.mode != MatchMode_RegEx &&
+         !PreparedQuery::Terms(query, options).empty();
+}
+
+std::vector<uint32_t>
+NameSuffixArray::Candidates(const EntryStore &store, const std::wstring &query,
+                            const SearchOptions &options) const {
+  const uint16_t *foldTable = store.FoldTable();
+  uint32_t idLimit = store.IdLimit();
+  bool exact = options.mode == MatchMode_Exact;
+  bool prefix = PreparedQuery::IsPrefix(query, options);
+
+  std::vector<uint32_t> result, found, fromDelta, merged;
+  bool first = true;
+  for (const auto &term : PreparedQuery::Terms(query, options)) {
+    std::vector<uint16_t> pattern;
+    if (exact)
+      pattern.push_back(0);
+    for (wchar_t c : term)
+      pattern.push_back(PreparedQuery::FoldUnit(foldTable, c));
+    if (exact && !prefix)
+      pattern.push_back(0);
+
+    // Main segment answers for the entries that did not change since
+    Find(main, pattern, idLimit, found);
+    if (!deltaIds.empty()) {
+      size_t kept = 0;
+      for (uint32_t id : found) {
+        if (id >= replaced.size() || !replaced[id])
+          found[kept++] = id;
+      }
+      found.resize(kept);
+      Find(delta, pattern, idLimit, fromDelta);
+      merged.clear();
+      std::set_union(found.begin(), found.end(), fromDelta.begin(),
+                     fromDelta.end(), std::back_inserter(merged));
+      found.swap(merged);
+    }
+
+    if (first) {
+      result.swap(found);
+      first = false;
+    } else {
+      merged.clear();
+      std::set_intersection(result.begin(), result.end(), found.begin(),
+                            found.end(), std::back_inserter(merged));
+      result.swap(merged);
+    }
+    if (result.empty())
+      break;
+  }
+  return result;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "EntryStore.h"
+#include "MFTReader.h" // For SearchOptions
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Suffix array over the case-folded names of an EntryStore, answering any
+// infix or exact name query by binary search instead of a pass over every
+// name.
+//
+// The names (own, further hard links, streams) are folded the way the search
+// compares them, as for NameTrigrams, and laid end to end with a 0
+// separator before each and one at the end. Every position but the last
+// is a suffix; suffixes compare only up to the next separator, so a match
+// never runs across two names. The suffixes of "\0query" and "\0query\0"
+// make exact matching the same binary search. A query term costs
+// O(|term| log n) to find plus one step per occurrence to map back to ids.
+//
+// Memory is about 6 bytes per name character (the folded text and a 32-bit
+// suffix) plus 8 per name. The build sorts slices of the suffixes on a
+// WorkerPool and merges them.
+//
+// Changes after the build go to a delta segment: the entries the store's
+// change log names are dropped from the main segment's answers and indexed
+// again, with their current names, in a second suffix array that is rebuilt
+// from those entries alone. Once the delta outgrows DeltaShare of the main
+// segment, or the change log does not reach back, everything is rebuilt.
+class NameSuffixArray {
+public:
+  NameSuffixArray();
+
+  // Indexes every name; `threads` 0 means one per logical processor.
+  void Build(const EntryStore &store, unsigned threads = 0);
+  // Catches up with the store through the delta segment, or rebuilds.
+  void Update(const EntryStore &store, unsigned threads = 0);
+  bool IsCurrent(const EntryStore &store) const {
+    return built && generation == store.Generation() &&
+           foldedWithTable == (store.FoldTable() != nullptr);
+  }
+  void Clear();
+
+  // Whether Candidates() can answer `query` under `options`: a non-empty,
+  // non-inverted name query in substring, space-divided or exact mode.
+  static bool Covers(const std::wstring &query, const SearchOptions &options);
+  // Ascending ids of the entries with a folded name holding every term
+  // (equal to the query, or starting with it, in exact mode): a superset
+  // of the matches, which the search still verifies. Only for queries
+  // Covers() accepts, and only while IsCurrent(store).
+  std::vector<uint32_t> Candidates(const EntryStore &store,
+                                   const std::wstring &query,
+                                   const SearchOptions &options) const;
+
+  size_t TextLength() const { return main.text.size() + delta.text.size(); }
+  size_t DeltaEntries() const { return deltaIds.size(); }
+  // Bytes held by both segments.
+  size_t MemoryUsage() const;
+
+private:
+  static constexpr size_t DeltaShare = 8; // Rebuild past 1/8 of main
+
+  struct Segment {
+    std::vector<uint16_t> text;
+    std::vector<uint32_t> suffixes;   // Positions in text, sorted
+    std::vector<uint32_t> nameStarts; // Separator before each name
+    std::vector<uint32_t> nameOwners; // Entry id of each name
+
+    void Clear();
+    size_t MemoryUsage() const;
+  };
+
+  Segment main;
+  Segment delta;
+  std::vector<uint32_t> deltaIds;  // Sorted; their main names are stale
+  std::vector<uint8_t> replaced;   // By id, 1 for deltaIds
+  uint64_t mainGeneration;         // Store generation main was built at
+  bool foldedWithTable;            // Else towlower()
+  uint64_t generation;
+  bool built;
+
+  static void BuildSegment(Segment &segment, const EntryStore &store,
+                           const std::vector<uint32_t> *ids,
+                           unsigned threads);
+  static void Find(const Segment &segment,
+                   const std::vector<uint16_t> &pattern, uint32_t idLimit,
+                   std::vector<uint32_t> &ids);
+};
@@ -0,0 +1,331 @@
+#include "NameTrigrams.h"
+#include "PreparedQuery.h"
+#include <algorithm>
+#include <unordered_map>
+
+static const uint32_t NoId = 0xFFFFFFFF;
+
+NameTrigrams::NameTrigrams()
+    : postings(0), builtGeneration(0), foldedWithTable(false), generation(0),
+      built(false) {}
+
+void NameTrigrams::Clear() {
+  std::vector<Key>().swap(keys);
+  std::vector<Block>().swap(blocks);
+  std::vector<uint8_t>().swap(bytes);
+  std::vector<uint32_t>().swap(deltaIds);
+  postings = 0;
+  built = false;
+}
+
+void NameTrigrams::AddTrigrams(const uint16_t *foldTable, const wchar_t *name,
+                               size_t length, std::vector<uint64_t> &out) {
+  uint64_t window = 0;
+  for (size_t i = 0; i < length; i++) {
+    uint16_t unit = PreparedQuery::FoldUnit(foldTable, name[i]);
+    window = ((window << 16) | unit) & 0xFFFFFFFFFFFFull;
+    if (i >= 2)
+      out.push_back(window);
+  }
+}
+
+// Posting list under construction.
+struct TrigramList {
+  uint64_t trigram;
+  std::vector<uint8_t> bytes;
+  std::vector<uint32_t> firstIds; // Per block
+  std::vector<uint32_t> offsets;  // Per block, into bytes
+  uint32_t last;
+  uint32_t count;
+};
+
+static void AppendVarint(std::vector<uint8_t> &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((uint8_t)value);
+}
+
+static uint32_t ReadVarint(const uint8_t *&p) {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint8_t b = *p++;
+    value |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+      return value;
+  }
+}
+
+void NameTrigrams::Build(const EntryStore &store) {
+  Clear();
+  const uint16_t *foldTable = store.FoldTable();
+
+  // Trigrams of three ASCII units, the bulk of them, find their list through
+  // a flat table; the rest through a hash map
+  std::vector<TrigramList> lists;
+  std::vector<uint32_t> asciiLists(128 * 128 * 128, NoId);
+  std::unordered_map<uint64_t, uint32_t> otherLists;
+
+  std::vector<uint64_t> found;
+  for (uint32_t id = 0; id < store.IdLimit(); id++) {
+    if (!store.IsValid(id))
+      continue;
+    found.clear();
+    AddTrigrams(foldTable, store.Name(id), store.NameLength(id), found);
+    for (uint32_t link = store.FirstLink(id); link != EntryStore::NoLink;
+         link = store.NextLink(link))
+      AddTrigrams(foldTable, store.LinkName(link), store.LinkNameLength(link),
+                  found);
+    for (uint32_t stream = store.FirstStream(id);
+         stream != EntryStore::NoStream; stream = store.NextStream(stream))
+      AddTrigrams(foldTable, store.StreamName(stream),
+                  store.StreamNameLength(stream), found);
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    for (uint64_t trigram : found) {
+      uint32_t *slot;
+      if ((trigram & 0xFF80FF80FF80ull) == 0)
+        slot = &asciiLists[((trigram >> 18) & 0x1FC000) |
+                           ((trigram >> 9) & 0x3F80) | (trigram & 0x7F)];
+      else
+        slot = &otherLists.emplace(trigram, NoId).first->second;
+      if (*slot == NoId) {
+        *slot = (uint32_t)lists.size();
+        lists.emplace_back();
+        lists.back().trigram = trigram;
+        lists.back().count = 0;
+      }
+      TrigramList &list = lists[*slot];
+      if (list.count % BlockSize == 0) {
+        list.firstIds.push_back(id);
+        list.offsets.push_back((uint32_t)list.bytes.size());
+      } else {
+        AppendVarint(list.bytes, id - list.last);
+      }
+      list.last = id;
+      list.count++;
+    }
+  }
+  std::vector<uint32_t>().swap(asciiLists);
+  otherLists.clear();
+
+  // Lay the lists out back to back in trigram order
+  std::vector<uint32_t> order(lists.size());
+  size_t blockCount = 0, byteCount = 0;
+  for (uint32_t i = 0; i < (uint32_t)lists.size(); i++) {
+    order[i] = i;
+    blockCount += lists[i].firstIds.size();
+    byteCount += lists[i].bytes.size();
+  }
+  std::sort(order.begin(), order.end(), [&lists](uint32_t a, uint32_t b) {
+    return lists[a].trigram < lists[b].trigram;
+  });
+  keys.reserve(lists.size());
+  blocks.reserve(blockCount);
+  bytes.reserve(byteCount);
+  for (uint32_t i : order) {
+    TrigramList &list = lists[i];
+    Key key;
+    key.trigram = list.trigram;
+    key.firstBlock = (uint32_t)blocks.size();
+    key.count = list.count;
+    keys.push_back(key);
+    for (size_t b = 0; b < list.firstIds.size(); b++) {
+      Block block;
+      block.firstId = list.firstIds[b];
+      block.offset = (uint32_t)bytes.size() + list.offsets[b];
+      blocks.push_back(block);
+    }
+    bytes.insert(bytes.end(), list.bytes.begin(), list.bytes.end());
+    postings += list.count;
+    std::vector<uint8_t>().swap(list.bytes); // Free as we go
+    std::vector<uint32_t>().swap(list.firstIds);
+    std::vector<uint32_t>().swap(list.offsets);
+  }
+
+  foldedWithTable = foldTable != nullptr;
+  builtGeneration = store.Generation();
+  generation = builtGeneration;
+  built = true;
+}
+
+void NameTrigrams::Update(const EntryStore &store) {
+  if (IsCurrent(store))
+    return;
+  std::vector<uint32_t> changed;
+  if (!built || foldedWithTable != (store.FoldTable() != nullptr) ||
+      !store.ChangedSince(builtGeneration, changed)) {
+    Build(store);
+    return;
+  }
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+  if (changed.size() > store.Count() / DeltaShare) {
+    Build(store);
+    return;
+  }
+
+  // Removed entries stay out; the others are answered unchecked
+  deltaIds.clear();
+  for (uint32_t id : changed) {
+    if (store.IsValid(id))
+      deltaIds.push_back(id);
+  }
+  generation = store.Generation();
+}
+
+const NameTrigrams::Key *NameTrigrams::Find(uint64_t trigram) const {
+  auto it = std::lower_bound(
+      keys.begin(), keys.end(), trigram,
+      [](const Key &key, uint64_t value) { return key.trigram < value; });
+  return it != keys.end() && it->trigram == trigram ? &*it : nullptr;
+}
+
+uint32_t NameTrigrams::BlockEnd(const Key &key) const {
+  size_t next = (&key - keys.data()) + 1;
+  return next < keys.size() ? keys[next].firstBlock : (uint32_t)blocks.size();
+}
+
+// Walks one posting list forward, skipping whole blocks where it can.
+class NameTrigrams::Cursor {
+public:
+  Cursor(const NameTrigrams &index, const Key &key)
+      : index(index), end(index.BlockEnd(key)),
+        lastBlockCount(key.count - (end - key.firstBlock - 1) * BlockSize),
+        done(false) {
+    Enter(key.firstBlock);
+  }
+
+  // The first id in the list not below `target`, NoId when there is none.
+  uint32_t SkipTo(uint32_t target) {
+    if (done)
+      return NoId;
+    if (current >= target)
+      return current;
+    const Block *blocks = index.blocks.data();
+    if (block + 1 < end && blocks[block + 1].firstId <= target) {
+      const Block *next = std::upper_bound(
+          blocks + block + 1, blocks + end, target,
+          [](uint32_t value, const Block &b) { return value < b.firstId; });
+      Enter((uint32_t)(next - blocks) - 1);
+      if (current >= target)
+        return current;
+    }
+    while (left > 0) {
+      current += ReadVarint(p);
+      left--;
+      if (current >= target)
+        return current;
+    }
+    // The next block starts past `target`
+    if (block + 1 < end) {
+      Enter(block + 1);
+      return current;
+    }
+    done = true;
+    return NoId;
+  }
+
+private:
+  const NameTrigrams &index;
+  uint32_t end;
+  uint32_t lastBlockCount;
+  uint32_t block;
+  uint32_t current; // Id at the cursor
+  uint32_t left;    // Ids in the block after current
+  const uint8_t *p; // Next delta
+  bool done;
+
+  void Enter(uint32_t b) {
+    block = b;
+    current = index.blocks[b].firstId;
+    p = index.bytes.data() + index.blocks[b].offset;
+    left = (b + 1 < end ? BlockSize : lastBlockCount) - 1;
+  }
+};
+
+bool NameTrigrams::Covers(const std::wstring &query,
+                          const SearchOptions &options) {
+  if (options.invertMatch || options.matchFullPath ||
+      options.mode == MatchMode_RegEx)
+    return false;
+  for (const auto &term : PreparedQuery::Terms(query, options)) {
+    if (term.length() >= 3)
+      return true;
+  }
+  return false;
+}
+
+void NameTrigrams::Intersect(const std::vector<uint64_t> &trigrams,
+                             std::vector<uint32_t> &ids) const {
+  // A trigram no name has rules out every entry
+  std::vector<const Key *> lists;
+  for (uint64_t trigram : trigrams) {
+    const Key *key = Find(trigram);
+    if (!key)
+      return;
+    lists.push_back(key);
+  }
+  if (lists.empty())
+    return;
+  std::sort(lists.begin(), lists.end(), [](const Key *a, const Key *b) {
+    return a->count < b->count;
+  });
+
+  // Start from the shortest list and keep what every other one holds too
+  ids.reserve(lists[0]->count);
+  Cursor shortest(*this, *lists[0]);
+  for (uint32_t id = shortest.SkipTo(0); id != NoId;
+       id = shortest.SkipTo(id + 1))
+    ids.push_back(id);
+  for (size_t i = 1; i < lists.size() && !ids.empty(); i++) {
+    Cursor cursor(*this, *lists[i]);
+    size_t kept = 0;
+    for (uint32_t id : ids) {
+      uint32_t found = cursor.SkipTo(id);
+      if (found == NoId)
+        break;
+      if (found == id)
+        ids[kept++] = id;
+    }
+    ids.resize(kept);
+  }
+}
+
+std::vector<uint32_t>
+NameTrigrams::Candidates(const EntryStore &store, const std::wstring &query,
+                         const SearchOptions &options) const {
+  std::vector<uint64_t> trigrams;
+  for (const auto &term : PreparedQuery::Terms(query, options))
+    AddTrigrams(store.FoldTable(), term.data(), term.length(), trigrams);
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  std::vector<uint32_t> ids;
+  Intersect(trigrams, ids);
+  if (generation == builtGeneration)
+    return ids;
+
+  // Postings of entries changed since the build may be stale both ways: drop
+  // the entries removed since and add every changed one
+  std::vector<uint32_t> merged;
+  merged.reserve(ids.size() + deltaIds.size());
+  auto delta = deltaIds.begin();
+  for (uint32_t id : ids) {
+    for (; delta != deltaIds.end() && *delta < id; ++delta)
+      merged.push_back(*delta);
+    if (delta != deltaIds.end() && *delta == id)
+      ++delta;
+    if (id < store.IdLimit() && store.IsValid(id))
+      merged.push_back(id);
+  }
+  merged.insert(merged.end(), delta, deltaIds.end());
+  return merged;
+}
+
+size_t NameTrigrams::MemoryUsage() const {
+  return keys.capacity() * sizeof(Key) + blocks.capacity() * sizeof(Block) +
+         bytes.capacity();
+}
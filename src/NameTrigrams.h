@@ -0,0 +1,92 @@
+#pragma once
+#include "EntryStore.h"
+#include "MFTReader.h" // For SearchOptions
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Trigram inverted index over the names in an EntryStore, so a substring
+// query visits only the entries that can contain it instead of every name.
+//
+// Every run of three case-folded UTF-16 code units in an entry's own name,
+// its further hard links and its stream names maps to a posting list of
+// entry ids. A query's trigrams intersect to a candidate list, which the
+// normal search then verifies, so results are exactly those of a full pass.
+// Names are folded the way the search compares them: through the store's
+// fold table when it has one, with towlower() otherwise.
+//
+// Posting lists hold ascending ids in blocks of BlockSize: the first id of
+// each block is kept uncompressed in a skip table, the rest as varint
+// deltas. Intersecting walks the shortest list and skips through the others
+// block by block, so a rare trigram next to a common one stays cheap.
+//
+// Built in one pass over the store. Entries changed after the build, as the
+// store's change log names them, are added to every answer rather than
+// looked up, since their postings may be stale; the index is rebuilt only
+// once they outgrow DeltaShare of the entries or the log no longer reaches
+// back. It pays off on large volumes that are searched far more often than
+// they change.
+class NameTrigrams {
+public:
+  NameTrigrams();
+
+  void Build(const EntryStore &store);
+  // Catches up with the store by noting the changed entries, or rebuilds.
+  void Update(const EntryStore &store);
+  bool IsCurrent(const EntryStore &store) const {
+    return built && generation == store.Generation() &&
+           foldedWithTable == (store.FoldTable() != nullptr);
+  }
+  void Clear();
+
+  // Whether Candidates() can answer `query` under `options`: a non-inverted
+  // name query in substring, space-divided or exact mode with at least one
+  // term of three or more characters. Regexes and full-path matches are not.
+  static bool Covers(const std::wstring &query, const SearchOptions &options);
+  // Ascending ids of the entries whose names hold every trigram of the
+  // query, plus every entry changed since the build: a superset of the
+  // matches. Only for queries Covers() accepts, and only while
+  // IsCurrent(store).
+  std::vector<uint32_t> Candidates(const EntryStore &store,
+                                   const std::wstring &query,
+                                   const SearchOptions &options) const;
+
+  size_t ListCount() const { return keys.size(); }
+  size_t DeltaEntries() const { return deltaIds.size(); }
+  size_t PostingCount() const { return postings; }
+  // Bytes held by the key and skip tables and the encoded lists.
+  size_t MemoryUsage() const;
+
+private:
+  static constexpr uint32_t BlockSize = 128;
+  static constexpr size_t DeltaShare = 8; // Rebuild past 1/8 of the entries
+
+  struct Key {
+    uint64_t trigram;    // Three folded code units, first in the high bits
+    uint32_t firstBlock; // Into blocks; the list ends at the next key's
+    uint32_t count;      // Ids in the list
+  };
+  struct Block {
+    uint32_t firstId;
+    uint32_t offset; // Into bytes, where the deltas after firstId start
+  };
+  class Cursor;
+
+  std::vector<Key> keys; // Sorted by trigram
+  std::vector<Block> blocks;
+  std::vector<uint8_t> bytes;
+  size_t postings;
+  std::vector<uint32_t> deltaIds; // Sorted, valid; changed since the build
+  uint64_t builtGeneration;       // Store generation the lists are from
+  bool foldedWithTable; // Else towlower()
+  uint64_t generation;
+  bool built;
+
+  static void AddTrigrams(const uint16_t *foldTable, const wchar_t *name,
+                          size_t length, std::vector<uint64_t> &out);
+  const Key *Find(uint64_t trigram) const;
+  // Ids in every list of `trigrams`, ascending, as of the build.
+  void Intersect(const std::vector<uint64_t> &trigrams,
+                 std::vector<uint32_t> &ids) const;
+  uint32_t BlockEnd(const Key &key) const;
+};
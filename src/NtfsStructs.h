@@ -70,10 +70,10 @@ struct RESIDENT_ATTRIBUTE_HEADER {
 // Standard Information Attribute (0x10)
 struct STANDARD_INFORMATION {
     uint64_t CreationTime;
-    uint64_t FileChangeTime;
-    uint64_t MftChangeTime;
-    uint64_t AccessTime;
-    uint32_t FileAttributes;
+    uint64_t LastWriteTime;  // File data altered
+    uint64_t ChangeTime;     // MFT record altered
+    uint64_t LastAccessTime;
+    uint32_t FileAttributes; // FILE_ATTRIBUTE_*
     uint32_t MaxNumVersions;
     uint32_t VersionNumber;
     uint32_t ClassID;
@@ -119,3 +119,11 @@ const uint32_t AttributeEA = 0xE0;
 const uint32_t AttributePropertySet = 0xF0;
 const uint32_t AttributeLoggedUtilityStream = 0x100;
 const uint32_t AttributeEnd = 0xFFFFFFFF;
+
+// Record signatures
+const uint32_t FileRecordMagic = 0x454C4946; // "FILE"
+const uint32_t BadRecordMagic = 0x44414142;  // "BAAD", failed chkdsk fixup
+
+// Multi-sector records carry an update sequence number in the last two bytes
+// of every 512-byte stride, independent of the physical sector size.
+const uint32_t UpdateSequenceStride = 512;
@@ -0,0 +1,80 @@
+#include "PathCache.h"
+
+// Parent chains deeper than this are treated as corrupt and cut off
+static const int MaxPathDepth = 256;
+
+PathCache::PathCache()
+    : rootId(EntryStore::NoParent), generation(0), hasGeneration(false) {}
+
+void PathCache::SetRoot(uint32_t id, const std::wstring &path) {
+  if (id == rootId && path == rootPath)
+    return;
+  rootId = id;
+  rootPath = path;
+  Clear();
+}
+
+void PathCache::Clear() {
+  cached.clear();
+  std::vector<wchar_t>().swap(arena);
+  hasGeneration = false;
+}
+
+bool PathCache::IsRoot(const EntryStore &store, uint32_t id) const {
+  return id == rootId || !store.IsValid(id);
+}
+
+std::wstring PathCache::DirectoryPath(const EntryStore &store,
+                                      uint32_t dirId) {
+  // Walk up to the root or the nearest directory already cached
+  std::vector<uint32_t> chain;
+  std::wstring path = rootPath;
+  uint32_t id = dirId;
+  while (!IsRoot(store, id) && (int)chain.size() < MaxPathDepth) {
+    auto it = cached.find(id);
+    if (it != cached.end()) {
+      path.assign(arena.data() + (it->second >> 32),
+                  (size_t)(it->second & 0xFFFFFFFF));
+      break;
+    }
+    chain.push_back(id);
+    id = store.Parent(id);
+  }
+
+  // Then build and cache each missing directory on the way back down
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    path += L'\\';
+    path.append(store.Name(*it), store.NameLength(*it));
+    cached[*it] = ((uint64_t)arena.size() << 32) | path.length();
+    arena.insert(arena.end(), path.begin(), path.end());
+  }
+  return path;
+}
+
+// Drops the cache once the store's directories changed.
+void PathCache::Sync(const EntryStore &store) {
+  if (!hasGeneration || generation != store.DirectoryGeneration()) {
+    Clear();
+    generation = store.DirectoryGeneration();
+    hasGeneration = true;
+  }
+}
+
+std::wstring PathCache::FullPath(const EntryStore &store, uint32_t id) {
+  Sync(store);
+  if (id == rootId)
+    return rootPath;
+
+  std::wstring path = DirectoryPath(store, store.Parent(id));
+  path += L'\\';
+  path.append(store.Name(id), store.NameLength(id));
+  return path;
+}
+
+std::wstring PathCache::LinkPath(const EntryStore &store, uint32_t link) {
+  Sync(store);
+  std::wstring path = DirectoryPath(store, store.LinkParent(link));
+  path += L'\\';
+  path.append(store.LinkName(link), store.LinkNameLength(link));
+  return path;
+}
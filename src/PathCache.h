@@ -0,0 +1,40 @@
+#pragma once
+#include "EntryStore.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Full paths of directories, built on first use and cached by directory id.
+// Entries in the same directory share one prefix instead of each walking the
+// parent chain, and only directories that a search actually reaches are ever
+// built. The cache drops itself when the store's directories change.
+class PathCache {
+public:
+  PathCache();
+
+  // `rootId` ends the parent walk (the NTFS root record, or
+  // EntryStore::NoParent on FAT/exFAT) and `rootPath` is its path, e.g. "C:".
+  void SetRoot(uint32_t rootId, const std::wstring &rootPath);
+  const std::wstring &RootPath() const { return rootPath; }
+  void Clear();
+
+  // Path of the parent directory, a backslash, then the entry's name.
+  std::wstring FullPath(const EntryStore &store, uint32_t id);
+  // The same for one of an entry's further hard links.
+  std::wstring LinkPath(const EntryStore &store, uint32_t link);
+
+private:
+  uint32_t rootId;
+  std::wstring rootPath;
+  uint64_t generation;
+  bool hasGeneration;
+
+  // Directory id -> (offset << 32 | length) into the arena
+  std::unordered_map<uint32_t, uint64_t> cached;
+  std::vector<wchar_t> arena;
+
+  void Sync(const EntryStore &store);
+  bool IsRoot(const EntryStore &store, uint32_t id) const;
+  std::wstring DirectoryPath(const EntryStore &store, uint32_t dirId);
+};
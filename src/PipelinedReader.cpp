@@ -0,0 +1,146 @@
+#include "PipelinedReader.h"
+#include <cstring>
+
+PipelinedReader::PipelinedReader(HANDLE h, uint32_t chunk, uint32_t depth)
+    : handle(h), chunkSize(chunk), slots(depth ? depth : 1), memory(nullptr),
+      extentIndex(0), extentDone(0), head(0), headInUse(false), error(0),
+      bytesRead(0) {
+  for (auto &slot : slots) {
+    memset(&slot.overlapped, 0, sizeof(slot.overlapped));
+    slot.buffer = nullptr;
+    slot.requested = 0;
+    slot.transferred = 0;
+    slot.issued = false;
+    slot.completed = false;
+  }
+}
+
+PipelinedReader::~PipelinedReader() {
+  Drain();
+  for (auto &slot : slots) {
+    if (slot.overlapped.hEvent)
+      CloseHandle(slot.overlapped.hEvent);
+  }
+  if (memory)
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+bool PipelinedReader::Start(const std::vector<ReadExtent> &list) {
+  extents = list;
+  memory = (uint8_t *)VirtualAlloc(NULL, (SIZE_T)chunkSize * slots.size(),
+                                   MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  if (!memory) {
+    error = ERROR_NOT_ENOUGH_MEMORY;
+    return false;
+  }
+  for (size_t i = 0; i < slots.size(); i++) {
+    Slot &slot = slots[i];
+    slot.buffer = memory + i * chunkSize;
+    // One event per slot, so each read can be waited for on its own
+    slot.overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!slot.overlapped.hEvent) {
+      error = GetLastError();
+      return false;
+    }
+  }
+  for (auto &slot : slots) {
+    if (!Issue(slot))
+      return false;
+  }
+  return true;
+}
+
+// Starts the read of the next chunk into `slot`. Leaves the slot idle when
+// every extent has been issued.
+bool PipelinedReader::Issue(Slot &slot) {
+  while (extentIndex < extents.size() &&
+         extentDone >= extents[extentIndex].length) {
+    extentIndex++;
+    extentDone = 0;
+  }
+  if (extentIndex == extents.size())
+    return true;
+
+  const ReadExtent &extent = extents[extentIndex];
+  uint64_t offset = extent.offset + extentDone;
+  uint64_t remaining = extent.length - extentDone;
+  slot.requested = remaining < chunkSize ? (uint32_t)remaining : chunkSize;
+  extentDone += slot.requested;
+
+  HANDLE event = slot.overlapped.hEvent;
+  memset(&slot.overlapped, 0, sizeof(slot.overlapped));
+  slot.overlapped.Offset = (DWORD)offset;
+  slot.overlapped.OffsetHigh = (DWORD)(offset >> 32);
+  slot.overlapped.hEvent = event;
+  slot.transferred = 0;
+  slot.issued = true;
+
+  slot.completed = ReadFile(handle, slot.buffer, slot.requested,
+                            &slot.transferred, &slot.overlapped) != FALSE;
+  if (!slot.completed) {
+    DWORD err = GetLastError();
+    if (err == ERROR_IO_PENDING)
+      return true;
+    slot.issued = false;
+    // Reading past the end of the volume just ends the stream
+    if (err != ERROR_HANDLE_EOF)
+      error = err;
+    return err == ERROR_HANDLE_EOF;
+  }
+  return true;
+}
+
+bool PipelinedReader::Next(uint8_t *&data, uint32_t &length) {
+  if (error)
+    return false;
+
+  // The caller is done with the previous chunk: reuse its slot for the read
+  // after the last one in flight
+  if (headInUse) {
+    headInUse = false;
+    slots[head].issued = false;
+    if (!Issue(slots[head]))
+      return false;
+    head = (head + 1) % slots.size();
+  }
+
+  Slot &slot = slots[head];
+  if (!slot.issued)
+    return false;
+  if (!slot.completed &&
+      !GetOverlappedResult(handle, &slot.overlapped, &slot.transferred,
+                           TRUE)) {
+    DWORD err = GetLastError();
+    slot.issued = false;
+    if (err != ERROR_HANDLE_EOF)
+      error = err;
+    return false;
+  }
+  slot.completed = true;
+  if (slot.transferred == 0)
+    return false;
+
+  bytesRead += slot.transferred;
+  data = slot.buffer;
+  length = slot.transferred;
+  headInUse = true;
+  return true;
+}
+
+// Cancels whatever is still in flight and waits for it, so no read lands in
+// freed buffers.
+void PipelinedReader::Drain() {
+  bool pending = false;
+  for (auto &slot : slots)
+    pending = pending || (slot.issued && !slot.completed);
+  if (!pending)
+    return;
+  CancelIoEx(handle, NULL);
+  for (auto &slot : slots) {
+    if (slot.issued && !slot.completed) {
+      DWORD transferred;
+      GetOverlappedResult(handle, &slot.overlapped, &transferred, TRUE);
+      slot.completed = true;
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <windows.h>
+
+// A byte range of the volume, e.g. one data run of $MFT.
+struct ReadExtent {
+  uint64_t offset;
+  uint64_t length;
+};
+
+// Reads a list of extents in fixed-size chunks with several reads in flight,
+// so the disk keeps streaming while the caller parses the previous chunk.
+//
+// With a handle opened FILE_FLAG_OVERLAPPED (ideally with
+// FILE_FLAG_NO_BUFFERING) up to `queueDepth` reads are outstanding at once.
+// A synchronous handle works too; each read then completes as it is issued,
+// which gives the old read-then-parse behaviour. Offsets, lengths and chunk
+// size must respect the volume's sector alignment.
+class PipelinedReader {
+public:
+  PipelinedReader(HANDLE handle, uint32_t chunkSize, uint32_t queueDepth);
+  ~PipelinedReader();
+
+  // Queues the first reads. False if the buffers could not be allocated or a
+  // read could not be issued; see Error().
+  bool Start(const std::vector<ReadExtent> &extents);
+
+  // Waits for the next chunk in extent order. `data` stays valid until the
+  // following call. False at the end, or on a failed read (Error() != 0).
+  bool Next(uint8_t *&data, uint32_t &length);
+
+  DWORD Error() const { return error; }
+  uint64_t BytesRead() const { return bytesRead; }
+
+private:
+  struct Slot {
+    OVERLAPPED overlapped;
+    uint8_t *buffer;
+    uint32_t requested;
+    DWORD transferred;
+    bool issued;
+    bool completed; // Finished inside ReadFile
+  };
+
+  HANDLE handle;
+  uint32_t chunkSize;
+  std::vector<Slot> slots;
+  uint8_t *memory; // chunkSize * slots, page aligned for unbuffered reads
+
+  std::vector<ReadExtent> extents;
+  size_t extentIndex;   // Next chunk to issue
+  uint64_t extentDone;  // Bytes of extents[extentIndex] already issued
+  size_t head;          // Slot holding the oldest read
+  bool headInUse;       // Caller still holds the head slot's buffer
+  DWORD error;
+  uint64_t bytesRead;
+
+  bool Issue(Slot &slot);
+  void Drain();
+};
@@ -0,0 +1,221 @@
+#include "PreparedQuery.h"
+#include "UpcaseTable.h"
+#include <cwctype>
+#include <sstream>
+
+static void ToLower(std::wstring &s) {
+  for (auto &c : s)
+    c = towlower(c);
+}
+
+// Splits a ';' separated list, dropping empty items.
+static std::vector<std::wstring> SplitList(const std::wstring &list,
+                                           bool lower) {
+  std::vector<std::wstring> items;
+  std::wstringstream ss(list);
+  std::wstring item;
+  while (std::getline(ss, item, L';')) {
+    if (item.empty())
+      continue;
+    if (lower)
+      ToLower(item);
+    items.push_back(item);
+  }
+  return items;
+}
+
+// Whitespace separated terms, as SpaceDivided queries split them.
+static std::vector<std::wstring> SplitTerms(const std::wstring &pattern) {
+  std::vector<std::wstring> items;
+  std::wstringstream ss(pattern);
+  std::wstring term;
+  while (ss >> term)
+    items.push_back(term);
+  return items;
+}
+
+PreparedQuery::PreparedQuery(const std::wstring &query,
+                             const SearchOptions &options,
+                             const uint16_t *foldTable)
+    : mode(options.mode), ignoreCase(options.ignoreCase),
+      invert(options.invertMatch), matchAll(query.empty()), prefix(false),
+      pattern(query) {
+  // Regex and full-path queries still fold per compare: the regex engines
+  // have their own case handling and paths are not stored folded
+  useFolded = foldTable && ignoreCase && !options.matchFullPath &&
+              mode != MatchMode_RegEx;
+  foldCase = ignoreCase && !useFolded;
+
+  if (mode == MatchMode_RegEx) {
+    nameRegex.reset(new NameRegex());
+    if (!nameRegex->Compile(query, ignoreCase)) {
+      nameRegex.reset();
+      try {
+        std::regex_constants::syntax_option_type flags =
+            std::regex::ECMAScript;
+        if (ignoreCase)
+          flags |= std::regex::icase;
+        regex.reset(new std::wregex(query, flags));
+      } catch (...) {
+        regex.reset();
+      }
+    }
+  } else {
+    prefix = IsPrefix(query, options);
+    if (prefix)
+      pattern.pop_back();
+    if (useFolded)
+      FoldString(foldTable, pattern);
+    else if (ignoreCase)
+      ToLower(pattern);
+    if (mode == MatchMode_SpaceDivided) {
+      for (const auto &term : SplitTerms(pattern))
+        terms.push_back(SubstringSearch(term, foldCase));
+    } else {
+      substring = SubstringSearch(pattern, foldCase);
+    }
+  }
+
+  extensions = SplitList(options.extensionFilter, !useFolded);
+  if (useFolded) {
+    for (auto &item : extensions)
+      FoldString(foldTable, item);
+  }
+  for (const auto &item : SplitList(options.excludePattern, false))
+    excludes.push_back(SubstringSearch(item, ignoreCase));
+}
+
+bool PreparedQuery::MatchesQuery(const wchar_t *str, size_t length) const {
+  switch (mode) {
+  case MatchMode_Exact:
+    if (prefix ? length < pattern.length() : length != pattern.length())
+      return false;
+    for (size_t i = 0; i < pattern.length(); i++) {
+      wchar_t c = foldCase ? (wchar_t)towlower(str[i]) : str[i];
+      if (c != pattern[i])
+        return false;
+    }
+    return true;
+  case MatchMode_RegEx:
+    if (nameRegex)
+      return nameRegex->Search(str, length);
+    return regex && std::regex_search(str, str + length, *regex);
+  case MatchMode_SpaceDivided:
+    for (const auto &term : terms) {
+      if (!term.Find(str, length))
+        return false;
+    }
+    return true;
+  default:
+    return substring.Find(str, length);
+  }
+}
+
+bool PreparedQuery::Matches(const wchar_t *str, size_t length) const {
+  if (matchAll)
+    return true;
+  return MatchesQuery(str, length) != invert;
+}
+
+bool PreparedQuery::MatchesExtension(const wchar_t *name,
+                                     size_t length) const {
+  if (extensions.empty())
+    return true;
+
+  // No dot means an empty extension, which no list item matches
+  size_t dot = length;
+  while (dot > 0 && name[dot - 1] != L'.')
+    dot--;
+  if (dot == 0)
+    return false;
+  const wchar_t *ext = name + dot;
+  size_t extLength = length - dot;
+
+  for (const auto &item : extensions) {
+    if (item.length() != extLength)
+      continue;
+    size_t i = 0;
+    if (!useFolded) {
+      while (i < extLength && (wchar_t)towlower(ext[i]) == item[i])
+        i++;
+    } else {
+      while (i < extLength && ext[i] == item[i])
+        i++;
+    }
+    if (i == extLength)
+      return true;
+  }
+  return false;
+}
+
+bool PreparedQuery::Narrows(const PreparedQuery &previous) const {
+  // Patterns are only comparable when prepared the same way
+  if (mode != previous.mode || ignoreCase != previous.ignoreCase ||
+      useFolded != previous.useFolded || invert != previous.invert)
+    return false;
+  if (pattern == previous.pattern && matchAll == previous.matchAll &&
+      prefix == previous.prefix)
+    return true;
+  // Inverted matches grow as the query grows; regexes are not compared
+  if (invert || mode == MatchMode_RegEx)
+    return false;
+  if (previous.matchAll)
+    return true;
+  if (matchAll)
+    return false;
+
+  if (mode == MatchMode_Exact) {
+    // Names starting with "read" include "readme" and those starting with it
+    return previous.prefix &&
+           pattern.compare(0, previous.pattern.length(), previous.pattern) ==
+               0;
+  }
+
+  if (mode == MatchMode_SpaceDivided) {
+    // A name holding every new term holds every old one if each old term
+    // lies inside some new term
+    std::vector<std::wstring> current = SplitTerms(pattern);
+    for (const auto &old : SplitTerms(previous.pattern)) {
+      bool covered = false;
+      for (const auto &term : current) {
+        if (term.find(old) != std::wstring::npos) {
+          covered = true;
+          break;
+        }
+      }
+      if (!covered)
+        return false;
+    }
+    return true;
+  }
+  return pattern.find(previous.pattern) != std::wstring::npos;
+}
+
+bool PreparedQuery::IsPrefix(const std::wstring &query,
+                             const SearchOptions &options) {
+  // '*' cannot occur in a file name, so a trailing one is free to mean
+  // "starts with"
+  return options.mode == MatchMode_Exact && !query.empty() &&
+         query.back() == L'*';
+}
+
+std::vector<std::wstring> PreparedQuery::Terms(const std::wstring &query,
+                                               const SearchOptions &options) {
+  if (options.mode == MatchMode_SpaceDivided)
+    return SplitTerms(query);
+  std::vector<std::wstring> terms;
+  std::wstring term = query;
+  if (IsPrefix(query, options))
+    term.pop_back();
+  if (!term.empty())
+    terms.push_back(term);
+  return terms;
+}
+
+bool PreparedQuery::IsExcluded(const std::wstring &fullPath) const {
+  for (const auto &item : excludes) {
+    if (item.Find(fullPath))
+      return true;
+  }
+  return false;
+}
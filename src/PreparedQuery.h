@@ -0,0 +1,85 @@
+#pragma once
+#include "MFTReader.h" // For SearchOptions
+#include "NameRegex.h"
+#include "SubstringSearch.h"
+#include <cwctype>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+// A query and its filters parsed once per search.
+//
+// Holds everything the per-entry checks need in ready-to-compare form: the
+// compiled regex, the SpaceDivided terms and the lowercased pattern, plus the
+// extension and exclude lists split and lowercased. Matching does not
+// allocate. Regex queries use NameRegex, or std::wregex for syntax it does
+// not cover.
+//
+// Given the store's fold table, case-insensitive name queries are folded
+// through it once here and then compared case-sensitively against
+// EntryStore::FoldedName(); see UsesFoldedNames().
+class PreparedQuery {
+public:
+  PreparedQuery(const std::wstring &query, const SearchOptions &options,
+                const uint16_t *foldTable = nullptr);
+
+  // True when Matches() and MatchesExtension() expect folded names.
+  bool UsesFoldedNames() const { return useFolded; }
+
+  // Query match on a name or full path, with invertMatch applied. An empty
+  // query matches everything; an invalid regex matches nothing.
+  bool Matches(const wchar_t *str, size_t length) const;
+  bool Matches(const std::wstring &str) const {
+    return Matches(str.data(), str.length());
+  }
+
+  // False when an extension filter is set and the name's extension is not in
+  // it. Callers skip this for directories.
+  bool MatchesExtension(const wchar_t *name, size_t length) const;
+
+  // True when the path contains any of the exclude patterns.
+  bool IsExcluded(const std::wstring &fullPath) const;
+
+  // True when every string this query matches is also matched by
+  // `previous`, judged from the query text alone: the same query, a
+  // substring query containing the previous one, SpaceDivided terms each
+  // containing one of the previous terms, or an exact query starting with
+  // the previous prefix query. Extension and exclude lists are the
+  // caller's to compare.
+  bool Narrows(const PreparedQuery &previous) const;
+
+  // Whether `query` is an exact query ending in '*', which asks for names
+  // starting with the rest.
+  static bool IsPrefix(const std::wstring &query, const SearchOptions &options);
+  // The terms a name index looks `query` up by: the whole query, or its
+  // whitespace separated words in SpaceDivided mode, with a prefix query's
+  // '*' dropped. Empty when there is nothing to look up.
+  static std::vector<std::wstring> Terms(const std::wstring &query,
+                                         const SearchOptions &options);
+  // One code unit folded as the indexes fold names: through the store's
+  // fold table when it has one, with towlower() otherwise.
+  static uint16_t FoldUnit(const uint16_t *foldTable, wchar_t c) {
+    uint16_t unit = (uint16_t)c;
+    return foldTable ? foldTable[unit] : (uint16_t)towlower(unit);
+  }
+
+private:
+  MatchMode mode;
+  bool ignoreCase;
+  bool invert;
+  bool matchAll; // Empty query
+  bool prefix;   // Exact query ending in '*': names starting with pattern
+  bool useFolded; // Names and query pre-folded, compare exactly
+  bool foldCase;  // Exact and substring compares fold with towlower()
+
+  std::wstring pattern; // Lowercased or folded when ignoring case, for Exact
+  SubstringSearch substring;
+  std::vector<SubstringSearch> terms; // SpaceDivided
+  std::unique_ptr<NameRegex> nameRegex; // Null if the syntax is unsupported
+  std::unique_ptr<std::wregex> regex;   // Fallback, null if invalid
+
+  std::vector<std::wstring> extensions; // Lowercased or folded, no dot
+  std::vector<SubstringSearch> excludes;
+  bool MatchesQuery(const wchar_t *str, size_t length) const;
+};
@@ -0,0 +1,71 @@
+#include "SearchHistory.h"
+#include <algorithm>
+
+SearchHistory::SearchHistory()
+    : generation(0), directoryGeneration(0), complete(false) {}
+
+// Every filter but the query text and how it is matched, which
+// PreparedQuery::Narrows() compares.
+static bool SameFilters(const SearchOptions &a, const SearchOptions &b) {
+  return a.minSize == b.minSize && a.maxSize == b.maxSize &&
+         a.minDate == b.minDate && a.maxDate == b.maxDate &&
+         a.dateField == b.dateField &&
+         a.requiredAttributes == b.requiredAttributes &&
+         a.excludedAttributes == b.excludedAttributes &&
+         a.includeFiles == b.includeFiles &&
+         a.includeFolders == b.includeFolders &&
+         a.extensionFilter == b.extensionFilter &&
+         a.matchFullPath == b.matchFullPath &&
+         a.excludePattern == b.excludePattern;
+}
+
+bool SearchHistory::CanNarrow(const EntryStore &store,
+                              const PreparedQuery &next,
+                              const std::vector<std::wstring> &folders,
+                              const SearchOptions &nextOptions) const {
+  if (!complete || !query || folders != targetFolders ||
+      !SameFilters(nextOptions, options) || !next.Narrows(*query))
+    return false;
+  if (IsCurrent(store))
+    return true;
+  std::vector<uint32_t> changed;
+  return directoryGeneration == store.DirectoryGeneration() &&
+         store.ChangedSince(generation, changed);
+}
+
+std::vector<uint32_t>
+SearchHistory::CandidateIds(const EntryStore &store) const {
+  std::vector<uint32_t> ids;
+  store.ChangedSince(generation, ids);
+  ids.reserve(ids.size() + candidates.size());
+  for (const auto &c : candidates)
+    ids.push_back(c.id);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  // Ids past the store's end were removed since
+  ids.erase(std::lower_bound(ids.begin(), ids.end(), store.IdLimit()),
+            ids.end());
+  return ids;
+}
+
+void SearchHistory::Remember(const EntryStore &store,
+                             std::unique_ptr<PreparedQuery> prepared,
+                             const std::vector<std::wstring> &folders,
+                             const SearchOptions &searchOptions,
+                             std::vector<SearchCandidate> &matched,
+                             bool finished) {
+  query = std::move(prepared);
+  targetFolders = folders;
+  options = searchOptions;
+  candidates.swap(matched);
+  generation = store.Generation();
+  directoryGeneration = store.DirectoryGeneration();
+  complete = finished;
+}
+
+void SearchHistory::Clear() {
+  query.reset();
+  targetFolders.clear();
+  std::vector<SearchCandidate>().swap(candidates);
+  complete = false;
+}
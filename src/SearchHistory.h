@@ -0,0 +1,68 @@
+#pragma once
+#include "EntryStore.h"
+#include "MFTReader.h" // For SearchOptions
+#include "PreparedQuery.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One name a search matched: an entry's own name, one of its hard links or
+// one of its streams (`item`), in the order the search visited them.
+struct SearchCandidate {
+  uint32_t id;
+  uint32_t item;
+  uint32_t kind;
+};
+
+// What the last search over a store matched, so that the next query can
+// re-check just those names when it only narrows the last one: typing "foo"
+// then "foob" can only lose matches, so the second search never needs to
+// visit the rest of the volume. Matches come out in the same order as from a
+// full pass.
+//
+// A search may narrow when the folders and every filter but the query are
+// the same, the last search ran to the end (not cut off by maxResults or
+// cancelled), and the new query PreparedQuery::Narrows() the old one.
+// Anything else is a full pass.
+//
+// Changes to the store since need not end the history: as long as no
+// directory changed (which could move other entries into or out of the
+// folders and filters) and the store's change log reaches back, the entries
+// changed since are searched too, along with the last matches. Candidates()
+// then no longer applies; CandidateIds() lists what to search.
+class SearchHistory {
+public:
+  SearchHistory();
+
+  bool CanNarrow(const EntryStore &store, const PreparedQuery &query,
+                 const std::vector<std::wstring> &targetFolders,
+                 const SearchOptions &options) const;
+  // Whether the store is as the last search left it, so Candidates() alone
+  // is what can match.
+  bool IsCurrent(const EntryStore &store) const {
+    return generation == store.Generation();
+  }
+  const std::vector<SearchCandidate> &Candidates() const {
+    return candidates;
+  }
+  // Ascending ids of the entries the last search matched and of those
+  // changed since, to search like index candidates. Only after CanNarrow().
+  std::vector<uint32_t> CandidateIds(const EntryStore &store) const;
+
+  // Records a finished search. Only a `complete` one can be narrowed later.
+  void Remember(const EntryStore &store, std::unique_ptr<PreparedQuery> query,
+                const std::vector<std::wstring> &targetFolders,
+                const SearchOptions &options,
+                std::vector<SearchCandidate> &matched, bool complete);
+  void Clear();
+
+private:
+  std::unique_ptr<PreparedQuery> query;
+  std::vector<std::wstring> targetFolders;
+  SearchOptions options;
+  std::vector<SearchCandidate> candidates;
+  uint64_t generation;
+  uint64_t directoryGeneration;
+  bool complete;
+};
@@ -0,0 +1,302 @@
+#include "SubstringSearch.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SUBSTRING_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// The vector paths copy the last partial block into a padded buffer; longer
+// needles (only possible against full paths) use the scalar path
+static const size_t MaxVectorNeedle = 256;
+
+SubstringSearch::SubstringSearch() : ignoreCase(false), asciiNeedle(true) {}
+
+SubstringSearch::SubstringSearch(const std::wstring &n, bool icase)
+    : needle(n), ignoreCase(icase), asciiNeedle(true) {
+  for (auto &c : needle) {
+    if (ignoreCase)
+      c = towlower(c);
+    if ((uint32_t)c >= 0x80)
+      asciiNeedle = false;
+  }
+  for (wchar_t c : needle)
+    units.push_back((uint16_t)c);
+  // Beyond 16 bits (only where wchar_t is 32-bit) a character is no unit
+  if (!std::equal(units.begin(), units.end(), needle.begin()))
+    units.clear();
+}
+
+// towlower() comparison over 16- or 32-bit units
+template <typename Char>
+static bool ScalarFind(const Char *str, size_t length,
+                       const std::wstring &needle, bool ignoreCase) {
+  const Char *end = str + length;
+  if (ignoreCase) {
+    return std::search(str, end, needle.begin(), needle.end(),
+                       [](Char c1, wchar_t c2) {
+                         return (wchar_t)towlower(c1) == c2;
+                       }) != end;
+  }
+  return std::search(str, end, needle.begin(), needle.end(),
+                     [](Char c1, wchar_t c2) { return (wchar_t)c1 == c2; }) !=
+         end;
+}
+
+bool SubstringSearch::FindScalar(const wchar_t *str, size_t length) const {
+  return ScalarFind(str, length, needle, ignoreCase);
+}
+
+#ifdef SUBSTRING_SIMD
+
+namespace {
+
+// Outcome of a vector scan; NonAscii sends the caller to the scalar path
+enum ScanResult { Scan_NotFound = 0, Scan_Found, Scan_NonAscii };
+
+// Compares the needle's middle at a candidate, folding ASCII letters. The
+// vector loads only cover the first and last characters, so a non-ASCII
+// unit in between (which towlower() may fold to ASCII, as U+212A KELVIN
+// SIGN to 'k') sends the name to the scalar path.
+template <typename Char>
+static inline ScanResult MiddleEquals(const Char *at, const Char *needle,
+                                      size_t length, bool fold) {
+  for (size_t j = 1; j + 1 < length; j++) {
+    Char c = at[j];
+    if (fold) {
+      if ((uint32_t)c >= 0x80)
+        return Scan_NonAscii;
+      if ((uint32_t)(c - L'A') < 26u)
+        c |= 0x20;
+    }
+    if (c != needle[j])
+      return Scan_NotFound;
+  }
+  return Scan_Found;
+}
+
+// 'A'..'Z' | 0x20; the bias turns the unsigned range test into a signed one
+static inline __m128i Fold128(__m128i v) {
+  __m128i biased = _mm_add_epi16(v, _mm_set1_epi16((short)(0x8000 - L'A')));
+  __m128i upper =
+      _mm_cmplt_epi16(biased, _mm_set1_epi16((short)(0x8000 + 26)));
+  return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi16(0x20)));
+}
+
+static inline bool AnyNonAscii128(__m128i v) {
+  return _mm_movemask_epi8(_mm_cmpeq_epi16(
+             _mm_and_si128(v, _mm_set1_epi16((short)0xFF80)),
+             _mm_setzero_si128())) != 0xFFFF;
+}
+
+// Index of the lowest set bit
+static inline unsigned LowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+// Checks `positions` (at most 8) candidates starting at `block`. The match
+// mask has two bits per lane.
+template <typename Char>
+static ScanResult ScanBlock128(const Char *block, size_t positions,
+                               const Char *needle, size_t m, bool fold,
+                               __m128i first, __m128i last) {
+  __m128i a = _mm_loadu_si128((const __m128i *)block);
+  __m128i b = _mm_loadu_si128((const __m128i *)(block + m - 1));
+  if (fold) {
+    if (AnyNonAscii128(_mm_or_si128(a, b)))
+      return Scan_NonAscii;
+    a = Fold128(a);
+    b = Fold128(b);
+  }
+  uint32_t mask = (uint32_t)_mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi16(a, first), _mm_cmpeq_epi16(b, last)));
+  if (positions < 8)
+    mask &= (1u << (positions * 2)) - 1;
+  while (mask) {
+    ScanResult r = MiddleEquals(block + LowestBit(mask) / 2, needle, m, fold);
+    if (r != Scan_NotFound)
+      return r;
+    mask &= mask - 1;
+    mask &= mask - 1; // Both bits of the lane
+  }
+  return Scan_NotFound;
+}
+
+template <typename Char>
+static ScanResult FindSse2(const Char *str, size_t length, const Char *needle,
+                           size_t m, bool fold) {
+  const size_t Lanes = 8;
+  __m128i first = _mm_set1_epi16((short)needle[0]);
+  __m128i last = _mm_set1_epi16((short)needle[m - 1]);
+  size_t positions = length - m + 1;
+  size_t i = 0;
+  // Full blocks: both loads stay inside the name
+  for (; i + Lanes <= positions; i += Lanes) {
+    ScanResult r = ScanBlock128(str + i, Lanes, needle, m, fold, first, last);
+    if (r != Scan_NotFound)
+      return r;
+  }
+  if (i == positions)
+    return Scan_NotFound;
+  // The rest through a zero-padded copy
+  Char tail[Lanes * 2 + MaxVectorNeedle] = {0};
+  memcpy(tail, str + i, (length - i) * sizeof(Char));
+  return ScanBlock128(tail, positions - i, needle, m, fold, first, last);
+}
+
+// AVX2 counterparts; kept separate so only these need the target attribute
+
+TARGET_AVX2 static inline bool AnyNonAscii256(__m256i v) {
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi16(
+             _mm256_and_si256(v, _mm256_set1_epi16((short)0xFF80)),
+             _mm256_setzero_si256())) != -1;
+}
+
+TARGET_AVX2 static inline __m256i Fold256(__m256i v) {
+  __m256i biased =
+      _mm256_add_epi16(v, _mm256_set1_epi16((short)(0x8000 - L'A')));
+  __m256i upper = _mm256_cmpgt_epi16(
+      _mm256_set1_epi16((short)(0x8000 + 26)), biased);
+  return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi16(0x20)));
+}
+
+template <typename Char>
+TARGET_AVX2 static ScanResult ScanBlock256(const Char *block, size_t positions,
+                                           const Char *needle, size_t m,
+                                           bool fold, __m256i first,
+                                           __m256i last) {
+  __m256i a = _mm256_loadu_si256((const __m256i *)block);
+  __m256i b = _mm256_loadu_si256((const __m256i *)(block + m - 1));
+  if (fold) {
+    if (AnyNonAscii256(_mm256_or_si256(a, b)))
+      return Scan_NonAscii;
+    a = Fold256(a);
+    b = Fold256(b);
+  }
+  uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(
+      _mm256_cmpeq_epi16(a, first), _mm256_cmpeq_epi16(b, last)));
+  if (positions < 16)
+    mask &= (1u << (positions * 2)) - 1;
+  while (mask) {
+    ScanResult r = MiddleEquals(block + LowestBit(mask) / 2, needle, m, fold);
+    if (r != Scan_NotFound)
+      return r;
+    mask &= mask - 1;
+    mask &= mask - 1;
+  }
+  return Scan_NotFound;
+}
+
+template <typename Char>
+TARGET_AVX2 static ScanResult FindAvx2(const Char *str, size_t length,
+                                       const Char *needle, size_t m,
+                                       bool fold) {
+  const size_t Lanes = 16;
+  __m256i first = _mm256_set1_epi16((short)needle[0]);
+  __m256i last = _mm256_set1_epi16((short)needle[m - 1]);
+  size_t positions = length - m + 1;
+  size_t i = 0;
+  for (; i + Lanes <= positions; i += Lanes) {
+    ScanResult r =
+        ScanBlock256(str + i, Lanes, needle, m, fold, first, last);
+    if (r != Scan_NotFound)
+      return r;
+  }
+  // Short names and tails: 8 lanes waste less of the padded block
+  if (i == positions)
+    return Scan_NotFound;
+  return FindSse2(str + i, length - i, needle, m, fold);
+}
+
+static bool CpuHasAvx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// Instantiated for wchar_t where it is 16-bit and for uint16_t
+template <typename Char> struct Kernel {
+  typedef ScanResult (*Function)(const Char *, size_t, const Char *, size_t,
+                                 bool);
+
+  static Function Select() {
+    static const Function kernel =
+        CpuHasAvx2() ? FindAvx2<Char> : FindSse2<Char>;
+    return kernel;
+  }
+};
+
+} // namespace
+
+#endif // SUBSTRING_SIMD
+
+const wchar_t *SubstringSearch::KernelName() {
+#ifdef SUBSTRING_SIMD
+  return Kernel<uint16_t>::Select() == FindAvx2<uint16_t> ? L"AVX2" : L"SSE2";
+#else
+  return L"Scalar";
+#endif
+}
+
+bool SubstringSearch::Find(const wchar_t *str, size_t length) const {
+  size_t m = needle.length();
+  if (m == 0)
+    return true;
+  if (m > length)
+    return false;
+#ifdef SUBSTRING_SIMD
+  if (sizeof(wchar_t) == 2 && m <= MaxVectorNeedle &&
+      (asciiNeedle || !ignoreCase)) {
+    ScanResult r =
+        Kernel<wchar_t>::Select()(str, length, needle.data(), m, ignoreCase);
+    if (r != Scan_NonAscii)
+      return r == Scan_Found;
+  }
+#endif
+  return FindScalar(str, length);
+}
+
+bool SubstringSearch::FindUtf16(const uint16_t *str, size_t length) const {
+  size_t m = needle.length();
+  if (m == 0)
+    return true;
+  if (m > length)
+    return false;
+#ifdef SUBSTRING_SIMD
+  if (units.size() == m && m <= MaxVectorNeedle &&
+      (asciiNeedle || !ignoreCase)) {
+    ScanResult r =
+        Kernel<uint16_t>::Select()(str, length, units.data(), m, ignoreCase);
+    if (r != Scan_NonAscii)
+      return r == Scan_Found;
+  }
+#endif
+  return ScalarFind(str, length, needle, ignoreCase);
+}
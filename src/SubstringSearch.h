@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Substring search over UTF-16 names, the innermost loop of a search.
+//
+// Candidates are found 8 (SSE2) or 16 (AVX2, when the CPU has it) positions
+// at a time by comparing the needle's first and last characters against two
+// shifted loads; only positions where both agree compare the middle. When
+// ignoring case, ASCII letters are folded in the vector registers. A name or
+// needle with any non-ASCII character takes the scalar path instead, which
+// folds with towlower() exactly like the reference below.
+class SubstringSearch {
+public:
+  SubstringSearch();
+  SubstringSearch(const std::wstring &needle, bool ignoreCase);
+
+  bool Find(const wchar_t *str, size_t length) const;
+  bool Find(const std::wstring &str) const {
+    return Find(str.data(), str.length());
+  }
+
+  // Find() over UTF-16 code units: what Find() runs where wchar_t is
+  // 16-bit, so the vector kernel can be checked on any platform.
+  bool FindUtf16(const uint16_t *str, size_t length) const;
+
+  // Plain towlower() comparison, kept as the reference Find() must agree
+  // with.
+  bool FindScalar(const wchar_t *str, size_t length) const;
+
+  // The vector kernel in use: "AVX2", "SSE2" or "Scalar".
+  static const wchar_t *KernelName();
+
+private:
+  std::wstring needle; // Lowercased when ignoring case
+  bool ignoreCase;
+  bool asciiNeedle;
+  std::vector<uint16_t> units; // The needle as UTF-16, for FindUtf16()
+};
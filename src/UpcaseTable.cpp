@@ -0,0 +1,30 @@
+#include "UpcaseTable.h"
+#include <cwctype>
+
+std::vector<uint16_t> DefaultUpcaseTable() {
+  static const std::vector<uint16_t> table = [] {
+    std::vector<uint16_t> t(UpcaseTableSize);
+    for (uint32_t u = 0; u < UpcaseTableSize; u++) {
+      wint_t upper = towupper((wint_t)u);
+      t[u] = upper < UpcaseTableSize ? (uint16_t)upper : (uint16_t)u;
+    }
+    return t;
+  }();
+  return table;
+}
+
+bool ParseUpcaseTable(const uint8_t *data, size_t size,
+                      std::vector<uint16_t> &table) {
+  if (size < UpcaseTableSize * 2)
+    return false;
+  table.resize(UpcaseTableSize);
+  for (size_t i = 0; i < UpcaseTableSize; i++)
+    table[i] = (uint16_t)(data[i * 2] | (data[i * 2 + 1] << 8));
+  // Every real table maps 'a' to 'A'; anything else is not $UpCase
+  return table[L'a'] == L'A' && table[L'A'] == L'A';
+}
+
+void FoldString(const uint16_t *table, std::wstring &s) {
+  for (auto &c : s)
+    c = (wchar_t)table[(uint16_t)c];
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Case folding tables for EntryStore's folded name column. A table maps every
+// UTF-16 code unit to its uppercase form, the way NTFS $UpCase does.
+
+// Entries in a complete table (and words in $UpCase).
+const size_t UpcaseTableSize = 0x10000;
+
+// Table built from towupper(), for volumes that carry none.
+std::vector<uint16_t> DefaultUpcaseTable();
+
+// Reads a little-endian $UpCase stream. Fails unless it holds a whole table.
+bool ParseUpcaseTable(const uint8_t *data, size_t size,
+                      std::vector<uint16_t> &table);
+
+// Maps `s` through `table` in place.
+void FoldString(const uint16_t *table, std::wstring &s);
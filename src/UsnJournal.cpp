@@ -0,0 +1,228 @@
+#include "UsnJournal.h"
+#include "EntryStore.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+template <typename T> T ReadLE(const uint8_t *p) {
+  T value;
+  memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+const uint64_t RecordNumberMask = 0xFFFFFFFFFFFFULL;
+const uint32_t DirectoryAttribute = 0x10; // FILE_ATTRIBUTE_DIRECTORY
+
+// Field offsets of USN_RECORD_V2 / USN_RECORD_V3
+struct UsnLayout {
+  size_t fileRef;
+  size_t parentRef;
+  size_t usn;
+  size_t timeStamp;
+  size_t reason;
+  size_t attributes;
+  size_t nameLength;
+  size_t nameOffset;
+  size_t headerSize; // Offset of FileName
+};
+
+const UsnLayout LayoutV2 = {8, 16, 24, 32, 40, 52, 56, 58, 60};
+// V3 uses 128-bit FILE_ID_128 references; NTFS keeps the record number in the
+// low 48 bits of the first 8 bytes.
+const UsnLayout LayoutV3 = {8, 24, 40, 48, 56, 68, 72, 74, 76};
+
+} // namespace
+
+bool ParseUsnRecords(const uint8_t *data, size_t size,
+                     std::vector<UsnRecord> &out, std::wstring *error) {
+  size_t offset = 0;
+  while (offset + 8 <= size) {
+    uint32_t recordLength = ReadLE<uint32_t>(data + offset);
+    if (recordLength == 0) {
+      // Journal pages are zero-padded at the end
+      break;
+    }
+    if (recordLength < 8 || recordLength > size - offset) {
+      if (error)
+        *error = L"USN record length out of range at offset " +
+                 std::to_wstring(offset);
+      return false;
+    }
+
+    const uint8_t *rec = data + offset;
+    uint16_t major = ReadLE<uint16_t>(rec + 4);
+    const UsnLayout *layout = nullptr;
+    if (major == 2)
+      layout = &LayoutV2;
+    else if (major == 3)
+      layout = &LayoutV3;
+
+    if (layout) {
+      if (recordLength < layout->headerSize) {
+        if (error)
+          *error = L"Truncated USN record at offset " + std::to_wstring(offset);
+        return false;
+      }
+      uint16_t nameLength = ReadLE<uint16_t>(rec + layout->nameLength);
+      uint16_t nameOffset = ReadLE<uint16_t>(rec + layout->nameOffset);
+      if ((size_t)nameOffset + nameLength > recordLength || (nameLength & 1)) {
+        if (error)
+          *error = L"USN file name out of range at offset " +
+                   std::to_wstring(offset);
+        return false;
+      }
+
+      UsnRecord r;
+      r.majorVersion = major;
+      r.fileRef = ReadLE<uint64_t>(rec + layout->fileRef) & RecordNumberMask;
+      r.parentRef =
+          ReadLE<uint64_t>(rec + layout->parentRef) & RecordNumberMask;
+      r.usn = ReadLE<int64_t>(rec + layout->usn);
+      r.timeStamp = ReadLE<uint64_t>(rec + layout->timeStamp);
+      r.reason = ReadLE<uint32_t>(rec + layout->reason);
+      r.fileAttributes = ReadLE<uint32_t>(rec + layout->attributes);
+
+      // UTF-16 code units, widened one by one so this also works where
+      // wchar_t is 32-bit
+      size_t units = nameLength / 2;
+      r.name.resize(units);
+      for (size_t i = 0; i < units; i++)
+        r.name[i] = (wchar_t)ReadLE<uint16_t>(rec + nameOffset + i * 2);
+
+      out.push_back(std::move(r));
+    }
+    // V4 range-tracking records carry no name and are skipped
+
+    // Records are 8-byte aligned
+    offset += (recordLength + 7) & ~(size_t)7;
+  }
+  return true;
+}
+
+bool ParseUsnReadBuffer(const uint8_t *data, size_t size, int64_t &nextUsn,
+                        std::vector<UsnRecord> &out, std::wstring *error) {
+  if (size < sizeof(int64_t)) {
+    if (error)
+      *error = L"USN read buffer too small";
+    return false;
+  }
+  nextUsn = ReadLE<int64_t>(data);
+  return ParseUsnRecords(data + sizeof(int64_t), size - sizeof(int64_t), out,
+                         error);
+}
+
+void UsnChangeSet::Add(const UsnRecord &record) {
+  auto it = files.find(record.fileRef);
+  if (it == files.end()) {
+    State s;
+    s.deleted = false;
+    s.named = false;
+    s.created = false;
+    s.isDirectory = false;
+    s.parentRef = 0;
+    s.timeStamp = 0;
+    s.fileAttributes = 0;
+    s.firstSeen = files.size();
+    it = files.emplace(record.fileRef, std::move(s)).first;
+  }
+  State &s = it->second;
+  s.timeStamp = record.timeStamp;
+  s.fileAttributes = record.fileAttributes;
+  s.isDirectory = (record.fileAttributes & DirectoryAttribute) != 0;
+
+  if (record.reason & UsnReason_FileDelete) {
+    s.deleted = true;
+    s.named = false;
+    s.created = false;
+    return;
+  }
+
+  // A create after a delete means the record number was reused
+  if (record.reason & (UsnReason_FileCreate | UsnReason_RenameNewName)) {
+    s.deleted = false;
+    s.named = true;
+    if (record.reason & UsnReason_FileCreate)
+      s.created = true;
+    s.parentRef = record.parentRef;
+    s.name = record.name;
+  } else if (!(record.reason & UsnReason_RenameOldName) && !s.named &&
+             !s.deleted) {
+    // Data, attribute or link changes on a file we already know about; keep
+    // the name the record reports in case the index has never seen it.
+    s.parentRef = record.parentRef;
+    s.name = record.name;
+  }
+}
+
+void UsnChangeSet::Add(const std::vector<UsnRecord> &records) {
+  for (const auto &r : records)
+    Add(r);
+}
+
+void UsnChangeSet::Clear() { files.clear(); }
+
+std::vector<UsnFileChange> UsnChangeSet::Changes() const {
+  std::vector<UsnFileChange> changes(files.size());
+  for (const auto &pair : files) {
+    const State &s = pair.second;
+    UsnFileChange &c = changes[s.firstSeen];
+    c.fileRef = pair.first;
+    c.created = s.created;
+    c.isDirectory = s.isDirectory;
+    c.timeStamp = s.timeStamp;
+    c.fileAttributes = s.fileAttributes;
+    c.parentRef = s.parentRef;
+    if (s.deleted) {
+      c.action = UsnAction_Remove;
+    } else if (s.named) {
+      c.action = UsnAction_Upsert;
+      c.name = s.name;
+    } else {
+      c.action = UsnAction_Refresh;
+      c.name = s.name;
+    }
+  }
+  return changes;
+}
+
+bool ApplyUsnChanges(EntryStore &entries,
+                     const std::vector<UsnFileChange> &changes,
+                     const std::function<bool(uint64_t fileRef)> &refresh) {
+  bool complete = true;
+  for (const auto &change : changes) {
+    uint32_t id = (uint32_t)change.fileRef;
+    if (change.action == UsnAction_Remove) {
+      entries.Remove(id);
+      continue;
+    }
+    if (refresh && refresh(change.fileRef))
+      continue;
+
+    if (change.action == UsnAction_Upsert) {
+      // A reused record number still holds the deleted file until here
+      bool known = entries.IsValid(id) && !change.created;
+      // Set() would drop the other names and write this one over the
+      // primary name, whichever link was renamed
+      if (known && (entries.FirstLink(id) != EntryStore::NoLink ||
+                    entries.FirstStream(id) != EntryStore::NoStream)) {
+        complete = false;
+        continue;
+      }
+      EntryTimes times = known ? entries.Times(id) : EntryTimes();
+      uint64_t allocatedSize = known ? entries.AllocatedSize(id) : 0;
+      entries.Set(id, (uint32_t)change.parentRef, change.name.c_str(),
+                  change.name.length(), known ? entries.Size(id) : 0,
+                  known ? entries.LastWriteTime(id) : change.timeStamp,
+                  change.isDirectory);
+      entries.SetAllocatedSize(id, allocatedSize);
+      entries.SetTimes(id, times);
+      entries.SetAttributes(id, change.fileAttributes);
+    } else if (entries.IsValid(id)) {
+      // Data, attribute or hard link change: the file keeps its own name
+      entries.SetLastWriteTime(id, change.timeStamp);
+      entries.SetAttributes(id, change.fileAttributes);
+    }
+  }
+  return complete;
+}
@@ -0,0 +1,110 @@
+#pragma once
+// USN change journal parsing and change coalescing.
+//
+// Deliberately free of Windows headers: records are decoded from raw bytes,
+// so recorded USN_RECORD_V2/V3 streams can be replayed on any platform.
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class EntryStore;
+
+// USN_REASON_* values from winioctl.h
+const uint32_t UsnReason_DataOverwrite = 0x00000001;
+const uint32_t UsnReason_DataExtend = 0x00000002;
+const uint32_t UsnReason_DataTruncation = 0x00000004;
+const uint32_t UsnReason_NamedDataOverwrite = 0x00000010;
+const uint32_t UsnReason_NamedDataExtend = 0x00000020;
+const uint32_t UsnReason_NamedDataTruncation = 0x00000040;
+const uint32_t UsnReason_FileCreate = 0x00000100;
+const uint32_t UsnReason_FileDelete = 0x00000200;
+const uint32_t UsnReason_RenameOldName = 0x00001000;
+const uint32_t UsnReason_RenameNewName = 0x00002000;
+const uint32_t UsnReason_BasicInfoChange = 0x00008000;
+const uint32_t UsnReason_HardLinkChange = 0x00010000;
+const uint32_t UsnReason_StreamChange = 0x00200000;
+const uint32_t UsnReason_Close = 0x80000000;
+
+// One decoded USN_RECORD_V2 or USN_RECORD_V3.
+struct UsnRecord {
+  uint16_t majorVersion;
+  uint64_t fileRef;   // MFT record number (low 48 bits of the reference)
+  uint64_t parentRef; // MFT record number of the parent directory
+  int64_t usn;
+  uint64_t timeStamp; // FILETIME
+  uint32_t reason;    // UsnReason_* bits
+  uint32_t fileAttributes;
+  std::wstring name;
+};
+
+// Decodes a packed sequence of USN records (as stored in $UsnJrnl:$J).
+// Unknown record versions are skipped; returns false on malformed data,
+// keeping the records decoded before the error.
+bool ParseUsnRecords(const uint8_t *data, size_t size,
+                     std::vector<UsnRecord> &out,
+                     std::wstring *error = nullptr);
+
+// Decodes FSCTL_READ_USN_JOURNAL output: the next USN followed by records.
+bool ParseUsnReadBuffer(const uint8_t *data, size_t size, int64_t &nextUsn,
+                        std::vector<UsnRecord> &out,
+                        std::wstring *error = nullptr);
+
+enum UsnAction {
+  UsnAction_Remove = 0, // File is gone
+  UsnAction_Upsert,     // File exists under (parentRef, name)
+  UsnAction_Refresh     // Name unchanged, size/time/attributes changed
+};
+
+// Net effect of all journal records for one file.
+struct UsnFileChange {
+  UsnAction action;
+  uint64_t fileRef;
+  uint64_t parentRef; // Upsert only
+  std::wstring name;  // Upsert only
+  bool created;       // Upsert of a new file: nothing of an older one holds
+  bool isDirectory;
+  uint64_t timeStamp;      // Time of the last record seen for the file
+  uint32_t fileAttributes; // As of that record
+};
+
+// Folds a journal stream into one action per file, so applying it costs
+// O(changed files) regardless of how many records each file produced.
+class UsnChangeSet {
+public:
+  void Add(const UsnRecord &record);
+  void Add(const std::vector<UsnRecord> &records);
+  void Clear();
+  bool Empty() const { return files.empty(); }
+
+  // Changes in the order files were first seen in the stream.
+  std::vector<UsnFileChange> Changes() const;
+
+private:
+  struct State {
+    bool deleted;
+    bool named;
+    bool created;
+    bool isDirectory;
+    uint64_t parentRef;
+    std::wstring name;
+    uint64_t timeStamp;
+    uint32_t fileAttributes;
+    size_t firstSeen;
+  };
+  std::unordered_map<uint64_t, State> files;
+};
+
+// Applies coalesced changes to `entries`. `refresh`, when set, re-reads a
+// created or modified file from the volume and returns true once it stored
+// it; otherwise the journal's name and time are used, keeping the size and
+// times already known for the file. The journal only names the link a
+// change came through, so a renamed file with further hard links or named
+// streams is left as it was without `refresh`, and false returned: the
+// index then needs a rescan.
+bool ApplyUsnChanges(EntryStore &entries,
+                     const std::vector<UsnFileChange> &changes,
+                     const std::function<bool(uint64_t fileRef)> &refresh =
+                         nullptr);
@@ -0,0 +1,549 @@
+#include "VolumeIndex.h"
+#include "IndexSnapshot.h"
+
+VolumeIndex::VolumeIndex()
+    : invalidateAll(false), rescanDrives(0), cancelToken(nullptr) {}
+
+static uint32_t DriveBit(wchar_t drive) {
+  return drive >= L'A' && drive <= L'Z' ? 1u << (drive - L'A') : 0;
+}
+
+VolumeIndex::~VolumeIndex() {}
+
+static VolumeFileSystem DetectFileSystem(const wchar_t *fsName) {
+  if (wcscmp(fsName, L"NTFS") == 0)
+    return VolumeFs_NTFS;
+  if (wcscmp(fsName, L"FAT") == 0 || wcscmp(fsName, L"FAT32") == 0)
+    return VolumeFs_FAT;
+  if (wcscmp(fsName, L"exFAT") == 0)
+    return VolumeFs_exFAT;
+  return VolumeFs_Unknown;
+}
+
+bool VolumeIndex::IsLoaded(wchar_t drive) const {
+  return volumes.find(towupper(drive)) != volumes.end();
+}
+
+VolumeFileSystem VolumeIndex::GetFileSystem(wchar_t drive) const {
+  auto it = volumes.find(towupper(drive));
+  return it == volumes.end() ? VolumeFs_Unknown : it->second.fs;
+}
+
+const EntryStore *VolumeIndex::GetEntries(wchar_t drive) const {
+  auto it = volumes.find(towupper(drive));
+  if (it == volumes.end())
+    return nullptr;
+  const Volume &vol = it->second;
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    return &vol.ntfs->GetEntries();
+  case VolumeFs_FAT:
+    return &vol.fat->GetEntries();
+  case VolumeFs_exFAT:
+    return &vol.exfat->GetEntries();
+  default:
+    return nullptr;
+  }
+}
+
+const NameTrigrams *VolumeIndex::GetTrigrams(wchar_t drive) const {
+  auto it = volumes.find(towupper(drive));
+  if (it == volumes.end())
+    return nullptr;
+  const Volume &vol = it->second;
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    return vol.ntfs->GetTrigrams();
+  case VolumeFs_FAT:
+    return vol.fat->GetTrigrams();
+  case VolumeFs_exFAT:
+    return vol.exfat->GetTrigrams();
+  default:
+    return nullptr;
+  }
+}
+
+const NameSuffixArray *VolumeIndex::GetSuffixes(wchar_t drive) const {
+  auto it = volumes.find(towupper(drive));
+  if (it == volumes.end())
+    return nullptr;
+  const Volume &vol = it->second;
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    return vol.ntfs->GetSuffixes();
+  case VolumeFs_FAT:
+    return vol.fat->GetSuffixes();
+  case VolumeFs_exFAT:
+    return vol.exfat->GetSuffixes();
+  default:
+    return nullptr;
+  }
+}
+
+// Settings every reader takes alike, whether it scans or loads a snapshot.
+template <typename Reader>
+void VolumeIndex::ConfigureReader(Reader &reader) const {
+  if (traceCallback)
+    reader.SetTraceCallback(traceCallback);
+  reader.SetFoldNames(policy.foldNames);
+  reader.SetTrigramIndex(policy.trigramIndex);
+  reader.SetSuffixIndex(policy.suffixIndex);
+  reader.SetNameOrder(policy.nameOrder);
+  reader.SetCancelToken(cancelToken);
+}
+
+void VolumeIndex::Invalidate(wchar_t drive) { volumes.erase(towupper(drive)); }
+
+void VolumeIndex::SetPolicy(const IndexPolicy &p) {
+  bool streamsChanged = p.indexStreams != policy.indexStreams;
+  policy = p;
+  // NTFS indexes hold streams or not from their scan on
+  if (streamsChanged) {
+    for (auto it = volumes.begin(); it != volumes.end();) {
+      if (it->second.ntfs)
+        it = volumes.erase(it);
+      else
+        ++it;
+    }
+  }
+  // Folding and the name indexes apply to what is already loaded; the rest
+  // takes effect on the next scan or snapshot load
+  for (auto &item : volumes) {
+    Volume &vol = item.second;
+    if (vol.ntfs)
+      ConfigureReader(*vol.ntfs);
+    if (vol.fat)
+      ConfigureReader(*vol.fat);
+    if (vol.exfat)
+      ConfigureReader(*vol.exfat);
+  }
+}
+
+void VolumeIndex::SetCancelToken(const CancelToken *token) {
+  cancelToken = token;
+  for (auto &item : volumes) {
+    Volume &vol = item.second;
+    if (vol.ntfs)
+      vol.ntfs->SetCancelToken(token);
+    if (vol.fat)
+      vol.fat->SetCancelToken(token);
+    if (vol.exfat)
+      vol.exfat->SetCancelToken(token);
+  }
+}
+
+static uint64_t CurrentFileTime() {
+  FILETIME ft;
+  GetSystemTimeAsFileTime(&ft);
+  return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+bool VolumeIndex::IsStale(const Volume &vol, VolumeFileSystem fs, DWORD serial,
+                          int codePage) const {
+  if (vol.fs != fs)
+    return true;
+  if (policy.checkVolumeSerial && vol.serial != serial)
+    return true;
+  // FAT short names are decoded with the code page at scan time
+  if (fs == VolumeFs_FAT && vol.codePage != codePage)
+    return true;
+  if (policy.maxAgeSeconds > 0 &&
+      GetTickCount64() - vol.scannedAt >
+          (ULONGLONG)policy.maxAgeSeconds * 1000)
+    return true;
+  return false;
+}
+
+bool VolumeIndex::Ensure(wchar_t drive, int codePage,
+                         void (*progressCallback)(int, int, void *),
+                         void *userData, IndexSource *source) {
+  drive = towupper(drive);
+  if (source)
+    *source = IndexSource_Cached;
+  lastError = L"";
+
+  // A refresh must not come back from the snapshots it means to replace
+  if (invalidateAll.exchange(false)) {
+    volumes.clear();
+    rescanDrives = DriveBit(L'Z') | (DriveBit(L'Z') - 1);
+  }
+
+  wchar_t driveRoot[] = {drive, L':', L'\\', L'\0'};
+  wchar_t fsName[MAX_PATH];
+  DWORD serial = 0;
+  if (!GetVolumeInformationW(driveRoot, NULL, 0, &serial, NULL, NULL, fsName,
+                             MAX_PATH)) {
+    lastError = L"Failed to query volume information";
+    volumes.erase(drive);
+    return false;
+  }
+
+  VolumeFileSystem fs = DetectFileSystem(fsName);
+  if (fs == VolumeFs_Unknown) {
+    lastError = std::wstring(L"Unsupported file system: ") + fsName;
+    volumes.erase(drive);
+    return false;
+  }
+
+  if (ReuseCached(drive, fs, serial, codePage))
+    return true;
+
+  Volume vol;
+  vol.fs = fs;
+  vol.serial = serial;
+  vol.codePage = codePage;
+
+  if (!snapshotDir.empty() && !(rescanDrives & DriveBit(drive)) &&
+      LoadSnapshot(drive, vol)) {
+    volumes[drive] = std::move(vol);
+    if (source)
+      *source = IndexSource_Snapshot;
+    return true;
+  }
+
+  if (traceCallback)
+    traceCallback(L"Index: Scanning " + std::wstring(1, drive) + L": (" +
+                  fsName + L")");
+  if (!ScanVolume(drive, vol, progressCallback, userData)) {
+    volumes.erase(drive);
+    return false;
+  }
+  vol.scannedAt = GetTickCount64();
+  rescanDrives &= ~DriveBit(drive);
+  if (!snapshotDir.empty())
+    SaveSnapshot(drive, vol);
+  volumes[drive] = std::move(vol);
+  if (source)
+    *source = IndexSource_Scan;
+  return true;
+}
+
+bool VolumeIndex::EnsureCached(wchar_t drive, int codePage) {
+  drive = towupper(drive);
+  lastError = L"";
+  if (invalidateAll || volumes.find(drive) == volumes.end())
+    return false;
+
+  wchar_t driveRoot[] = {drive, L':', L'\\', L'\0'};
+  wchar_t fsName[MAX_PATH];
+  DWORD serial = 0;
+  if (!GetVolumeInformationW(driveRoot, NULL, 0, &serial, NULL, NULL, fsName,
+                             MAX_PATH))
+    return false;
+  return ReuseCached(drive, DetectFileSystem(fsName), serial, codePage);
+}
+
+bool VolumeIndex::ReuseCached(wchar_t drive, VolumeFileSystem fs, DWORD serial,
+                              int codePage) {
+  auto it = volumes.find(drive);
+  if (it == volumes.end())
+    return false;
+  Volume &cached = it->second;
+  bool fresh = !IsStale(cached, fs, serial, codePage);
+  if (fs == VolumeFs_NTFS && cached.fs == fs && cached.serial == serial) {
+    // With the journal the index is caught up in place whatever its age;
+    // without it, an index that merely aged out is still good if nothing
+    // changed.
+    bool updated = false;
+    if (policy.useJournal && cached.ntfs->GetScanStamp().journalId != 0)
+      updated = fresh = UpdateNtfsFromJournal(cached);
+    else if (!fresh)
+      updated = fresh = IsNtfsUnchanged(cached);
+    if (updated)
+      cached.scannedAt = GetTickCount64();
+  }
+  if (fresh && traceCallback)
+    traceCallback(L"Index: Reusing cached index for " +
+                  std::wstring(1, drive) + L":");
+  return fresh;
+}
+
+bool VolumeIndex::IsNtfsUnchanged(Volume &vol) {
+  if (!vol.ntfs || !vol.ntfs->ReopenVolume())
+    return false;
+  NtfsChangeStamp current;
+  bool unchanged = vol.ntfs->QueryChangeStamp(current) &&
+                   current == vol.ntfs->GetScanStamp();
+  vol.ntfs->ReleaseVolume();
+  return unchanged;
+}
+
+bool VolumeIndex::UpdateNtfsFromJournal(Volume &vol) {
+  if (!vol.ntfs->ReopenVolume())
+    return false;
+  size_t changes = 0;
+  bool ok = vol.ntfs->UpdateFromJournal(&changes);
+  if (traceCallback)
+    traceCallback(ok ? L"Index: Applied " + std::to_wstring(changes) +
+                           L" journal changes"
+                     : L"Index: Journal update failed (" +
+                           vol.ntfs->GetLastErrorMessage() + L")");
+  vol.ntfs->ReleaseVolume();
+  return ok;
+}
+
+bool VolumeIndex::ScanVolume(wchar_t drive, Volume &vol,
+                             void (*progressCallback)(int, int, void *),
+                             void *userData) {
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    vol.ntfs.reset(new MFTReader());
+    ConfigureReader(*vol.ntfs);
+    vol.ntfs->SetReadAhead(policy.scanChunkKB * 1024, policy.scanQueueDepth);
+    vol.ntfs->SetParseThreads(policy.parseThreads);
+    vol.ntfs->SetIndexStreams(policy.indexStreams);
+    if (!vol.ntfs->Initialize(drive) ||
+        !vol.ntfs->Scan(progressCallback, userData, fileFoundCallback)) {
+      lastError = vol.ntfs->GetLastErrorMessage();
+      return false;
+    }
+    vol.ntfs->ReleaseVolume();
+    return true;
+  case VolumeFs_FAT:
+    vol.fat.reset(new FatReader());
+    ConfigureReader(*vol.fat);
+    if (!vol.fat->Initialize(drive) ||
+        !vol.fat->Scan(vol.codePage, progressCallback, userData,
+                       fileFoundCallback)) {
+      lastError = vol.fat->GetLastErrorMessage();
+      return false;
+    }
+    vol.fat->ReleaseVolume();
+    return true;
+  case VolumeFs_exFAT:
+    vol.exfat.reset(new exFatReader());
+    ConfigureReader(*vol.exfat);
+    if (!vol.exfat->Initialize(drive) ||
+        !vol.exfat->Scan(progressCallback, userData, fileFoundCallback)) {
+      lastError = vol.exfat->GetLastErrorMessage();
+      return false;
+    }
+    vol.exfat->ReleaseVolume();
+    return true;
+  default:
+    return false;
+  }
+}
+
+std::vector<FileResult> VolumeIndex::Search(wchar_t drive,
+                                            const std::wstring &query,
+                                            const std::wstring &targetFolder,
+                                            const SearchOptions &options,
+                                            int maxResults) {
+  std::vector<std::wstring> targets;
+  if (!targetFolder.empty())
+    targets.push_back(targetFolder);
+  return Search(drive, query, targets, options, maxResults);
+}
+
+std::vector<FileResult>
+VolumeIndex::Search(wchar_t drive, const std::wstring &query,
+                    const std::vector<std::wstring> &targetFolders,
+                    const SearchOptions &options, int maxResults) {
+  auto it = volumes.find(towupper(drive));
+  if (it == volumes.end())
+    return std::vector<FileResult>();
+
+  Volume &vol = it->second;
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    return vol.ntfs->Search(query, targetFolders, options, maxResults);
+  case VolumeFs_FAT:
+    return vol.fat->Search(query, targetFolders, vol.codePage, options,
+                           maxResults);
+  case VolumeFs_exFAT:
+    return vol.exfat->Search(query, targetFolders, options, maxResults);
+  default:
+    return std::vector<FileResult>();
+  }
+}
+
+size_t VolumeIndex::Search(wchar_t drive, const std::wstring &query,
+                           const std::vector<std::wstring> &targetFolders,
+                           const SearchOptions &options, int maxResults,
+                           const ResultCallback &onResults) {
+  auto it = volumes.find(towupper(drive));
+  if (it == volumes.end())
+    return 0;
+
+  Volume &vol = it->second;
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    return vol.ntfs->Search(query, targetFolders, options, maxResults,
+                            onResults);
+  case VolumeFs_FAT:
+    return vol.fat->Search(query, targetFolders, vol.codePage, options,
+                           maxResults, onResults);
+  case VolumeFs_exFAT:
+    return vol.exfat->Search(query, targetFolders, options, maxResults,
+                             onResults);
+  default:
+    return 0;
+  }
+}
+
+std::vector<DirectoryUsage> VolumeIndex::DiskUsage(wchar_t drive,
+                                                   const std::wstring &folder,
+                                                   size_t count) {
+  auto it = volumes.find(towupper(drive));
+  if (it == volumes.end())
+    return std::vector<DirectoryUsage>();
+
+  Volume &vol = it->second;
+  switch (vol.fs) {
+  case VolumeFs_NTFS:
+    return vol.ntfs->DiskUsage(folder, count);
+  case VolumeFs_FAT:
+    return vol.fat->DiskUsage(folder, count);
+  case VolumeFs_exFAT:
+    return vol.exfat->DiskUsage(folder, count);
+  default:
+    return std::vector<DirectoryUsage>();
+  }
+}
+
+std::wstring VolumeIndex::SnapshotPath(wchar_t drive, DWORD serial) const {
+  return snapshotDir + L"\\" + SnapshotFileName(drive, serial);
+}
+
+bool VolumeIndex::LoadSnapshot(wchar_t drive, Volume &vol) {
+  SnapshotView view;
+  std::wstring error;
+  if (!view.Open(SnapshotPath(drive, vol.serial), error)) {
+    if (traceCallback)
+      traceCallback(L"Index: No usable snapshot (" + error + L")");
+    return false;
+  }
+
+  SnapshotInfo info = view.Info();
+  if (info.fileSystem != (uint32_t)vol.fs || info.volumeSerial != vol.serial ||
+      (vol.fs == VolumeFs_FAT && info.codePage != (uint32_t)vol.codePage)) {
+    if (traceCallback)
+      traceCallback(L"Index: Snapshot belongs to a different volume state");
+    return false;
+  }
+
+  bool resave = false;
+  uint64_t now = CurrentFileTime();
+  ULONGLONG ageMs =
+      now > info.createdAt ? (ULONGLONG)((now - info.createdAt) / 10000) : 0;
+
+  switch (vol.fs) {
+  case VolumeFs_NTFS: {
+    // NTFS snapshots are trusted while the volume is provably unchanged, or
+    // while the journal still holds every change made since they were saved
+    vol.ntfs.reset(new MFTReader());
+    ConfigureReader(*vol.ntfs);
+    vol.ntfs->SetIndexStreams(policy.indexStreams);
+    if (((info.options & SnapshotOption_Streams) != 0) !=
+        policy.indexStreams) {
+      if (traceCallback)
+        traceCallback(L"Index: Snapshot was taken with other stream settings");
+      return false;
+    }
+    if (!vol.ntfs->Initialize(drive))
+      return false;
+    NtfsChangeStamp current;
+    bool queried = vol.ntfs->QueryChangeStamp(current);
+    bool unchanged = queried && current.mftLsn == info.mftLsn &&
+                     current.journalId == info.journalId &&
+                     current.journalUsn == info.journalUsn;
+    bool replayable = queried && policy.useJournal && info.journalId != 0 &&
+                      current.journalId == info.journalId;
+    if (!unchanged && !replayable) {
+      vol.ntfs->ReleaseVolume();
+      if (traceCallback)
+        traceCallback(L"Index: Snapshot is out of date");
+      return false;
+    }
+    vol.ntfs->ImportSnapshot(view, drive);
+    if (!unchanged) {
+      size_t changes = 0;
+      if (!vol.ntfs->UpdateFromJournal(&changes)) {
+        vol.ntfs->ReleaseVolume();
+        if (traceCallback)
+          traceCallback(L"Index: Snapshot is out of date (" +
+                        vol.ntfs->GetLastErrorMessage() + L")");
+        return false;
+      }
+      if (traceCallback)
+        traceCallback(L"Index: Applied " + std::to_wstring(changes) +
+                      L" journal changes to snapshot");
+      // Save the caught-up index so the next start replays less
+      if (changes > 0)
+        resave = true;
+    }
+    vol.ntfs->ReleaseVolume();
+    ageMs = 0;
+    break;
+  }
+  case VolumeFs_FAT:
+  case VolumeFs_exFAT:
+    // FAT has no change journal, so fall back to the age policy
+    if (policy.maxAgeSeconds > 0 &&
+        ageMs > (ULONGLONG)policy.maxAgeSeconds * 1000) {
+      if (traceCallback)
+        traceCallback(L"Index: Snapshot is too old");
+      return false;
+    }
+    if (vol.fs == VolumeFs_FAT) {
+      vol.fat.reset(new FatReader());
+      ConfigureReader(*vol.fat);
+      vol.fat->ImportSnapshot(view, drive);
+    } else {
+      vol.exfat.reset(new exFatReader());
+      ConfigureReader(*vol.exfat);
+      vol.exfat->ImportSnapshot(view, drive);
+    }
+    break;
+  default:
+    return false;
+  }
+
+  ULONGLONG nowTick = GetTickCount64();
+  vol.scannedAt = nowTick > ageMs ? nowTick - ageMs : 0;
+  if (traceCallback)
+    traceCallback(L"Index: Loaded snapshot with " +
+                  std::to_wstring(view.Count()) + L" entries");
+  if (resave) {
+    view.Close();
+    SaveSnapshot(drive, vol);
+  }
+  return true;
+}
+
+void VolumeIndex::SaveSnapshot(wchar_t drive, const Volume &vol) {
+  SnapshotInfo info;
+  info.fileSystem = (uint32_t)vol.fs;
+  info.codePage = vol.fs == VolumeFs_FAT ? (uint32_t)vol.codePage : 0;
+  info.volumeSerial = vol.serial;
+  info.createdAt = CurrentFileTime();
+
+  SnapshotBuilder builder;
+  switch (vol.fs) {
+  case VolumeFs_NTFS: {
+    const NtfsChangeStamp &stamp = vol.ntfs->GetScanStamp();
+    info.mftLsn = stamp.mftLsn;
+    info.journalId = stamp.journalId;
+    info.journalUsn = stamp.journalUsn;
+    if (vol.ntfs->IndexesStreams())
+      info.options |= SnapshotOption_Streams;
+    vol.ntfs->ExportSnapshot(builder);
+    break;
+  }
+  case VolumeFs_FAT:
+    vol.fat->ExportSnapshot(builder);
+    break;
+  case VolumeFs_exFAT:
+    vol.exfat->ExportSnapshot(builder);
+    break;
+  default:
+    return;
+  }
+
+  CreateDirectoryW(snapshotDir.c_str(), NULL);
+  std::wstring error;
+  if (!builder.Write(SnapshotPath(drive, vol.serial), info, error) &&
+      traceCallback)
+    traceCallback(L"Index: Failed to save snapshot (" + error + L")");
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include "FatReader.h"
+#include "MFTReader.h"
+#include "exFatReader.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+enum VolumeFileSystem {
+  VolumeFs_Unknown = 0,
+  VolumeFs_NTFS,
+  VolumeFs_FAT,
+  VolumeFs_exFAT
+};
+
+// Where Ensure() got the index from.
+enum IndexSource {
+  IndexSource_Cached = 0, // Already in memory and fresh
+  IndexSource_Snapshot,   // Loaded from a saved snapshot
+  IndexSource_Scan        // Read from the volume
+};
+
+// When a cached volume index must be rebuilt.
+struct IndexPolicy {
+  uint32_t maxAgeSeconds; // 0 = never expire by age
+  bool checkVolumeSerial; // Rescan when different media shows up on a letter
+  bool useJournal;        // Keep NTFS indexes current from the USN journal
+  bool foldNames; // Pre-folded name column; off saves 2 bytes per name char
+  uint32_t scanChunkKB;    // NTFS scan read size, 0 = default
+  uint32_t scanQueueDepth; // NTFS scan reads in flight, 0 = default
+  uint32_t parseThreads;   // NTFS record parsing, 0 = one per processor
+  bool indexStreams;       // NTFS named streams as "file:stream" entries
+  bool trigramIndex;       // Trigram postings for substring queries
+  bool suffixIndex;        // Suffix array for any name query length
+  bool nameOrder;          // Sorted names for exact/prefix queries, sorting
+
+  IndexPolicy()
+      : maxAgeSeconds(300), checkVolumeSerial(true), useJournal(true),
+        foldNames(true), scanChunkKB(0), scanQueueDepth(0), parseThreads(0),
+        indexStreams(false), trigramIndex(false), suffixIndex(false),
+        nameOrder(true) {}
+};
+
+// Keeps one scanned reader per drive letter alive between searches, so a
+// repeat query only pays for matching instead of a full volume scan.
+class VolumeIndex {
+public:
+  VolumeIndex();
+  ~VolumeIndex();
+
+  // Loads the index for `drive`, scanning only if it is missing or stale
+  // under the current policy and no current snapshot exists.
+  bool Ensure(wchar_t drive, int codePage,
+              void (*progressCallback)(int, int, void *), void *userData,
+              IndexSource *source = nullptr);
+
+  // Like Ensure(), but only ever uses the index already in memory: catches
+  // it up in place where Ensure() would (NTFS journal or an unchanged
+  // volume) and fails where Ensure() would load a snapshot or scan. For
+  // searches that must not stall, such as those started by typing.
+  bool EnsureCached(wchar_t drive, int codePage);
+
+  std::vector<FileResult> Search(wchar_t drive, const std::wstring &query,
+                                 const std::wstring &targetFolder,
+                                 const SearchOptions &options = SearchOptions(),
+                                 int maxResults = -1);
+  // Entries under any of `targetFolders`, each matched once.
+  std::vector<FileResult> Search(wchar_t drive, const std::wstring &query,
+                                 const std::vector<std::wstring> &targetFolders,
+                                 const SearchOptions &options = SearchOptions(),
+                                 int maxResults = -1);
+  // Streams the matches to `onResults` in batches; returns how many were
+  // delivered, 0 if the drive has no index.
+  size_t Search(wchar_t drive, const std::wstring &query,
+                const std::vector<std::wstring> &targetFolders,
+                const SearchOptions &options, int maxResults,
+                const ResultCallback &onResults);
+  // Recursive size of `folder` (the whole volume when empty), then its
+  // `count` largest directories; empty if the drive has no index.
+  std::vector<DirectoryUsage> DiskUsage(wchar_t drive,
+                                        const std::wstring &folder,
+                                        size_t count);
+
+  bool IsLoaded(wchar_t drive) const;
+  VolumeFileSystem GetFileSystem(wchar_t drive) const;
+  // Entries of a loaded drive, nullptr if it has no index.
+  const EntryStore *GetEntries(wchar_t drive) const;
+  // Trigram index of a loaded drive, nullptr unless enabled by the policy.
+  // Empty until the first search it serves.
+  const NameTrigrams *GetTrigrams(wchar_t drive) const;
+  // Suffix array of a loaded drive, nullptr unless enabled by the policy.
+  // Empty until the first search it serves.
+  const NameSuffixArray *GetSuffixes(wchar_t drive) const;
+
+  void Invalidate(wchar_t drive);
+  // Drops every index and has each drive's next Ensure() scan it again
+  // rather than load its snapshot. Safe to call from any thread; takes
+  // effect on the next Ensure().
+  void InvalidateAll() { invalidateAll = true; }
+
+  // Snapshots are saved after each scan and tried before the next one.
+  // An empty directory disables them.
+  void SetSnapshotDirectory(const std::wstring &dir) { snapshotDir = dir; }
+
+  void SetPolicy(const IndexPolicy &p);
+  const IndexPolicy &GetPolicy() const { return policy; }
+
+  // Scans and searches give up soon after `token` is raised; a cancelled
+  // scan makes Ensure() fail and leaves no index for the drive. nullptr
+  // never cancels.
+  void SetCancelToken(const CancelToken *token);
+
+  void SetTraceCallback(std::function<void(const std::wstring &)> callback) {
+    traceCallback = callback;
+  }
+  void SetFileFoundCallback(std::function<void(const std::wstring &)> callback) {
+    fileFoundCallback = callback;
+  }
+
+  std::wstring GetLastErrorMessage() const { return lastError; }
+
+private:
+  struct Volume {
+    VolumeFileSystem fs;
+    DWORD serial;
+    int codePage;
+    ULONGLONG scannedAt; // GetTickCount64() at end of scan
+    std::unique_ptr<MFTReader> ntfs;
+    std::unique_ptr<FatReader> fat;
+    std::unique_ptr<exFatReader> exfat;
+
+    Volume() : fs(VolumeFs_Unknown), serial(0), codePage(0), scannedAt(0) {}
+  };
+
+  IndexPolicy policy;
+  std::wstring snapshotDir;
+  std::map<wchar_t, Volume> volumes;
+  std::atomic<bool> invalidateAll;
+  uint32_t rescanDrives; // Bit per letter from 'A': skip the snapshot
+  const CancelToken *cancelToken;
+  std::wstring lastError;
+
+  std::function<void(const std::wstring &)> traceCallback;
+  std::function<void(const std::wstring &)> fileFoundCallback;
+
+  template <typename Reader> void ConfigureReader(Reader &reader) const;
+  bool IsStale(const Volume &vol, VolumeFileSystem fs, DWORD serial,
+               int codePage) const;
+  bool ReuseCached(wchar_t drive, VolumeFileSystem fs, DWORD serial,
+                   int codePage);
+  bool IsNtfsUnchanged(Volume &vol);
+  bool UpdateNtfsFromJournal(Volume &vol);
+  bool ScanVolume(wchar_t drive, Volume &vol,
+                  void (*progressCallback)(int, int, void *), void *userData);
+  std::wstring SnapshotPath(wchar_t drive, DWORD serial) const;
+  bool LoadSnapshot(wchar_t drive, Volume &vol);
+  void SaveSnapshot(wchar_t drive, const Volume &vol);
+};
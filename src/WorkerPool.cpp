@@ -0,0 +1,49 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned count) : stopping(false) {
+  if (count == 0)
+    count = DefaultThreadCount();
+  for (unsigned i = 0; i < count; i++)
+    threads.emplace_back(&WorkerPool::Run, this);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+unsigned WorkerPool::DefaultThreadCount() {
+  unsigned count = std::thread::hardware_concurrency();
+  return count ? count : 1;
+}
+
+std::future<void> WorkerPool::Submit(std::function<void()> job) {
+  std::packaged_task<void()> task(std::move(job));
+  std::future<void> done = task.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(task));
+  }
+  wake.notify_one();
+  return done;
+}
+
+void WorkerPool::Run() {
+  for (;;) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this] { return stopping || !queue.empty(); });
+      if (queue.empty())
+        return; // Stopping with nothing left
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running submitted jobs in FIFO order. Each job gets a
+// future, so the caller can consume results in submission order however the
+// jobs finish. Destruction finishes the queued jobs first.
+class WorkerPool {
+public:
+  // 0 threads means one per logical processor.
+  explicit WorkerPool(unsigned threads);
+  ~WorkerPool();
+
+  std::future<void> Submit(std::function<void()> job);
+  unsigned ThreadCount() const { return (unsigned)threads.size(); }
+
+  // Logical processors, at least 1.
+  static unsigned DefaultThreadCount();
+
+private:
+  std::vector<std::thread> threads;
+  std::deque<std::packaged_task<void()>> queue;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping;
+
+  void Run();
+};
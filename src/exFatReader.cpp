@@ -1,9 +1,11 @@
 #include "exFatReader.h"
+#include "IndexSearch.h"
+#include "UpcaseTable.h"
 #include <algorithm>
-#include <regex>
-#include <sstream>
 
-exFatReader::exFatReader() : hVolume(INVALID_HANDLE_VALUE), currentDrive(0) {}
+exFatReader::exFatReader()
+    : hVolume(INVALID_HANDLE_VALUE), currentDrive(0),
+      history(new SearchHistory()), foldNames(false), cancelToken(nullptr) {}
 exFatReader::~exFatReader() { Close(); }
 
 void exFatReader::SetError(const std::wstring &msg) {
@@ -18,12 +20,25 @@ void exFatReader::SetError(const std::wstring &msg) {
     LocalFree(lpMsgBuf);
 }
 
-void exFatReader::Close() {
+void exFatReader::ReleaseVolume() {
   if (hVolume != INVALID_HANDLE_VALUE) {
     CloseHandle(hVolume);
     hVolume = INVALID_HANDLE_VALUE;
   }
-  fileMap.clear();
+}
+
+void exFatReader::Close() {
+  ReleaseVolume();
+  entries.Clear();
+  tree.Clear();
+  totals.Clear();
+  history->Clear();
+  if (trigrams)
+    trigrams->Clear();
+  if (suffixes)
+    suffixes->Clear();
+  if (names)
+    names->Clear();
 }
 
 std::wstring exFatReader::GetLastErrorMessage() const { return lastError; }
@@ -92,13 +107,20 @@ bool exFatReader::Scan(void (*progressCallback)(int, int, void *),
     return false;
 
   // Start from Root Directory
-  ProcessDirectory(rootDirectoryCluster, false, 0, 0, L"");
+  ProcessDirectory(rootDirectoryCluster, false, 0, EntryStore::NoParent, L"");
+  // The recursion unwinds on its own; the partial index is of no use
+  if (cancelToken && cancelToken->IsCancelled()) {
+    SetLastError(ERROR_CANCELLED);
+    SetError(L"Scan cancelled");
+    return false;
+  }
 
+  ApplyFolding();
   return true;
 }
 
 void exFatReader::ProcessDirectory(uint32_t cluster, bool noFatChain,
-                                   uint64_t dataLength, uint32_t parentCluster,
+                                   uint64_t dataLength, uint32_t parentId,
                                    const std::wstring &parentPath) {
   uint32_t current = cluster;
   uint32_t clusterBytes = bytesPerSector * sectorsPerCluster;
@@ -107,6 +129,8 @@ void exFatReader::ProcessDirectory(uint32_t cluster, bool noFatChain,
   uint64_t bytesProcessed = 0;
 
   while (current >= 2 && current < 0xFFFFFFF8) {
+    if (cancelToken && cancelToken->IsCancelled())
+      return;
     uint64_t sector = ClusterToSector(current);
     LARGE_INTEGER li;
     li.QuadPart = sector * bytesPerSector;
@@ -153,30 +177,29 @@ void exFatReader::ProcessDirectory(uint32_t cluster, bool noFatChain,
           fileName += part;
         }
 
-        Entry entry;
-        entry.FirstCluster = se->FirstCluster;
-        entry.ParentFirstCluster = cluster;
-        entry.Name = fileName;
-        entry.Size = se->DataLength;
-        entry.IsDirectory = (fe->FileAttributes & 0x10) != 0;
-        entry.LastWriteTime = FatTimestampToWin32(
-            fe->LastModifiedTimestamp, fe->LastModified10msIncrement);
-        entry.IsValid = true;
-
-        uint32_t id = entry.FirstCluster;
-        if (id == 0)
-          id = 0x80000000 + (uint32_t)fileMap.size();
-
-        fileMap[id] = entry;
+        bool isDirectory = (fe->FileAttributes & 0x10) != 0;
+        uint32_t id = entries.Append(
+            parentId, fileName.c_str(), fileName.length(), se->DataLength,
+            FatTimestampToWin32(fe->LastModifiedTimestamp,
+                                fe->LastModified10msIncrement),
+            isDirectory);
+        EntryTimes times;
+        times.creation = FatTimestampToWin32(fe->CreateTimestamp,
+                                             fe->Create10msIncrement);
+        times.lastAccess = FatTimestampToWin32(fe->LastAccessedTimestamp, 0);
+        entries.SetTimes(id, times);
+        entries.SetAttributes(id, fe->FileAttributes);
+        entries.SetAllocatedSize(id, (se->DataLength + clusterBytes - 1) /
+                                         clusterBytes * clusterBytes);
 
         // Move index forward
         i += 32 * secondaryCount;
 
-        if (entry.IsDirectory && entry.FirstCluster != 0) {
+        if (isDirectory && se->FirstCluster != 0) {
           bool nextNoFatChain =
               (se->GeneralSecondaryFlags & EXFAT_FLAG_NO_FAT_CHAIN) != 0;
-          ProcessDirectory(entry.FirstCluster, nextNoFatChain, entry.Size,
-                           cluster, parentPath + L"\\" + entry.Name);
+          ProcessDirectory(se->FirstCluster, nextNoFatChain, se->DataLength,
+                           id, parentPath + L"\\" + fileName);
         }
       }
     }
@@ -211,207 +234,98 @@ uint64_t exFatReader::FatTimestampToWin32(uint32_t timestamp, uint8_t tenMs) {
   st.wMilliseconds = (WORD)(tenMs * 10);
 
   FILETIME ft;
-  SystemTimeToFileTime(&st, &ft);
+  if (!SystemTimeToFileTime(&st, &ft))
+    return 0; // Unset (0) or invalid timestamp
   return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
 }
 
-bool exFatReader::MatchPattern(const std::wstring &str,
-                               const std::wstring &pattern,
-                               const SearchOptions &options) {
-  if (pattern.empty())
-    return true;
+std::vector<FileResult> exFatReader::Search(const std::wstring &query,
+                                            const std::wstring &targetFolder,
+                                            const SearchOptions &options,
+                                            int maxResults) {
+  std::vector<std::wstring> targets;
+  if (!targetFolder.empty())
+    targets.push_back(targetFolder);
+  return Search(query, targets, options, maxResults);
+}
 
-  bool matched = false;
+std::vector<FileResult>
+exFatReader::Search(const std::wstring &query,
+                    const std::vector<std::wstring> &targetFolders,
+                    const SearchOptions &options, int maxResults) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(EntryStore::NoParent, rootPath);
+  return SearchEntries(entries, paths, tree, EntryStore::NoParent, query,
+                       targetFolders, options, maxResults, cancelToken,
+                       history.get(), trigrams.get(), suffixes.get(),
+                       names.get());
+}
 
-  if (options.mode == MatchMode_Exact) {
-    if (options.ignoreCase) {
-      matched = lstrcmpiW(str.c_str(), pattern.c_str()) == 0;
-    } else {
-      matched = wcscmp(str.c_str(), pattern.c_str()) == 0;
-    }
-  } else if (options.mode == MatchMode_RegEx) {
-    try {
-      std::regex_constants::syntax_option_type flags = std::regex::ECMAScript;
-      if (options.ignoreCase)
-        flags |= std::regex::icase;
-      std::wregex re(pattern, flags);
-      matched = std::regex_search(str, re);
-    } catch (...) {
-      matched = false;
-    }
-  } else if (options.mode == MatchMode_SpaceDivided) {
-    std::wstringstream ss(pattern);
-    std::wstring token;
-    bool allTokensFound = true;
-    while (ss >> token) {
-      bool tokenFound = false;
-      if (options.ignoreCase) {
-        auto it = std::search(str.begin(), str.end(), token.begin(),
-                              token.end(), [](wchar_t c1, wchar_t c2) {
-                                return towlower(c1) == towlower(c2);
-                              });
-        tokenFound = (it != str.end());
-      } else {
-        tokenFound = (str.find(token) != std::wstring::npos);
-      }
-      if (!tokenFound) {
-        allTokensFound = false;
-        break;
-      }
-    }
-    matched = allTokensFound;
-  } else {
-    // Default: Substring
-    if (options.ignoreCase) {
-      auto it = std::search(
-          str.begin(), str.end(), pattern.begin(), pattern.end(),
-          [](wchar_t c1, wchar_t c2) { return towlower(c1) == towlower(c2); });
-      matched = it != str.end();
-    } else {
-      matched = str.find(pattern) != std::wstring::npos;
-    }
-  }
+size_t exFatReader::Search(const std::wstring &query,
+                           const std::vector<std::wstring> &targetFolders,
+                           const SearchOptions &options, int maxResults,
+                           const ResultCallback &onResults) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(EntryStore::NoParent, rootPath);
+  return SearchEntries(entries, paths, tree, EntryStore::NoParent, query,
+                       targetFolders, options, maxResults, onResults,
+                       cancelToken, history.get(),
+                       trigrams.get(), suffixes.get(), names.get());
+}
 
-  if (options.invertMatch)
-    return !matched;
-  return matched;
+std::vector<DirectoryUsage> exFatReader::DiskUsage(const std::wstring &folder,
+                                                   size_t count) {
+  std::wstring rootPath = L"";
+  rootPath += currentDrive;
+  rootPath += L":";
+  paths.SetRoot(EntryStore::NoParent, rootPath);
+  return ReportDiskUsage(entries, paths, tree, totals, EntryStore::NoParent,
+                         folder, count);
 }
 
-std::vector<FileResult> exFatReader::Search(const std::wstring &query,
-                                            const std::wstring &targetFolder,
-                                            const SearchOptions &options,
-                                            int maxResults) {
-  std::vector<FileResult> results;
-  // Similar to FatReader::Search
-  // We can't use BuildPath directly without ParentFirstCluster logic
-  // Let's implement a simple path builder or use recursion.
-  // Given the map-based approach, it's easier to reconstruct upwards.
-
-  auto BuildPathLocal = [&](const Entry &entry) {
-    std::wstring path = entry.Name;
-    uint32_t pc = entry.ParentFirstCluster;
-    while (pc != 0 && pc != rootDirectoryCluster) {
-      auto it = fileMap.find(pc);
-      if (it == fileMap.end())
-        break;
-      path = it->second.Name + L"\\" + path;
-      pc = it->second.ParentFirstCluster;
-    }
-    std::wstring drive = L"";
-    drive += currentDrive;
-    drive += L":\\";
-    return drive + path;
-  };
-
-  for (auto const &[id, entry] : fileMap) {
-    if (MatchPattern(entry.Name, query, options)) {
-      std::wstring fullPath = BuildPathLocal(entry);
-      // Filter by Target Folder
-      if (!targetFolder.empty()) {
-        if (fullPath.length() < targetFolder.length())
-          continue;
-        bool match = true;
-        for (size_t i = 0; i < targetFolder.length(); ++i) {
-          if (towlower(fullPath[i]) != towlower(targetFolder[i])) {
-            match = false;
-            break;
-          }
-        }
-        if (!match)
-          continue;
-      }
+void exFatReader::ExportSnapshot(SnapshotBuilder &builder) const {
+  ExportEntries(entries, builder);
+}
 
-      // Exclusion Filter
-      if (!options.excludePattern.empty()) {
-        bool excluded = false;
-        std::wstring targetForExclude = fullPath;
-        std::wstringstream ss(options.excludePattern);
-        std::wstring pattern;
-        while (std::getline(ss, pattern, L';')) {
-          if (pattern.empty())
-            continue;
-          if (options.ignoreCase) {
-            std::wstring targetLower = targetForExclude;
-            std::wstring patternLower = pattern;
-            for (auto &c : targetLower)
-              c = towlower(c);
-            for (auto &c : patternLower)
-              c = towlower(c);
-            if (targetLower.find(patternLower) != std::wstring::npos) {
-              excluded = true;
-              break;
-            }
-          } else {
-            if (targetForExclude.find(pattern) != std::wstring::npos) {
-              excluded = true;
-              break;
-            }
-          }
-        }
-        if (excluded)
-          continue;
-      }
+bool exFatReader::ImportSnapshot(const SnapshotView &view, TCHAR driveLetter) {
+  currentDrive = driveLetter;
+  ImportEntries(view, entries);
+  ApplyFolding();
+  return true;
+}
 
-      // Match Query (Name or Full Path)
-      if (!MatchPattern(options.matchFullPath ? fullPath : entry.Name, query,
-                        options))
-        continue;
-
-      // Metadata Filters
-      if (options.minSize > 0 && entry.Size < options.minSize)
-        continue;
-      if (options.maxSize > 0 && entry.Size > options.maxSize)
-        continue;
-      if (options.minDate > 0 && entry.LastWriteTime < options.minDate)
-        continue;
-      if (options.maxDate > 0 && entry.LastWriteTime > options.maxDate)
-        continue;
-
-      // Type Filter
-      if (entry.IsDirectory) {
-        if (!options.includeFolders)
-          continue;
-      } else {
-        if (!options.includeFiles)
-          continue;
+void exFatReader::ApplyFolding() {
+  entries.SetFoldTable(foldNames ? DefaultUpcaseTable()
+                                 : std::vector<uint16_t>());
+}
 
-        // Extension Filter (Logical AND with name match)
-        if (!options.extensionFilter.empty()) {
-          bool extMatch = false;
-          size_t dotPos = entry.Name.find_last_of(L'.');
-          std::wstring fileExt = (dotPos != std::wstring::npos)
-                                     ? entry.Name.substr(dotPos + 1)
-                                     : L"";
-          for (auto &c : fileExt)
-            c = towlower(c);
-
-          std::wstringstream ss(options.extensionFilter);
-          std::wstring extToken;
-          while (std::getline(ss, extToken, L';')) {
-            if (extToken.empty())
-              continue;
-            for (auto &c : extToken)
-              c = towlower(c);
-            if (fileExt == extToken) {
-              extMatch = true;
-              break;
-            }
-          }
-          if (!extMatch)
-            continue;
-        }
-      }
+void exFatReader::SetFoldNames(bool enable) {
+  foldNames = enable;
+  if (entries.Count() > 0 && entries.HasFoldedNames() != enable)
+    ApplyFolding();
+}
 
-      FileResult res;
-      res.Name = entry.Name;
-      res.FullPath = fullPath;
-      res.Size = entry.Size;
-      res.LastWriteTime = entry.LastWriteTime;
-      res.IsDirectory = entry.IsDirectory;
-      results.push_back(res);
-      if (maxResults > 0 && (int)results.size() >= maxResults)
-        break;
-    }
-  }
-  return results;
+void exFatReader::SetTrigramIndex(bool enable) {
+  if (!enable)
+    trigrams.reset();
+  else if (!trigrams)
+    trigrams.reset(new NameTrigrams());
+}
+
+void exFatReader::SetSuffixIndex(bool enable) {
+  if (!enable)
+    suffixes.reset();
+  else if (!suffixes)
+    suffixes.reset(new NameSuffixArray());
+}
+
+void exFatReader::SetNameOrder(bool enable) {
+  if (!enable)
+    names.reset();
+  else if (!names)
+    names.reset(new NameOrder());
 }
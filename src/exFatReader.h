@@ -3,7 +3,6 @@
 #include "exFatStructs.h"
 #include <functional>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <windows.h>
 
@@ -15,37 +14,85 @@ public:
 
   bool Initialize(TCHAR driveLetter);
   void Close();
+  // Closes the volume handle but keeps the scanned index searchable.
+  void ReleaseVolume();
   bool Scan(void (*progressCallback)(int, int, void *), void *userData,
             std::function<void(const std::wstring &)> onFileFound = nullptr);
 
   void SetTraceCallback(std::function<void(const std::wstring &)> callback) {
     traceCallback = callback;
   }
+  // Scan() and Search() give up soon after `token` is raised: a scan fails
+  // with ERROR_CANCELLED, a search stops early. nullptr never cancels.
+  void SetCancelToken(const CancelToken *token) { cancelToken = token; }
 
   std::vector<FileResult> Search(const std::wstring &query,
                                  const std::wstring &targetFolder,
                                  const SearchOptions &options = SearchOptions(),
                                  int maxResults = -1);
+  // Entries under any of `targetFolders`, each matched once.
+  std::vector<FileResult> Search(const std::wstring &query,
+                                 const std::vector<std::wstring> &targetFolders,
+                                 const SearchOptions &options = SearchOptions(),
+                                 int maxResults = -1);
+  // Streams the matches to `onResults` in batches as they are found instead
+  // of collecting them; returns how many were delivered.
+  size_t Search(const std::wstring &query,
+                const std::vector<std::wstring> &targetFolders,
+                const SearchOptions &options, int maxResults,
+                const ResultCallback &onResults);
 
+  // Disk usage below `folder` (the volume when empty): the folder's own
+  // totals, then its `count` largest directories by allocated size.
+  std::vector<DirectoryUsage> DiskUsage(const std::wstring &folder,
+                                        size_t count);
   std::wstring GetLastErrorMessage() const;
 
+  void ExportSnapshot(SnapshotBuilder &builder) const;
+  bool ImportSnapshot(const SnapshotView &view, TCHAR driveLetter);
+
+  const EntryStore &GetEntries() const { return entries; }
+
+  // Keeps a towupper()-folded copy of every name for case-insensitive
+  // searches (2 bytes per name character). Off by default.
+  void SetFoldNames(bool enable);
+  // Answers substring queries from a trigram index over the names instead of
+  // matching every name. Built on the first search it serves and rebuilt
+  // after the index changed; off by default. Disabling frees it.
+  void SetTrigramIndex(bool enable);
+  // The trigram index, null unless enabled.
+  const NameTrigrams *GetTrigrams() const { return trigrams.get(); }
+  // Answers substring, space-divided and exact name queries from a suffix
+  // array over the names, whatever their length. Built on the first search
+  // it serves and patched through a small delta after the index changed;
+  // off by default. Disabling frees it.
+  void SetSuffixIndex(bool enable);
+  // The suffix array, null unless enabled.
+  const NameSuffixArray *GetSuffixes() const { return suffixes.get(); }
+  // Keeps every name in sorted order, so exact and prefix ("readme*")
+  // queries are a binary search and results carry a NameRank to sort by.
+  // Built on the first search and merged with later changes. Disabling
+  // frees it.
+  void SetNameOrder(bool enable);
+  // The name order, null unless enabled.
+  const NameOrder *GetNameOrder() const { return names.get(); }
+
 private:
   std::wstring lastError;
   void SetError(const std::wstring &msg);
 
-  struct Entry {
-    uint32_t FirstCluster;
-    uint32_t ParentFirstCluster;
-    std::wstring Name;
-    uint64_t Size;
-    uint64_t LastWriteTime;
-    bool IsDirectory;
-    bool IsValid;
-  };
-
   HANDLE hVolume;
   TCHAR currentDrive;
-  std::unordered_map<uint32_t, Entry> fileMap;
+  EntryStore entries; // Ids in discovery order, parents passed down
+  PathCache paths;
+  DirectoryTree tree; // Built on the first folder-filtered search
+  DirectoryTotals totals; // Built on the first DiskUsage()
+  std::unique_ptr<SearchHistory> history; // The last search, for narrowing
+  std::unique_ptr<NameTrigrams> trigrams; // Null unless enabled
+  std::unique_ptr<NameSuffixArray> suffixes; // Null unless enabled
+  std::unique_ptr<NameOrder> names; // Null unless enabled
+  bool foldNames;
+  const CancelToken *cancelToken;
 
   std::function<void(const std::wstring &)> traceCallback;
 
@@ -57,12 +104,11 @@ private:
   uint32_t rootDirectoryCluster;
 
   void ProcessDirectory(uint32_t cluster, bool noFatChain, uint64_t dataLength,
-                        uint32_t parentCluster, const std::wstring &parentPath);
+                        uint32_t parentId, const std::wstring &parentPath);
   uint32_t GetNextCluster(uint32_t cluster);
   uint64_t ClusterToSector(uint32_t cluster);
 
   uint64_t FatTimestampToWin32(uint32_t timestamp, uint8_t tenMs);
 
-  bool MatchPattern(const std::wstring &str, const std::wstring &pattern,
-                    const SearchOptions &options);
+  void ApplyFolding();
 };
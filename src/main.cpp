@@ -1,9 +1,8 @@
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
-#include "FatReader.h"
 #include "Localization.h"
-#include "MFTReader.h"
-#include "exFatReader.h"
+#include "PreparedQuery.h"
+#include "VolumeIndex.h"
 #include "resource.h"
 #include <atomic>
 #include <commctrl.h>
@@ -15,6 +14,8 @@
 #include <iomanip>
 #endif
 #include <algorithm>
+#include <iterator>
+#include <mutex>
 #include <process.h>
 #include <regex>
 #include <set>
@@ -30,21 +31,36 @@
 
 // Globals
 HINSTANCE hInstBuffer;
-MFTReader mftReader;
-FatReader fatReader;
-exFatReader exFatReaderObj;
-std::vector<FileResult> searchResults;
+VolumeIndex volumeIndex;
+std::vector<FileResult> searchResults; // Only touched on the UI thread
 std::atomic<bool> isSearching(false);
+// Batches the search thread found but the UI has not taken yet
+std::mutex pendingMutex;
+std::vector<FileResult> pendingResults;
+bool pendingPosted = false; // A WM_USER + 4 is on its way
+// Raised to abort the running search; a new query restarts once it stopped
+CancelToken searchCancel;
+// Numbers each search; its final message carries it, so one from a search
+// already replaced is ignored
+std::atomic<unsigned> searchSequence(0);
+bool restartSearch = false;
+bool restartTyped = false; // The restart is for typing, not the Search button
+// The running search was started by typing and only uses indexes in memory
+std::atomic<bool> typedSearch(false);
+// The search thread is building or refreshing an index, not just searching
+std::atomic<bool> scanningVolume(false);
 HWND hList = NULL;
 HWND hTargetList = NULL;
 int currentLang = 0; // 0=English, 1=Japanese
 int currentCodePage = CP_OEMCP;
 std::vector<std::wstring> searchTargets;
 SearchOptions g_options;
+bool useSnapshots = true;
 
 // Sorting Globals
 int sortColumn = -1;
 bool sortAscending = true;
+bool sortByRank = false; // Name column: all results ranked on one volume
 
 // Subclassing Globals for Startup Fix
 WNDPROC oldEditProc = NULL;
@@ -93,6 +109,7 @@ void SaveConfig(HWND hDlg);
 void LoadConfig(HWND hDlg);
 void ResizeLayout(HWND hDlg, int cx, int cy);
 int CALLBACK CompareFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort);
+void SortList();
 std::wstring FormatSize(uint64_t size);
 INT_PTR CALLBACK ConfigDlgProc(HWND hDlg, UINT uMsg, WPARAM wParam,
                                LPARAM lParam);
@@ -197,6 +214,9 @@ void UpdateLanguage(HWND hDlg) {
     ModifyMenuW(hMenu, ID_CONFIG_OPTIONS, MF_BYCOMMAND | MF_STRING,
                 ID_CONFIG_OPTIONS,
                 Localization::GetString(IDS_MENU_SEARCH_OPTIONS));
+    ModifyMenuW(hMenu, ID_INDEX_REFRESH, MF_BYCOMMAND | MF_STRING,
+                ID_INDEX_REFRESH,
+                Localization::GetString(IDS_MENU_REFRESH_INDEX));
     ModifyMenuW(hMenu, ID_HELP_ABOUT, MF_BYCOMMAND | MF_STRING, ID_HELP_ABOUT,
                 Localization::GetString(IDS_MENU_ABOUT));
 
@@ -291,13 +311,13 @@ void UpdateLanguage(HWND hDlg) {
 
 void ScanThread(void *param) {
   HWND hDlg = (HWND)param;
+  // No other search starts before this one posts its final message
+  LPARAM sequence = (LPARAM)searchSequence.load();
 
   wchar_t queryBuf[256];
   GetDlgItemTextW(hDlg, IDC_EDIT_QUERY, queryBuf, 256);
   std::wstring query = queryBuf;
 
-  searchResults.clear();
-
   std::set<wchar_t> drivesToScan;
   for (const auto &target : searchTargets) {
     if (target.length() >= 3 && target[1] == L':') {
@@ -313,87 +333,134 @@ void ScanThread(void *param) {
   };
 
   bool anySuccess = false;
+  bool typed = typedSearch;
+  int staleDrives = 0; // Left out of a typed search
 
   for (wchar_t drive : drivesToScan) {
-    wchar_t driveRoot[] = {drive, L':', L'\\', L'\0'};
-    wchar_t fsName[MAX_PATH];
-    bool fsOk = GetVolumeInformationW(driveRoot, NULL, 0, NULL, NULL, NULL,
-                                      fsName, MAX_PATH);
-
-    if (fsOk) {
-      bool scanSuccess = false;
-      bool isNtfs = (wcscmp(fsName, L"NTFS") == 0);
-      bool isFat =
-          (wcscmp(fsName, L"FAT") == 0 || wcscmp(fsName, L"FAT32") == 0);
-      bool isExFat = (wcscmp(fsName, L"exFAT") == 0);
-
-      // Reset Progress for next drive
-      callback(0, 100, hDlg);
-
-      if (isNtfs) {
-        if (mftReader.Initialize(drive) && mftReader.Scan(callback, hDlg))
-          scanSuccess = true;
-      } else if (isFat) {
-        if (fatReader.Initialize(drive) &&
-            fatReader.Scan(currentCodePage, callback, hDlg))
-          scanSuccess = true;
-      } else if (isExFat) {
-        if (exFatReaderObj.Initialize(drive) &&
-            exFatReaderObj.Scan(callback, hDlg))
-          scanSuccess = true;
-      }
-
-      callback(100, 100, hDlg); // Ensure 100% at end
+    if (searchCancel.IsCancelled())
+      break;
+    // Reset Progress for next drive
+    callback(0, 100, hDlg);
+
+    // Reuses the cached index unless it is missing or stale. Typing never
+    // waits for a scan: a drive that needs one is left to the Search button.
+    bool scanSuccess;
+    if (typed) {
+      scanSuccess = volumeIndex.EnsureCached(drive, currentCodePage);
+      if (!scanSuccess)
+        staleDrives++;
+    } else {
+      scanningVolume = true;
+      scanSuccess = volumeIndex.Ensure(drive, currentCodePage, callback, hDlg);
+      scanningVolume = false;
+    }
 
-      if (scanSuccess) {
-        std::vector<std::wstring> driveTargets;
-        for (const auto &t : searchTargets) {
-          if (t.length() >= 3 && towupper(t[0]) == drive) {
-            driveTargets.push_back(t);
-          }
-        }
+    callback(100, 100, hDlg); // Ensure 100% at end
 
-        for (const auto &targetFolder : driveTargets) {
-          std::vector<FileResult> results;
-          if (isNtfs)
-            results = mftReader.Search(query, targetFolder, g_options, 50000);
-          else if (isFat)
-            results = fatReader.Search(query, targetFolder, currentCodePage,
-                                       g_options, 50000);
-          else if (isExFat)
-            results =
-                exFatReaderObj.Search(query, targetFolder, g_options, 50000);
-
-          searchResults.insert(searchResults.end(), results.begin(),
-                               results.end());
-          if (searchResults.size() >= 50000)
-            break;
+    if (scanSuccess) {
+      std::vector<std::wstring> driveTargets;
+      for (const auto &t : searchTargets) {
+        if (t.length() >= 3 && towupper(t[0]) == drive) {
+          driveTargets.push_back(t);
         }
-        anySuccess = true;
       }
+
+      // One pass per drive; overlapping targets only report an entry once.
+      // Batches are handed to the UI as they are found, at most one message
+      // outstanding however fast they come.
+      volumeIndex.Search(drive, query, driveTargets, g_options, 50000,
+                         [hDlg](std::vector<FileResult> &batch) {
+                           std::lock_guard<std::mutex> lock(pendingMutex);
+                           pendingResults.insert(
+                               pendingResults.end(),
+                               std::make_move_iterator(batch.begin()),
+                               std::make_move_iterator(batch.end()));
+                           if (!pendingPosted) {
+                             pendingPosted = true;
+                             PostMessage(hDlg, WM_USER + 4, 0, 0);
+                           }
+                           return true;
+                         });
+      anySuccess = true;
     }
   }
 
-  if (anySuccess) {
-    PostMessage(hDlg, WM_USER + 1, 0, 0);
+  // Cleared before the final message, so its handler may start the next
+  // search
+  bool cancelled = searchCancel.IsCancelled();
+  isSearching = false;
+  if (cancelled) {
+    PostMessage(hDlg, WM_USER + 5, 0, sequence);
+  } else if (anySuccess || staleDrives > 0) {
+    PostMessage(hDlg, WM_USER + 1, (WPARAM)staleDrives, sequence);
   } else {
     // If we scanned nothing or failed all
-    PostMessage(hDlg, WM_USER + 2, 0, 0);
+    PostMessage(hDlg, WM_USER + 2, 0, sequence);
   }
-
-  isSearching = false;
 }
 
-void PopulateList() {
+// `typed` searches come from editing the query and never scan.
+void StartSearch(HWND hDlg, bool typed = false) {
+  // Update Options
+  g_options.invertMatch =
+      (IsDlgButtonChecked(hDlg, IDC_CHECK_NOT) == BST_CHECKED);
+  // Ranks cost an update of the name order; only the Name sort uses them
+  g_options.rankNames = sortColumn == 0;
+
+  searchCancel.Reset();
+  typedSearch = typed;
+  searchSequence++;
+  isSearching = true;
+  SetDlgItemTextW(hDlg, IDC_STATUS, Localization::GetString(IDS_STATUS_BUSY));
   ListView_DeleteAllItems(hList);
+  searchResults.clear();
+  {
+    // Drop whatever a cancelled search left behind
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    pendingResults.clear();
+    pendingPosted = false;
+  }
+  _beginthread(ScanThread, 0, (void *)hDlg);
+}
+
+// Whether every target drive already has an index. Only valid while no
+// search thread runs.
+bool TargetsIndexed() {
+  if (searchTargets.empty())
+    return false;
+  for (const auto &target : searchTargets) {
+    if (target.length() < 3 || target[1] != L':' ||
+        !volumeIndex.IsLoaded(target[0]))
+      return false;
+  }
+  return true;
+}
+
+// Search as you type. Each keystroke restarts the search over the indexes
+// already in memory; the reader narrows from the last query's matches when
+// the text only grew, so that is cheap. Typing never starts a scan: with a
+// drive not indexed yet nothing happens until Search is pressed, a drive
+// whose index is out of date and cannot be caught up from the journal is
+// left out until then, and a scan in progress is left to finish before the
+// latest text is searched.
+void QueryChanged(HWND hDlg) {
+  if (isSearching) {
+    if (!restartSearch)
+      restartTyped = true;
+    restartSearch = true;
+    if (!scanningVolume)
+      searchCancel.Cancel();
+  } else if (TargetsIndexed()) {
+    StartSearch(hDlg, true);
+  }
+}
+
+// Adds searchResults[first..] to the list view.
+void AppendToList(size_t first) {
   SendMessage(hList, WM_SETREDRAW, FALSE, 0);
 
   LVITEM lvI;
-  lvI.mask = LVIF_TEXT | LVIF_STATE;
-  lvI.stateMask = 0;
-  lvI.state = 0;
-
-  for (size_t i = 0; i < searchResults.size(); ++i) {
+  for (size_t i = first; i < searchResults.size(); ++i) {
     memset(&lvI, 0, sizeof(lvI));
     lvI.mask = LVIF_TEXT | LVIF_PARAM | LVIF_STATE;
     lvI.state = 0;
@@ -415,6 +482,32 @@ void PopulateList() {
   }
 
   SendMessage(hList, WM_SETREDRAW, TRUE, 0);
+}
+
+// Moves the batches the search thread delivered so far into searchResults
+// and the list. Returns false when there were none.
+bool TakePendingResults() {
+  std::vector<FileResult> batch;
+  {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    batch.swap(pendingResults);
+    pendingPosted = false;
+  }
+  if (batch.empty())
+    return false;
+  size_t first = searchResults.size();
+  searchResults.insert(searchResults.end(),
+                       std::make_move_iterator(batch.begin()),
+                       std::make_move_iterator(batch.end()));
+  AppendToList(first);
+  return true;
+}
+
+void FinishList() {
+  TakePendingResults();
+  // Rows arrived in batches after any column sort
+  if (sortColumn >= 0)
+    SortList();
 
   // 1. Force focus away immediately
   SetFocus(GetDlgItem(GetParent(hList), IDC_EDIT_QUERY));
@@ -508,6 +601,18 @@ std::wstring GetConfigPath(bool createDir) {
   return L"FastFileSearch.ini";
 }
 
+// Snapshots live next to the ini: %LOCALAPPDATA%\FastFileSearch\Index
+std::wstring GetIndexDirectory() {
+  wchar_t path[MAX_PATH];
+  if (SUCCEEDED(SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA, NULL, SHGFP_TYPE_CURRENT,
+                                 path))) {
+    std::wstring dir = std::wstring(path) + L"\\FastFileSearch";
+    CreateDirectoryW(dir.c_str(), NULL);
+    return dir + L"\\Index";
+  }
+  return L"Index";
+}
+
 void SaveConfig(HWND hDlg) {
   std::wstring iniPath = GetConfigPath(true);
 
@@ -571,6 +676,46 @@ void SaveConfig(HWND hDlg) {
       L"SearchOptions", L"InvertMatch",
       std::to_wstring(g_options.invertMatch ? 1 : 0).c_str(), iniPath.c_str());
 
+  // Save Index Policy
+  IndexPolicy policy = volumeIndex.GetPolicy();
+  WritePrivateProfileStringW(L"Index", L"MaxAgeSeconds",
+                             std::to_wstring(policy.maxAgeSeconds).c_str(),
+                             iniPath.c_str());
+  WritePrivateProfileStringW(
+      L"Index", L"CheckVolumeSerial",
+      std::to_wstring(policy.checkVolumeSerial ? 1 : 0).c_str(),
+      iniPath.c_str());
+  WritePrivateProfileStringW(L"Index", L"UseJournal",
+                             std::to_wstring(policy.useJournal ? 1 : 0).c_str(),
+                             iniPath.c_str());
+  WritePrivateProfileStringW(L"Index", L"FoldNames",
+                             std::to_wstring(policy.foldNames ? 1 : 0).c_str(),
+                             iniPath.c_str());
+  WritePrivateProfileStringW(L"Index", L"ScanChunkKB",
+                             std::to_wstring(policy.scanChunkKB).c_str(),
+                             iniPath.c_str());
+  WritePrivateProfileStringW(L"Index", L"ScanQueueDepth",
+                             std::to_wstring(policy.scanQueueDepth).c_str(),
+                             iniPath.c_str());
+  WritePrivateProfileStringW(L"Index", L"ParseThreads",
+                             std::to_wstring(policy.parseThreads).c_str(),
+                             iniPath.c_str());
+  WritePrivateProfileStringW(
+      L"Index", L"Streams",
+      std::to_wstring(policy.indexStreams ? 1 : 0).c_str(), iniPath.c_str());
+  WritePrivateProfileStringW(
+      L"Index", L"TrigramIndex",
+      std::to_wstring(policy.trigramIndex ? 1 : 0).c_str(), iniPath.c_str());
+  WritePrivateProfileStringW(
+      L"Index", L"SuffixIndex",
+      std::to_wstring(policy.suffixIndex ? 1 : 0).c_str(), iniPath.c_str());
+  WritePrivateProfileStringW(
+      L"Index", L"NameOrder",
+      std::to_wstring(policy.nameOrder ? 1 : 0).c_str(), iniPath.c_str());
+  WritePrivateProfileStringW(L"Index", L"Snapshots",
+                             std::to_wstring(useSnapshots ? 1 : 0).c_str(),
+                             iniPath.c_str());
+
   // Clear old Targets
   WritePrivateProfileStringW(L"Targets", NULL, NULL, iniPath.c_str());
 
@@ -660,6 +805,36 @@ void LoadConfig(HWND hDlg) {
   CheckDlgButton(hDlg, IDC_CHECK_NOT,
                  g_options.invertMatch ? BST_CHECKED : BST_UNCHECKED);
 
+  // Load Index Policy
+  IndexPolicy policy;
+  policy.maxAgeSeconds = GetPrivateProfileIntW(
+      L"Index", L"MaxAgeSeconds", policy.maxAgeSeconds, iniPath.c_str());
+  policy.checkVolumeSerial =
+      GetPrivateProfileIntW(L"Index", L"CheckVolumeSerial", 1,
+                            iniPath.c_str()) != 0;
+  policy.useJournal =
+      GetPrivateProfileIntW(L"Index", L"UseJournal", 1, iniPath.c_str()) != 0;
+  policy.foldNames =
+      GetPrivateProfileIntW(L"Index", L"FoldNames", 1, iniPath.c_str()) != 0;
+  policy.scanChunkKB =
+      GetPrivateProfileIntW(L"Index", L"ScanChunkKB", 0, iniPath.c_str());
+  policy.scanQueueDepth =
+      GetPrivateProfileIntW(L"Index", L"ScanQueueDepth", 0, iniPath.c_str());
+  policy.parseThreads =
+      GetPrivateProfileIntW(L"Index", L"ParseThreads", 0, iniPath.c_str());
+  policy.indexStreams =
+      GetPrivateProfileIntW(L"Index", L"Streams", 0, iniPath.c_str()) != 0;
+  policy.trigramIndex =
+      GetPrivateProfileIntW(L"Index", L"TrigramIndex", 0, iniPath.c_str()) != 0;
+  policy.suffixIndex =
+      GetPrivateProfileIntW(L"Index", L"SuffixIndex", 0, iniPath.c_str()) != 0;
+  policy.nameOrder =
+      GetPrivateProfileIntW(L"Index", L"NameOrder", 1, iniPath.c_str()) != 0;
+  volumeIndex.SetPolicy(policy);
+  useSnapshots =
+      GetPrivateProfileIntW(L"Index", L"Snapshots", 1, iniPath.c_str()) != 0;
+  volumeIndex.SetSnapshotDirectory(useSnapshots ? GetIndexDirectory() : L"");
+
   // Load Targets
   searchTargets.clear();
   SendMessage(hTargetList, LB_RESETCONTENT, 0, 0);
@@ -692,7 +867,10 @@ int CALLBACK CompareFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort) {
   int cmp = 0;
   switch (sortColumn) {
   case 0: // Name
-    cmp = lstrcmpiW(a.Name.c_str(), b.Name.c_str());
+    if (sortByRank)
+      cmp = a.NameRank < b.NameRank ? -1 : a.NameRank > b.NameRank ? 1 : 0;
+    else
+      cmp = lstrcmpiW(a.Name.c_str(), b.Name.c_str());
     break;
   case 1: // Path
     cmp = lstrcmpiW(a.FullPath.c_str(), b.FullPath.c_str());
@@ -714,6 +892,23 @@ int CALLBACK CompareFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort) {
   return sortAscending ? cmp : -cmp;
 }
 
+// Sorts the list by sortColumn. Names from a single volume's index compare
+// by their rank in its name order instead of by text; results spanning
+// volumes, or without ranks, fall back to lstrcmpiW. Searches only rank
+// their results while the list is sorted by Name, so the first click on
+// that column sorts by text until the next search.
+void SortList() {
+  sortByRank = sortColumn == 0 && !searchResults.empty() &&
+               !searchResults[0].FullPath.empty();
+  for (size_t i = 0; i < searchResults.size() && sortByRank; i++) {
+    const FileResult &r = searchResults[i];
+    sortByRank = r.NameRank != NoNameRank && !r.FullPath.empty() &&
+                 towupper(r.FullPath[0]) ==
+                     towupper(searchResults[0].FullPath[0]);
+  }
+  ListView_SortItems(hList, CompareFunc, 0);
+}
+
 void ResizeLayout(HWND hDlg, int cx, int cy) {
   if (cx == 0 || cy == 0)
     return;
@@ -870,15 +1065,23 @@ LRESULT DrawItemWithHighlight(LPNMLVCUSTOMDRAW lplvcd, HWND hDlg) {
 
   // Collect Ranges
   if (g_options.mode == MatchMode_Exact) {
-    bool match = g_options.ignoreCase
-                     ? (lstrcmpiW(text.c_str(), query.c_str()) == 0)
-                     : (text == query);
+    // A trailing '*' matches names starting with the rest
+    bool prefix = PreparedQuery::IsPrefix(query, g_options);
+    size_t length = prefix ? query.length() - 1 : query.length();
+    bool match;
+    if (prefix)
+      match = text.length() >= length &&
+              (g_options.ignoreCase
+                   ? textLower.compare(0, length, queryLower, 0, length) == 0
+                   : text.compare(0, length, query, 0, length) == 0);
+    else
+      match = g_options.ignoreCase
+                  ? (lstrcmpiW(text.c_str(), query.c_str()) == 0)
+                  : (text == query);
     if (match)
-      ranges.push_back({0, text.length()});
+      ranges.push_back({0, prefix ? length : text.length()});
   } else if (g_options.mode == MatchMode_SpaceDivided) {
-    std::wstringstream ss(queryLower);
-    std::wstring token;
-    while (ss >> token) {
+    for (const auto &token : PreparedQuery::Terms(queryLower, g_options)) {
       size_t pos = textLower.find(token);
       while (pos != std::wstring::npos) {
         ranges.push_back({pos, token.length()});
@@ -1007,6 +1210,7 @@ INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam,
     isStartupGuarded = true; // Start guarded
 
     hInstBuffer = GetModuleHandle(NULL);
+    volumeIndex.SetCancelToken(&searchCancel);
     hList = GetDlgItem(hDlg, IDC_LIST_RESULTS);
     HWND hEdit = GetDlgItem(hDlg, IDC_EDIT_QUERY);
 
@@ -1156,23 +1360,22 @@ INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam,
   case WM_COMMAND: {
     int id = LOWORD(wParam);
     if (id == IDC_BTN_SEARCH) {
-      if (!isSearching) {
-        if (searchTargets.empty()) {
-          MessageBoxW(hDlg, L"Please add at least one search candidate.",
-                      L"Info", MB_OK);
-          break;
-        }
-
-        // Update Options
-        g_options.invertMatch =
-            (IsDlgButtonChecked(hDlg, IDC_CHECK_NOT) == BST_CHECKED);
-
-        isSearching = true;
-        SetDlgItemTextW(hDlg, IDC_STATUS,
-                        Localization::GetString(IDS_STATUS_BUSY));
-        ListView_DeleteAllItems(hList);
-        _beginthread(ScanThread, 0, (void *)hDlg);
+      if (searchTargets.empty()) {
+        MessageBoxW(hDlg, L"Please add at least one search candidate.",
+                    L"Info", MB_OK);
+        break;
       }
+      if (isSearching) {
+        // Abort the running scan or search; WM_USER + 5 starts this one
+        // once it has stopped
+        searchCancel.Cancel();
+        restartSearch = true;
+        restartTyped = false;
+      } else {
+        StartSearch(hDlg);
+      }
+    } else if (id == IDC_EDIT_QUERY && HIWORD(wParam) == EN_CHANGE) {
+      QueryChanged(hDlg);
     } else if (id == IDC_BTN_SAVE) {
       SaveResults(hDlg);
     } else if (id == IDC_BTN_ADD) {
@@ -1203,6 +1406,9 @@ INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam,
         // Options updated
       }
       break;
+    } else if (id == ID_INDEX_REFRESH) {
+      // Drop cached indexes; the next search rescans every volume
+      volumeIndex.InvalidateAll();
     } else if (id == ID_HELP_ABOUT) {
       MessageBoxW(
           hDlg,
@@ -1254,7 +1460,7 @@ INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam,
           sortColumn = pnmv->iSubItem;
           sortAscending = true;
         }
-        ListView_SortItems(hList, CompareFunc, 0);
+        SortList();
       } else if (pnm->code == NM_RCLICK) {
         LPNMITEMACTIVATE pnmitem = (LPNMITEMACTIVATE)pnm;
         if (pnmitem->iItem != -1) {
@@ -1293,18 +1499,52 @@ INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam,
     }
     break;
   }
-  case WM_USER + 1: // Search Done
-    PopulateList();
-    {
+  case WM_USER + 4: // Results found so far
+    if (TakePendingResults()) {
       wchar_t buf[100];
       wsprintfW(buf, Localization::GetString(IDS_STATUS_FOUND_FMT),
                 searchResults.size());
       SetDlgItemTextW(hDlg, IDC_STATUS, buf);
     }
+    return TRUE;
+  case WM_USER + 1: // Search Done; lParam: the search's sequence number
+    if ((unsigned)lParam != searchSequence)
+      break; // Late; the next search already started
+    if (restartSearch) {
+      // The query changed after the scan, or too late to cancel the search
+      restartSearch = false;
+      StartSearch(hDlg, restartTyped);
+      break;
+    }
+    FinishList();
+    {
+      wchar_t buf[100];
+      wsprintfW(buf, Localization::GetString(IDS_STATUS_FOUND_FMT),
+                searchResults.size());
+      std::wstring status = buf;
+      // wParam: drives a typed search left out for being out of date
+      if (wParam > 0)
+        status += Localization::GetString(IDS_STATUS_STALE_DRIVES);
+      SetDlgItemTextW(hDlg, IDC_STATUS, status.c_str());
+    }
+    break;
+  case WM_USER + 5: // Cancelled; lParam as for WM_USER + 1
+    if ((unsigned)lParam != searchSequence) {
+      // Late; the restart it was for already started, and a pending one
+      // belongs to the search now running
+    } else if (restartSearch) {
+      restartSearch = false;
+      StartSearch(hDlg, restartTyped);
+    } else {
+      SetDlgItemTextW(hDlg, IDC_STATUS,
+                      Localization::GetString(IDS_STATUS_CANCELLED));
+    }
     break;
-  case WM_USER + 2: // Error
+  case WM_USER + 2: // Error; lParam as for WM_USER + 1
   {
-    std::wstring err = mftReader.GetLastErrorMessage();
+    if ((unsigned)lParam != searchSequence)
+      break; // Late; the next search already started
+    std::wstring err = volumeIndex.GetLastErrorMessage();
     if (err.empty())
       err = L"Unknown Error or Scan Failed.";
 
@@ -1315,6 +1555,7 @@ INT_PTR CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wParam,
     SetDlgItemTextW(hDlg, IDC_STATUS, L"Failed.");
   }
     isSearching = false;
+    restartSearch = false; // Typing must not retry a failed scan
     break;
   }
   return FALSE;
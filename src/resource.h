@@ -32,6 +32,7 @@
 #define ID_POPUP_OPENFOLDER 40004
 #define ID_HELP_ABOUT 40002
 #define ID_CONFIG_OPTIONS 40003
+#define ID_INDEX_REFRESH 40005
 
 #define IDC_RADIO_SUBSTRING 1016
 #define IDC_RADIO_EXACT 1017
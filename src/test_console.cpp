@@ -1,11 +1,43 @@
 #include "FatReader.h"
+#include "IndexSearch.h"
 #include "MFTReader.h"
+#include "SubstringSearch.h"
+#include "VolumeIndex.h"
 #include "exFatReader.h"
+#include <algorithm>
+#include <chrono>
 #include <functional> // Added for std::function
 #include <iostream>
 #include <locale.h>
+#include <thread>
 #include <vector> // Added for std::vector
 #include <windows.h>
+#include <psapi.h>
+
+// Reads an attribute filter such as "+h+s-r": letters after '+' must be set,
+// letters after '-' clear. r h s d a as in dir /a, plus c (compressed),
+// e (encrypted), p (sparse), l (reparse point) and o (offline).
+static void ParseAttributes(const std::wstring &spec, SearchOptions &options) {
+  bool required = true;
+  for (wchar_t c : spec) {
+    uint32_t bit = 0;
+    switch (towlower(c)) {
+    case L'+': required = true; continue;
+    case L'-': required = false; continue;
+    case L'r': bit = FILE_ATTRIBUTE_READONLY; break;
+    case L'h': bit = FILE_ATTRIBUTE_HIDDEN; break;
+    case L's': bit = FILE_ATTRIBUTE_SYSTEM; break;
+    case L'd': bit = FILE_ATTRIBUTE_DIRECTORY; break;
+    case L'a': bit = FILE_ATTRIBUTE_ARCHIVE; break;
+    case L'c': bit = FILE_ATTRIBUTE_COMPRESSED; break;
+    case L'e': bit = FILE_ATTRIBUTE_ENCRYPTED; break;
+    case L'p': bit = FILE_ATTRIBUTE_SPARSE_FILE; break;
+    case L'l': bit = FILE_ATTRIBUTE_REPARSE_POINT; break;
+    case L'o': bit = FILE_ATTRIBUTE_OFFLINE; break;
+    }
+    (required ? options.requiredAttributes : options.excludedAttributes) |= bit;
+  }
+}
 
 int wmain(int argc, wchar_t *argv[]) {
   setlocale(LC_ALL, ""); // Use system locale
@@ -17,6 +49,22 @@ int wmain(int argc, wchar_t *argv[]) {
 
   bool verbose = false;
   bool trace = false;
+  int repeat = 0; // Extra warm searches against the cached index
+  bool verifySubstring = false; // Check the vector kernel on every name
+  bool foldNames = true;        // Pre-folded name column (--no-fold drops it)
+  uint32_t chunkKB = 0;         // NTFS scan read-ahead, 0 = default
+  uint32_t queueDepth = 0;
+  uint32_t parseThreads = 0;    // 0 = one per logical processor
+  bool indexStreams = false;    // Named streams as "file:stream" entries
+  int diskUsage = 0; // Largest directories to list under the target, 0 = off
+  bool streamResults = false; // Print every match as its batch arrives
+  int cancelAfterMs = 0; // Raise the cancel token this long into the scan
+  bool typeQuery = false; // Search every prefix of the query, as if typed
+  bool trigramIndex = false; // Trigram index, benchmarked against a scan
+  bool suffixIndex = false;  // Suffix array, benchmarked against a scan
+  bool nameOrderBench = false; // Sorted names, benchmarked against a scan
+  std::wstring snapshotDir;
+  std::wstring usnReplayFile; // Recorded USN_RECORD_V2/V3 stream to decode
   std::wstring target = L"D:";
   std::wstring query = L"ws";
   SearchOptions options;
@@ -73,6 +121,24 @@ int wmain(int argc, wchar_t *argv[]) {
       ULARGE_INTEGER uli; uli.LowPart = ft.dwLowDateTime; uli.HighPart = ft.dwHighDateTime;
       options.maxDate = uli.QuadPart;
       it = args.erase(it);
+    } else if (*it == L"--within" && std::next(it) != args.end()) {
+      // Last N hours, e.g. "--within 1" for the last hour
+      it = args.erase(it);
+      FILETIME now; GetSystemTimeAsFileTime(&now);
+      ULARGE_INTEGER uli; uli.LowPart = now.dwLowDateTime; uli.HighPart = now.dwHighDateTime;
+      options.minDate = uli.QuadPart - (uint64_t)_wtoi64(it->c_str()) * 36000000000ULL;
+      it = args.erase(it);
+    } else if (*it == L"--date-field" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      options.dateField = *it == L"created"    ? DateField_Created
+                          : *it == L"accessed" ? DateField_Accessed
+                          : *it == L"changed"  ? DateField_Changed
+                                               : DateField_Modified;
+      it = args.erase(it);
+    } else if (*it == L"--attrib" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      ParseAttributes(*it, options);
+      it = args.erase(it);
     } else if (*it == L"--files-only") {
       options.includeFiles = true;
       options.includeFolders = false;
@@ -92,11 +158,112 @@ int wmain(int argc, wchar_t *argv[]) {
       it = args.erase(it);
       options.excludePattern = *it;
       it = args.erase(it);
+    } else if (*it == L"--snapshot" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      snapshotDir = *it;
+      it = args.erase(it);
+    } else if (*it == L"--repeat" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      repeat = _wtoi(it->c_str());
+      it = args.erase(it);
+    } else if (*it == L"--verify-substring") {
+      verifySubstring = true;
+      it = args.erase(it);
+    } else if (*it == L"--no-fold") {
+      foldNames = false;
+      it = args.erase(it);
+    } else if (*it == L"--chunk-kb" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      chunkKB = (uint32_t)_wtoi(it->c_str());
+      it = args.erase(it);
+    } else if (*it == L"--queue-depth" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      queueDepth = (uint32_t)_wtoi(it->c_str());
+      it = args.erase(it);
+    } else if (*it == L"--threads" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      parseThreads = (uint32_t)_wtoi(it->c_str());
+      it = args.erase(it);
+    } else if (*it == L"--streams") {
+      indexStreams = true;
+      it = args.erase(it);
+    } else if (*it == L"--cancel-after" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      cancelAfterMs = _wtoi(it->c_str());
+      it = args.erase(it);
+    } else if (*it == L"--stream") {
+      streamResults = true;
+      it = args.erase(it);
+    } else if (*it == L"--type") {
+      typeQuery = true;
+      it = args.erase(it);
+    } else if (*it == L"--trigrams") {
+      trigramIndex = true;
+      it = args.erase(it);
+    } else if (*it == L"--suffix-array") {
+      suffixIndex = true;
+      it = args.erase(it);
+    } else if (*it == L"--name-order") {
+      nameOrderBench = true;
+      it = args.erase(it);
+    } else if (*it == L"--du" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      diskUsage = _wtoi(it->c_str());
+      it = args.erase(it);
+    } else if (*it == L"--usn-replay" && std::next(it) != args.end()) {
+      it = args.erase(it);
+      usnReplayFile = *it;
+      it = args.erase(it);
     } else {
       ++it;
     }
   }
 
+  // Decode a recorded journal stream and print the coalesced changes
+  if (!usnReplayFile.empty()) {
+    HANDLE hFile = CreateFileW(usnReplayFile.c_str(), GENERIC_READ,
+                               FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+      std::wcout << L"Failed to open " << usnReplayFile << std::endl;
+      return 1;
+    }
+    LARGE_INTEGER size;
+    std::vector<uint8_t> data;
+    DWORD bytesRead = 0;
+    bool ok = GetFileSizeEx(hFile, &size) && size.QuadPart < 0x40000000;
+    if (ok) {
+      data.resize((size_t)size.QuadPart);
+      ok = data.empty() || (ReadFile(hFile, data.data(), (DWORD)data.size(),
+                                     &bytesRead, NULL) &&
+                            bytesRead == data.size());
+    }
+    CloseHandle(hFile);
+    if (!ok) {
+      std::wcout << L"Failed to read " << usnReplayFile << std::endl;
+      return 1;
+    }
+
+    std::vector<UsnRecord> records;
+    std::wstring error;
+    if (!ParseUsnRecords(data.data(), data.size(), records, &error))
+      std::wcout << L"Parse error: " << error << std::endl;
+    UsnChangeSet changeSet;
+    changeSet.Add(records);
+    std::vector<UsnFileChange> changes = changeSet.Changes();
+    std::wcout << records.size() << L" records, " << changes.size()
+               << L" files changed" << std::endl;
+    for (const auto &c : changes) {
+      const wchar_t *action = c.action == UsnAction_Remove   ? L"Remove "
+                              : c.action == UsnAction_Upsert ? L"Upsert "
+                                                             : L"Refresh";
+      std::wcout << action << L" #" << c.fileRef << L" parent #"
+                 << c.parentRef << L" " << c.name
+                 << (c.created ? L" (created)" : L"") << std::endl;
+    }
+    return error.empty() ? 0 : 1;
+  }
+
   // Parse positional
   if (args.size() > 0)
     target = args[0];
@@ -117,6 +284,9 @@ int wmain(int argc, wchar_t *argv[]) {
              << L"\nMaxSize: " << options.maxSize << L" bytes"
              << L"\nMinDate: " << options.minDate
              << L"\nMaxDate: " << options.maxDate
+             << L"\nDateField: " << options.dateField
+             << L"\nAttributes: +0x" << std::hex << options.requiredAttributes
+             << L" -0x" << options.excludedAttributes << std::dec
              << L"\nIncludeFiles: " << (options.includeFiles ? L"Yes" : L"No")
              << L"\nIncludeFolders: " << (options.includeFolders ? L"Yes" : L"No")
              << L"\nExtensionFilter: " << options.extensionFilter
@@ -175,60 +345,402 @@ int wmain(int argc, wchar_t *argv[]) {
     };
   }
 
-  if (wcscmp(fsName, L"NTFS") == 0) {
-    MFTReader r;
-    if (trace)
-      r.SetTraceCallback([](const std::wstring &msg) {
-        std::wcout << L"[TRACE] " << msg << std::endl;
-      });
-    if (!r.Initialize(drive)) {
-      std::wcout << L"Init Failed: " << r.GetLastErrorMessage() << std::endl;
-      return 1;
-    }
+  VolumeIndex index;
+  if (trace)
+    index.SetTraceCallback([](const std::wstring &msg) {
+      std::wcout << L"[TRACE] " << msg << std::endl;
+    });
+  index.SetFileFoundCallback(verboseCb);
+  index.SetSnapshotDirectory(snapshotDir);
+  IndexPolicy policy = index.GetPolicy();
+  policy.foldNames = foldNames;
+  policy.scanChunkKB = chunkKB;
+  policy.scanQueueDepth = queueDepth;
+  policy.parseThreads = parseThreads;
+  policy.indexStreams = indexStreams;
+  policy.trigramIndex = trigramIndex;
+  policy.suffixIndex = suffixIndex;
+  index.SetPolicy(policy);
 
-    if (!r.Scan(callback, nullptr, verboseCb)) {
-      std::wcout << L"Scan Failed: " << r.GetLastErrorMessage() << std::endl;
-      return 1;
+  auto ElapsedMs = [](std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - since)
+        .count();
+  };
+
+  // Cancels the first Ensure() from another thread and reports how long
+  // the scan took to notice
+  CancelToken cancel;
+  std::chrono::steady_clock::time_point cancelledAt;
+  std::thread canceller;
+  if (cancelAfterMs > 0) {
+    index.SetCancelToken(&cancel);
+    canceller = std::thread([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(cancelAfterMs));
+      cancelledAt = std::chrono::steady_clock::now();
+      cancel.Cancel();
+    });
+  }
+
+  // Use default Code Page (OEM) for FAT short names
+  auto t0 = std::chrono::steady_clock::now();
+  IndexSource source;
+  bool ensured = index.Ensure(drive, CP_OEMCP, callback, nullptr, &source);
+  if (canceller.joinable()) {
+    canceller.join();
+    if (!ensured) {
+      std::wcout << L"Cancelled: " << index.GetLastErrorMessage()
+                 << L", stopped " << ElapsedMs(cancelledAt)
+                 << L" ms after the token was raised" << std::endl;
+      return 0;
     }
-    searchResults = r.Search(query, target, options);
+    std::wcout << L"Finished before the token was raised" << std::endl;
+    index.SetCancelToken(nullptr);
+  }
+  if (!ensured) {
+    std::wcout << L"Scan Failed: " << index.GetLastErrorMessage() << std::endl;
+    return 1;
+  }
+  double scanMs = ElapsedMs(t0);
+  std::wcout << L"Index Source: "
+             << (source == IndexSource_Snapshot ? L"Snapshot" : L"Scan")
+             << std::endl;
 
-  } else if (wcscmp(fsName, L"FAT") == 0 || wcscmp(fsName, L"FAT32") == 0) {
-    FatReader r;
-    if (trace)
-      r.SetTraceCallback([](const std::wstring &msg) {
-        std::wcout << L"[TRACE] " << msg << std::endl;
-      });
-    if (!r.Initialize(drive)) {
-      std::wcout << L"Init Failed: " << r.GetLastErrorMessage() << std::endl;
+  t0 = std::chrono::steady_clock::now();
+  searchResults = index.Search(drive, query, target, options);
+  double coldSearchMs = ElapsedMs(t0);
+
+  std::wcout << L"Index: " << scanMs << L" ms, First search: " << coldSearchMs
+             << L" ms" << std::endl;
+
+  // Memory held by the index itself and by the whole process
+  if (const EntryStore *entries = index.GetEntries(drive)) {
+    PROCESS_MEMORY_COUNTERS pmc = {0};
+    pmc.cb = sizeof(pmc);
+    K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+    std::wcout << L"Entries: " << entries->Count() << L" (+"
+               << entries->LinkCount() << L" hard links, "
+               << entries->StreamCount() << L" streams), Index memory: "
+               << entries->MemoryUsage() / (1024 * 1024) << L" MB (folded names "
+               << entries->FoldedMemoryUsage() / (1024 * 1024)
+               << L" MB), Working set: " << pmc.WorkingSetSize / (1024 * 1024)
+               << L" MB (peak " << pmc.PeakWorkingSetSize / (1024 * 1024)
+               << L" MB)" << std::endl;
+  }
+
+  // Recursive folder sizes: the target itself, then its largest directories
+  if (diskUsage > 0) {
+    // A bare drive letter means the whole volume
+    std::wstring folder = target.size() > 2 ? target : std::wstring();
+    t0 = std::chrono::steady_clock::now();
+    std::vector<DirectoryUsage> usage =
+        index.DiskUsage(drive, folder, (size_t)diskUsage);
+    double firstMs = ElapsedMs(t0);
+    t0 = std::chrono::steady_clock::now();
+    index.DiskUsage(drive, folder, (size_t)diskUsage);
+    double againMs = ElapsedMs(t0);
+    if (usage.empty())
+      std::wcout << L"Folder not found: " << target << std::endl;
+    for (const auto &u : usage)
+      std::wcout << u.totals.allocated / (1024 * 1024) << L" MB on disk, "
+                 << u.totals.size / (1024 * 1024) << L" MB, "
+                 << u.totals.files << L" files, " << u.totals.directories
+                 << L" folders  " << u.path << std::endl;
+    std::wcout << L"Disk usage: " << firstMs << L" ms (totals built), "
+               << againMs << L" ms (cached)" << std::endl;
+  }
+
+  // Differential check of the substring kernel against its scalar reference
+  const EntryStore *verifyEntries = index.GetEntries(drive);
+  if (verifySubstring && verifyEntries) {
+    SubstringSearch needle(query, options.ignoreCase);
+    std::vector<uint8_t> fast(verifyEntries->IdLimit(), 0);
+    size_t checked = 0, mismatches = 0, vectorHits = 0, scalarHits = 0;
+    auto v0 = std::chrono::steady_clock::now();
+    for (uint32_t id = 0; id < verifyEntries->IdLimit(); id++) {
+      if (verifyEntries->IsValid(id))
+        fast[id] = needle.Find(verifyEntries->Name(id),
+                               verifyEntries->NameLength(id));
+    }
+    double vectorMs = ElapsedMs(v0);
+    v0 = std::chrono::steady_clock::now();
+    for (uint32_t id = 0; id < verifyEntries->IdLimit(); id++) {
+      if (!verifyEntries->IsValid(id))
+        continue;
+      const wchar_t *name = verifyEntries->Name(id);
+      size_t length = verifyEntries->NameLength(id);
+      bool reference = needle.FindScalar(name, length);
+      checked++;
+      vectorHits += fast[id];
+      scalarHits += reference;
+      if (fast[id] != reference && mismatches++ < 20)
+        std::wcout << L"Mismatch: " << std::wstring(name, length)
+                   << L" kernel=" << (int)fast[id] << L" scalar=" << reference
+                   << std::endl;
+    }
+    double scalarMs = ElapsedMs(v0);
+    std::wcout << L"Substring kernel " << SubstringSearch::KernelName()
+               << L": " << checked << L" names, " << mismatches
+               << L" mismatches, hits " << vectorHits << L"/" << scalarHits
+               << L", " << vectorMs << L" ms vs scalar " << scalarMs
+               << L" ms" << std::endl;
+    if (mismatches)
       return 1;
+  }
+
+  // Trigram index against the linear scan over the same store: build time,
+  // size, then the query both ways (best of a few runs, no search history)
+  const EntryStore *trigramEntries = index.GetEntries(drive);
+  if (trigramIndex && trigramEntries) {
+    uint32_t rootId = index.GetFileSystem(drive) == VolumeFs_NTFS
+                          ? 0x05
+                          : EntryStore::NoParent;
+    PathCache benchPaths;
+    benchPaths.SetRoot(rootId, std::wstring(1, drive) + L":");
+    DirectoryTree benchTree;
+    std::vector<std::wstring> targets(1, target);
+    NameTrigrams trigrams;
+    t0 = std::chrono::steady_clock::now();
+    trigrams.Build(*trigramEntries);
+    double buildMs = ElapsedMs(t0);
+    std::wcout << L"Trigram index: " << trigrams.ListCount() << L" lists, "
+               << trigrams.PostingCount() << L" postings, "
+               << trigrams.MemoryUsage() / (1024 * 1024) << L" MB, built in "
+               << buildMs << L" ms" << std::endl;
+
+    auto bestOf = [&](NameTrigrams *with, size_t &found) {
+      double best = 0;
+      for (int i = 0; i < 5; i++) {
+        t0 = std::chrono::steady_clock::now();
+        found = SearchEntries(*trigramEntries, benchPaths, benchTree, rootId,
+                              query, targets, options, -1, nullptr, nullptr,
+                              with)
+                    .size();
+        double ms = ElapsedMs(t0);
+        if (i == 0 || ms < best)
+          best = ms;
+      }
+      return best;
+    };
+    size_t linearFound = 0, indexedFound = 0;
+    double linearMs = bestOf(nullptr, linearFound);
+    double indexedMs = bestOf(&trigrams, indexedFound);
+    if (!NameTrigrams::Covers(query, options)) {
+      std::wcout << L"Query not covered by the trigram index (needs a term "
+                    L"of 3+ characters, no regex, inversion or full path)"
+                 << std::endl;
+    } else {
+      t0 = std::chrono::steady_clock::now();
+      size_t candidates =
+          trigrams.Candidates(*trigramEntries, query, options).size();
+      double lookupMs = ElapsedMs(t0);
+      std::wcout << L"Trigram candidates: " << candidates << L" in "
+                 << lookupMs << L" ms" << std::endl;
     }
+    std::wcout << L"Search with trigrams: " << indexedMs << L" ms, linear: "
+               << linearMs << L" ms, results " << indexedFound << L"/"
+               << linearFound << std::endl;
+    if (indexedFound != linearFound)
+      return 1;
+  }
+
+  // Suffix array against the linear scan, the same way
+  const EntryStore *suffixEntries = index.GetEntries(drive);
+  if (suffixIndex && suffixEntries) {
+    uint32_t rootId = index.GetFileSystem(drive) == VolumeFs_NTFS
+                          ? 0x05
+                          : EntryStore::NoParent;
+    PathCache benchPaths;
+    benchPaths.SetRoot(rootId, std::wstring(1, drive) + L":");
+    DirectoryTree benchTree;
+    std::vector<std::wstring> targets(1, target);
+    NameSuffixArray suffixes;
+    t0 = std::chrono::steady_clock::now();
+    suffixes.Build(*suffixEntries);
+    double buildMs = ElapsedMs(t0);
+    std::wcout << L"Suffix array: " << suffixes.TextLength()
+               << L" characters, " << suffixes.MemoryUsage() / (1024 * 1024)
+               << L" MB, built in " << buildMs << L" ms" << std::endl;
 
-    // Use default Code Page (OEM)
-    if (!r.Scan(CP_OEMCP, callback, nullptr, verboseCb)) {
-      std::wcout << L"Scan Failed: " << r.GetLastErrorMessage() << std::endl;
+    auto bestOf = [&](NameSuffixArray *with, size_t &found) {
+      double best = 0;
+      for (int i = 0; i < 5; i++) {
+        t0 = std::chrono::steady_clock::now();
+        found = SearchEntries(*suffixEntries, benchPaths, benchTree, rootId,
+                              query, targets, options, -1, nullptr, nullptr,
+                              nullptr, with)
+                    .size();
+        double ms = ElapsedMs(t0);
+        if (i == 0 || ms < best)
+          best = ms;
+      }
+      return best;
+    };
+    size_t linearFound = 0, indexedFound = 0;
+    double linearMs = bestOf(nullptr, linearFound);
+    double indexedMs = bestOf(&suffixes, indexedFound);
+    if (!NameSuffixArray::Covers(query, options)) {
+      std::wcout << L"Query not covered by the suffix array (no regex, "
+                    L"inversion, full path or empty query)"
+                 << std::endl;
+    } else {
+      t0 = std::chrono::steady_clock::now();
+      size_t candidates =
+          suffixes.Candidates(*suffixEntries, query, options).size();
+      double lookupMs = ElapsedMs(t0);
+      std::wcout << L"Suffix array candidates: " << candidates << L" in "
+                 << lookupMs << L" ms" << std::endl;
+    }
+    std::wcout << L"Search with suffix array: " << indexedMs
+               << L" ms, linear: " << linearMs << L" ms, results "
+               << indexedFound << L"/" << linearFound << std::endl;
+    if (indexedFound != linearFound)
       return 1;
+  }
+
+  // Sorted names against the linear scan, then sorting the results by name
+  // through their ranks against lstrcmpiW
+  const EntryStore *orderEntries = index.GetEntries(drive);
+  if (nameOrderBench && orderEntries) {
+    uint32_t rootId = index.GetFileSystem(drive) == VolumeFs_NTFS
+                          ? 0x05
+                          : EntryStore::NoParent;
+    PathCache benchPaths;
+    benchPaths.SetRoot(rootId, std::wstring(1, drive) + L":");
+    DirectoryTree benchTree;
+    std::vector<std::wstring> targets(1, target);
+    NameOrder names;
+    t0 = std::chrono::steady_clock::now();
+    names.Build(*orderEntries);
+    double buildMs = ElapsedMs(t0);
+    std::wcout << L"Name order: " << names.NameCount() << L" names, "
+               << names.MemoryUsage() / (1024 * 1024) << L" MB, built in "
+               << buildMs << L" ms" << std::endl;
+
+    std::vector<FileResult> found;
+    SearchOptions ranked = options;
+    ranked.rankNames = true;
+    auto bestOf = [&](NameOrder *with) {
+      double best = 0;
+      for (int i = 0; i < 5; i++) {
+        t0 = std::chrono::steady_clock::now();
+        found = SearchEntries(*orderEntries, benchPaths, benchTree, rootId,
+                              query, targets, ranked, -1, nullptr, nullptr,
+                              nullptr, nullptr, with);
+        double ms = ElapsedMs(t0);
+        if (i == 0 || ms < best)
+          best = ms;
+      }
+      return best;
+    };
+    double linearMs = bestOf(nullptr);
+    size_t linearFound = found.size();
+    double indexedMs = bestOf(&names);
+    size_t indexedFound = found.size();
+    if (!NameOrder::Covers(query, options)) {
+      std::wcout << L"Query not covered by the name order (exact mode only, "
+                    L"no inversion or full path)"
+                 << std::endl;
+    } else {
+      t0 = std::chrono::steady_clock::now();
+      size_t candidates =
+          names.Candidates(*orderEntries, query, options).size();
+      double lookupMs = ElapsedMs(t0);
+      std::wcout << L"Name order candidates: " << candidates << L" in "
+                 << lookupMs << L" ms" << std::endl;
     }
-    searchResults = r.Search(query, target, CP_OEMCP, options);
+    std::wcout << L"Search with name order: " << indexedMs
+               << L" ms, linear: " << linearMs << L" ms, results "
+               << indexedFound << L"/" << linearFound << std::endl;
 
-  } else if (wcscmp(fsName, L"exFAT") == 0) {
-    exFatReader r;
-    if (trace)
-      r.SetTraceCallback([](const std::wstring &msg) {
-        std::wcout << L"[TRACE] " << msg << std::endl;
-      });
-    if (!r.Initialize(drive)) {
-      std::wcout << L"Init Failed: " << r.GetLastErrorMessage() << std::endl;
+    std::vector<FileResult> byText = found, byRank = found;
+    t0 = std::chrono::steady_clock::now();
+    std::sort(byText.begin(), byText.end(),
+              [](const FileResult &a, const FileResult &b) {
+                return lstrcmpiW(a.Name.c_str(), b.Name.c_str()) < 0;
+              });
+    double textMs = ElapsedMs(t0);
+    t0 = std::chrono::steady_clock::now();
+    std::sort(byRank.begin(), byRank.end(),
+              [](const FileResult &a, const FileResult &b) {
+                return a.NameRank < b.NameRank;
+              });
+    double rankMs = ElapsedMs(t0);
+    std::wcout << L"Sort " << found.size() << L" results by name: ranks "
+               << rankMs << L" ms, lstrcmpiW " << textMs << L" ms"
+               << std::endl;
+    if (indexedFound != linearFound)
       return 1;
+  }
+
+  // Warm queries: Ensure() should reuse the cached index every time
+  if (repeat > 0) {
+    double totalMs = 0, minMs = 0, maxMs = 0;
+    for (int i = 0; i < repeat; ++i) {
+      t0 = std::chrono::steady_clock::now();
+      IndexSource warmSource;
+      if (!index.Ensure(drive, CP_OEMCP, nullptr, nullptr, &warmSource)) {
+        std::wcout << L"Ensure Failed: " << index.GetLastErrorMessage()
+                   << std::endl;
+        return 1;
+      }
+      searchResults = index.Search(drive, query, target, options);
+      double ms = ElapsedMs(t0);
+      if (warmSource != IndexSource_Cached)
+        std::wcout << L"Repeat " << i << L": index was reloaded" << std::endl;
+      totalMs += ms;
+      if (i == 0 || ms < minMs)
+        minMs = ms;
+      if (i == 0 || ms > maxMs)
+        maxMs = ms;
     }
+    std::wcout << L"Warm queries: " << repeat << L" runs, avg "
+               << totalMs / repeat << L" ms, min " << minMs << L" ms, max "
+               << maxMs << L" ms" << std::endl;
+  }
 
-    if (!r.Scan(callback, nullptr, verboseCb)) {
-      std::wcout << L"Scan Failed: " << r.GetLastErrorMessage() << std::endl;
-      return 1;
+  // Search as you type: one search per keystroke. The first prefix does not
+  // narrow the full query searched above, so it is a full pass; every later
+  // one re-checks only what the previous prefix matched.
+  if (typeQuery) {
+    double totalMs = 0, maxMs = 0;
+    for (size_t length = 1; length <= query.size(); length++) {
+      std::wstring typed = query.substr(0, length);
+      t0 = std::chrono::steady_clock::now();
+      size_t found = index.Search(drive, typed, target, options).size();
+      double ms = ElapsedMs(t0);
+      std::wcout << L"Typed '" << typed << L"': " << found << L" results, "
+                 << ms << L" ms" << std::endl;
+      if (length > 1) {
+        totalMs += ms;
+        maxMs = (std::max)(maxMs, ms);
+      }
     }
-    searchResults = r.Search(query, target, options);
-  } else {
-    std::wcout << L"Unsupported File System." << std::endl;
-    return 1;
+    if (query.size() > 1)
+      std::wcout << L"Narrowed keystrokes: avg "
+                 << totalMs / (query.size() - 1) << L" ms, max " << maxMs
+                 << L" ms" << std::endl;
+  }
+
+  // Streamed search: every match is printed as its batch arrives and none
+  // are kept, so the output can be piped whatever the result count
+  if (streamResults) {
+    std::vector<std::wstring> targets(1, target);
+    size_t batches = 0;
+    double firstMs = 0;
+    t0 = std::chrono::steady_clock::now();
+    size_t streamed = index.Search(
+        drive, query, targets, options, -1,
+        [&](std::vector<FileResult> &batch) {
+          if (batches++ == 0)
+            firstMs = ElapsedMs(t0);
+          for (const auto &res : batch)
+            std::wcout << res.FullPath << L"\n";
+          return true;
+        });
+    std::wcout << L"Streamed " << streamed << L" results in " << batches
+               << L" batches, first after " << firstMs << L" ms, all after "
+               << ElapsedMs(t0) << L" ms" << std::endl;
   }
 
   std::wcout << L"Scan Complete." << std::endl;
@@ -0,0 +1,94 @@
+// Checks the vector substring kernel against its scalar reference over UTF-16
+// names, as Find() sees them on Windows: random names and needles up to the
+// kernel's 256-unit limit, with non-ASCII characters that towlower() folds
+// to ASCII (U+212A KELVIN SIGN to 'k', U+0130 to 'i') anywhere in them.
+// Usage: substring_search_test
+#include "SubstringSearch.h"
+#include <algorithm>
+#include <clocale>
+#include <cstdio>
+#include <cwctype>
+#include <random>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+static void Compare(const std::vector<uint16_t> &name,
+                    const std::vector<uint16_t> &needle, bool ignoreCase) {
+  std::wstring wideName(name.begin(), name.end());
+  std::wstring wideNeedle(needle.begin(), needle.end());
+  SubstringSearch search(wideNeedle, ignoreCase);
+  bool kernel = search.FindUtf16(name.data(), name.size());
+  bool scalar = search.FindScalar(wideName.data(), wideName.size());
+  if (kernel == scalar)
+    return;
+  if (failures++ < 10) {
+    printf("FAILED (%s): kernel %d, scalar %d\n  needle", ignoreCase ? "i" : "c",
+           kernel, scalar);
+    for (uint16_t c : needle)
+      printf(" %04X", c);
+    printf("\n  name  ");
+    for (uint16_t c : name)
+      printf(" %04X", c);
+    printf("\n");
+  }
+}
+
+static std::vector<uint16_t> Units(const wchar_t *text) {
+  std::vector<uint16_t> units;
+  for (; *text; text++)
+    units.push_back((uint16_t)*text);
+  return units;
+}
+
+int main() {
+  // towlower() folds beyond ASCII only in a Unicode locale
+  if (!setlocale(LC_CTYPE, "C.UTF-8"))
+    setlocale(LC_CTYPE, "");
+  printf("Kernel: %ls\n", SubstringSearch::KernelName());
+
+  // A non-ASCII character between the needle's first and last
+  Compare(Units(L"01234567\u212A9"), Units(L"01234567k9"), true);
+  Compare(Units(L"0123456789ab\u212Ad"), Units(L"0123456789abkd"), true);
+  Compare(Units(L"x0123456789\u0130abcdefghij"),
+          Units(L"0123456789iabcdefghij"), true);
+
+  const uint16_t alphabet[] = {'a',    'b',    'k',    'i',    'K',
+                               'I',    'Z',    '0',    '.',    ' ',
+                               0x212A, 0x0130, 0x00C4, 0x00E4, 0x03A3,
+                               0x03C3, 0x0131, 0xFF21};
+  const size_t letters = sizeof(alphabet) / sizeof(alphabet[0]);
+  std::mt19937 rng(1);
+  for (int round = 0; round < 200000; round++) {
+    size_t length = 1 + rng() % (round % 10 == 0 ? 600 : 80);
+    std::vector<uint16_t> name(length);
+    // Mostly ASCII, so the vector path runs and finds candidates
+    for (auto &c : name)
+      c = rng() % 8 ? alphabet[rng() % 10] : alphabet[rng() % letters];
+
+    size_t m = 1 + rng() % (std::min)(length, (size_t)300);
+    size_t start = rng() % (length - m + 1);
+    std::vector<uint16_t> needle(name.begin() + start,
+                                 name.begin() + start + m);
+    for (auto &c : needle) {
+      int what = rng() % 16;
+      if (what == 0)
+        c = alphabet[rng() % 10];
+      else if (what == 1 && c < 0x80)
+        c = (uint16_t)towlower(c);
+      else if (what == 2 && c == 0x212A)
+        c = 'k';
+      else if (what == 3 && c == 0x0130)
+        c = 'i';
+    }
+    Compare(name, needle, true);
+    Compare(name, needle, false);
+  }
+
+  if (failures == 0)
+    printf("All checks passed\n");
+  else
+    printf("%d checks failed\n", failures);
+  return failures == 0 ? 0 : 1;
+}
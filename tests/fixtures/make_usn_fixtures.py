@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Writes usn_v2.bin and usn_v3.bin: the same journal stream as packed
+USN_RECORD_V2 and USN_RECORD_V3 records, laid out as $UsnJrnl:$J stores them
+(8-byte aligned, the page zero-padded at the end).
+
+The stream starts from the tree UsnReplayTest.cpp sets up:
+
+    5  .            root
+    40 docs         directory in the root
+    41 old.txt      in docs
+    42 gone.txt     in docs
+    43 reused.txt   in docs
+    44 linked.txt   in docs, also linked as alias.txt in the root
+    45 shared.txt   in docs, also linked as shared-alias.txt in the root
+    46 notes.txt    in docs, with a named stream
+
+Run from this directory after changing the stream, and update the test.
+"""
+import struct
+
+ARCHIVE = 0x20
+DIRECTORY = 0x10
+
+DATA_EXTEND = 0x00000002
+FILE_CREATE = 0x00000100
+FILE_DELETE = 0x00000200
+RENAME_OLD_NAME = 0x00001000
+RENAME_NEW_NAME = 0x00002000
+HARD_LINK_CHANGE = 0x00010000
+CLOSE = 0x80000000
+
+T0 = 133000000000000000  # FILETIME of the first record
+
+
+def ref(number, sequence):
+    return (sequence << 48) | number
+
+
+# (file reference, parent reference, reason, attributes, name)
+STREAM = [
+    # Create new.txt in docs
+    (ref(50, 1), ref(40, 1), FILE_CREATE, ARCHIVE, "new.txt"),
+    (ref(50, 1), ref(40, 1), FILE_CREATE | DATA_EXTEND | CLOSE, ARCHIVE,
+     "new.txt"),
+    # Rename docs\old.txt to renamed.txt in the root
+    (ref(41, 3), ref(40, 1), RENAME_OLD_NAME, ARCHIVE, "old.txt"),
+    (ref(41, 3), ref(5, 5), RENAME_NEW_NAME, ARCHIVE, "renamed.txt"),
+    (ref(41, 3), ref(5, 5), RENAME_NEW_NAME | CLOSE, ARCHIVE, "renamed.txt"),
+    # Delete gone.txt
+    (ref(42, 2), ref(40, 1), FILE_DELETE | CLOSE, ARCHIVE, "gone.txt"),
+    # Delete reused.txt; its record number comes back as fresh.dat
+    (ref(43, 7), ref(40, 1), FILE_DELETE | CLOSE, ARCHIVE, "reused.txt"),
+    (ref(43, 8), ref(40, 1), FILE_CREATE, ARCHIVE, "fresh.dat"),
+    (ref(43, 8), ref(40, 1), FILE_CREATE | CLOSE, ARCHIVE, "fresh.dat"),
+    # Add a hard link docs\second.txt to linked.txt; the record carries the
+    # new link's name, not the file's
+    (ref(44, 1), ref(40, 1), HARD_LINK_CHANGE, ARCHIVE, "second.txt"),
+    (ref(44, 1), ref(40, 1), HARD_LINK_CHANGE | CLOSE, ARCHIVE, "second.txt"),
+    # Create a directory with a file in it
+    (ref(51, 1), ref(5, 5), FILE_CREATE, DIRECTORY, "newdir"),
+    (ref(51, 1), ref(5, 5), FILE_CREATE | CLOSE, DIRECTORY, "newdir"),
+    (ref(52, 1), ref(51, 1), FILE_CREATE | CLOSE, ARCHIVE, "inner.log"),
+    # Rename the second link of shared.txt; nothing says which link it was
+    # but the old name
+    (ref(45, 1), ref(5, 5), RENAME_OLD_NAME, ARCHIVE, "shared-alias.txt"),
+    (ref(45, 1), ref(5, 5), RENAME_NEW_NAME | CLOSE, ARCHIVE,
+     "alias-renamed.txt"),
+    # Rename a file with a named stream
+    (ref(46, 1), ref(40, 1), RENAME_OLD_NAME, ARCHIVE, "notes.txt"),
+    (ref(46, 1), ref(40, 1), RENAME_NEW_NAME | CLOSE, ARCHIVE, "notes.md"),
+]
+
+
+def record(version, usn, time, fields):
+    file_ref, parent_ref, reason, attributes, name = fields
+    encoded = name.encode("utf-16-le")
+    if version == 2:
+        refs = struct.pack("<QQ", file_ref, parent_ref)
+        name_offset = 60
+    else:
+        # FILE_ID_128: NTFS keeps the reference in the low 8 bytes
+        refs = struct.pack("<QQQQ", file_ref, 0, parent_ref, 0)
+        name_offset = 76
+    length = name_offset + len(encoded)
+    data = struct.pack("<IHH", length, version, 0) + refs
+    data += struct.pack("<qqIIII", usn, time, reason, 0, 0, attributes)
+    data += struct.pack("<HH", len(encoded), name_offset) + encoded
+    return data + b"\0" * (-len(data) % 8)
+
+
+def write(path, version):
+    out = b""
+    for i, fields in enumerate(STREAM):
+        out += record(version, 0x10000 + len(out), T0 + i * 10000000, fields)
+    out += b"\0" * 32
+    with open(path, "wb") as f:
+        f.write(out)
+
+
+write("usn_v2.bin", 2)
+write("usn_v3.bin", 3)